@@ -0,0 +1,409 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include "ofx/SpatialHash.h"
+
+
+// A headless KDTree benchmark suite.
+//
+// The sweep times buildIndex(), both findNClosestPoints() overloads and
+// findPointsWithinRadius() while varying one parameter at a time around a
+// baseline:
+//
+//   scale      N from 1e3 to 1e7 for every dimension and distribution
+//   leafSize   maxLeafSize at N = 1e5
+//   k          the number of nearest neighbors at N = 1e5
+//   radius     the expected number of radius results at N = 1e5
+//
+// Dimensions are 2, 3, 4 and 8, the last standing in for the N dimensional
+// case. Distributions are uniform in a cube, clustered (a Gaussian mixture)
+// and surface (the surface of a sphere). Radii are chosen per dataset so that
+// a query finds the requested number of points on average, which keeps the
+// radius timings comparable across distributions.
+//
+// Results are printed and written as JSON, so they can be tracked from one
+// release to the next.
+//
+// Usage: benchmark_kdtree [--json path] [--max-points n]
+
+
+enum
+{
+    NUM_QUERIES = 10000,
+    BASELINE_NUM_POINTS = 100000,
+    BASELINE_NUM_NEAREST = 16,
+    BASELINE_RADIUS_RESULTS = 32,
+    NUM_CLUSTERS = 32
+};
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+double secondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+/// \brief The point distributions.
+enum Distribution
+{
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_CLUSTERED,
+    DISTRIBUTION_SURFACE
+};
+
+
+const char* distributionName(Distribution distribution)
+{
+    switch (distribution)
+    {
+        case DISTRIBUTION_UNIFORM: return "uniform";
+        case DISTRIBUTION_CLUSTERED: return "clustered";
+        case DISTRIBUTION_SURFACE: return "surface";
+    }
+
+    return "";
+}
+
+
+/// \brief One benchmark measurement.
+struct Result
+{
+    std::string benchmark;
+    Distribution distribution = DISTRIBUTION_UNIFORM;
+    std::size_t dimension = 0;
+    std::size_t numPoints = 0;
+    std::size_t maxLeafSize = 0;
+    std::size_t numNearest = 0;
+    std::size_t radiusResults = 0;
+    double radius = 0;
+    double buildSeconds = 0;
+    double nearestMicroseconds = 0;
+    double nearestResultsMicroseconds = 0;
+    double radiusMicroseconds = 0;
+    double averageRadiusResults = 0;
+};
+
+
+/// \brief Generate points in [0, 1000]^Dimension.
+template<std::size_t Dimension>
+std::vector<std::array<float, Dimension>> makePoints(Distribution distribution,
+                                                     std::size_t count,
+                                                     std::mt19937& random)
+{
+    std::uniform_real_distribution<float> uniform(0, 1000);
+    std::normal_distribution<float> normal(0, 1);
+    std::uniform_int_distribution<std::size_t> pickCluster(0, NUM_CLUSTERS - 1);
+
+    // The cluster centers come from their own generator so that points and
+    // queries share them.
+    std::mt19937 centerRandom(Dimension);
+    std::vector<std::array<float, Dimension>> centers(NUM_CLUSTERS);
+
+    for (auto& center: centers)
+    {
+        for (auto& value: center)
+        {
+            value = uniform(centerRandom);
+        }
+    }
+
+    std::vector<std::array<float, Dimension>> points(count);
+
+    for (auto& point: points)
+    {
+        switch (distribution)
+        {
+            case DISTRIBUTION_UNIFORM:
+                for (auto& value: point)
+                {
+                    value = uniform(random);
+                }
+                break;
+            case DISTRIBUTION_CLUSTERED:
+            {
+                const auto& center = centers[pickCluster(random)];
+
+                for (std::size_t j = 0; j < Dimension; ++j)
+                {
+                    point[j] = center[j] + normal(random) * 20;
+                }
+                break;
+            }
+            case DISTRIBUTION_SURFACE:
+            {
+                // A normalized Gaussian vector is uniform on the sphere.
+                float length = 0;
+
+                for (auto& value: point)
+                {
+                    value = normal(random);
+                    length += value * value;
+                }
+
+                length = std::sqrt(std::max(length, 1e-12f));
+
+                for (auto& value: point)
+                {
+                    value = 500 + 500 * value / length;
+                }
+                break;
+            }
+        }
+    }
+
+    return points;
+}
+
+
+/// \brief Choose a radius that finds about the requested number of points.
+template<typename Tree, typename Points>
+float radiusForResults(const Tree& tree, const Points& queries, std::size_t numResults)
+{
+    typename Tree::SearchResults results;
+    std::vector<float> radii;
+
+    for (std::size_t i = 0; i < std::min(queries.size(), static_cast<std::size_t>(1000)); ++i)
+    {
+        tree.findNClosestPoints(queries[i], numResults, results);
+        radii.push_back(std::sqrt(results.back().second));
+    }
+
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    return radii[radii.size() / 2];
+}
+
+
+/// \brief Build a tree and time every query kind.
+template<std::size_t Dimension>
+Result measure(const std::string& benchmark,
+               Distribution distribution,
+               const std::vector<std::array<float, Dimension>>& points,
+               const std::vector<std::array<float, Dimension>>& queries,
+               std::size_t maxLeafSize,
+               std::size_t numNearest,
+               std::size_t radiusResults)
+{
+    typedef ofx::KDTree<std::array<float, Dimension>> Tree;
+
+    Result result;
+    result.benchmark = benchmark;
+    result.distribution = distribution;
+    result.dimension = Dimension;
+    result.numPoints = points.size();
+    result.maxLeafSize = maxLeafSize;
+    result.numNearest = numNearest;
+    result.radiusResults = radiusResults;
+
+    // Always build the tree, so small N measures the tree and not a scan.
+    Tree tree(points, maxLeafSize, false);
+    tree.setSearchBackend(Tree::SEARCH_BACKEND_TREE);
+
+    auto start = Clock::now();
+    tree.buildIndex();
+    result.buildSeconds = secondsSince(start);
+
+    const double toMicroseconds = 1e6 / queries.size();
+
+    typename Tree::Indicies indices;
+    typename Tree::DistancesSquared distancesSquared;
+    typename Tree::SearchResults results;
+
+    start = Clock::now();
+
+    for (const auto& query: queries)
+    {
+        tree.findNClosestPoints(query, numNearest, indices, distancesSquared);
+    }
+
+    result.nearestMicroseconds = secondsSince(start) * toMicroseconds;
+
+    start = Clock::now();
+
+    for (const auto& query: queries)
+    {
+        tree.findNClosestPoints(query, numNearest, results);
+    }
+
+    result.nearestResultsMicroseconds = secondsSince(start) * toMicroseconds;
+
+    result.radius = radiusForResults(tree, queries, std::min(radiusResults, points.size()));
+
+    std::size_t totalRadiusResults = 0;
+
+    start = Clock::now();
+
+    for (const auto& query: queries)
+    {
+        totalRadiusResults += tree.findPointsWithinRadius(query, static_cast<float>(result.radius), results);
+    }
+
+    result.radiusMicroseconds = secondsSince(start) * toMicroseconds;
+    result.averageRadiusResults = double(totalRadiusResults) / queries.size();
+
+    return result;
+}
+
+
+void printResult(const Result& result)
+{
+    std::printf("%-9s %-10s %4zu %9zu %5zu %4zu %10.4f %10.3f %10.3f %10.3f %8.1f\n",
+                result.benchmark.c_str(),
+                distributionName(result.distribution),
+                result.dimension,
+                result.numPoints,
+                result.maxLeafSize,
+                result.numNearest,
+                result.buildSeconds,
+                result.nearestMicroseconds,
+                result.nearestResultsMicroseconds,
+                result.radiusMicroseconds,
+                result.averageRadiusResults);
+    std::fflush(stdout);
+}
+
+
+/// \brief Run the sweep for one dimension.
+template<std::size_t Dimension>
+void runSweep(std::size_t maxPoints, std::vector<Result>& results)
+{
+    const Distribution distributions[] = {
+        DISTRIBUTION_UNIFORM,
+        DISTRIBUTION_CLUSTERED,
+        DISTRIBUTION_SURFACE
+    };
+
+    for (Distribution distribution: distributions)
+    {
+        std::mt19937 random(42);
+
+        const auto queries = makePoints<Dimension>(distribution, NUM_QUERIES, random);
+
+        for (std::size_t numPoints = 1000; numPoints <= maxPoints; numPoints *= 10)
+        {
+            const auto points = makePoints<Dimension>(distribution, numPoints, random);
+
+            results.push_back(measure<Dimension>("scale", distribution, points, queries, ofx::KDTree<std::array<float, Dimension>>::DEFAULT_MAX_LEAF_SIZE, BASELINE_NUM_NEAREST, BASELINE_RADIUS_RESULTS));
+            printResult(results.back());
+        }
+
+        const auto points = makePoints<Dimension>(distribution, std::min(maxPoints, static_cast<std::size_t>(BASELINE_NUM_POINTS)), random);
+
+        for (std::size_t maxLeafSize: { 1, 2, 4, 8, 16, 32, 64 })
+        {
+            results.push_back(measure<Dimension>("leafSize", distribution, points, queries, maxLeafSize, BASELINE_NUM_NEAREST, BASELINE_RADIUS_RESULTS));
+            printResult(results.back());
+        }
+
+        for (std::size_t numNearest: { 1, 4, 16, 64, 256 })
+        {
+            results.push_back(measure<Dimension>("k", distribution, points, queries, ofx::KDTree<std::array<float, Dimension>>::DEFAULT_MAX_LEAF_SIZE, numNearest, BASELINE_RADIUS_RESULTS));
+            printResult(results.back());
+        }
+
+        for (std::size_t radiusResults: { 8, 32, 128, 512 })
+        {
+            results.push_back(measure<Dimension>("radius", distribution, points, queries, ofx::KDTree<std::array<float, Dimension>>::DEFAULT_MAX_LEAF_SIZE, BASELINE_NUM_NEAREST, radiusResults));
+            printResult(results.back());
+        }
+    }
+}
+
+
+/// \brief Write the results as JSON.
+bool writeJSON(const std::string& path, const std::vector<Result>& results)
+{
+    std::ofstream stream(path);
+
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    stream << "{\n  \"numQueries\": " << NUM_QUERIES << ",\n  \"results\": [\n";
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+
+        stream << "    {"
+               << "\"benchmark\": \"" << result.benchmark << "\", "
+               << "\"distribution\": \"" << distributionName(result.distribution) << "\", "
+               << "\"dimension\": " << result.dimension << ", "
+               << "\"numPoints\": " << result.numPoints << ", "
+               << "\"maxLeafSize\": " << result.maxLeafSize << ", "
+               << "\"numNearest\": " << result.numNearest << ", "
+               << "\"radiusResults\": " << result.radiusResults << ", "
+               << "\"radius\": " << result.radius << ", "
+               << "\"buildSeconds\": " << result.buildSeconds << ", "
+               << "\"nearestMicroseconds\": " << result.nearestMicroseconds << ", "
+               << "\"nearestResultsMicroseconds\": " << result.nearestResultsMicroseconds << ", "
+               << "\"radiusMicroseconds\": " << result.radiusMicroseconds << ", "
+               << "\"averageRadiusResults\": " << result.averageRadiusResults
+               << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    stream << "  ]\n}\n";
+
+    return stream.good();
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string jsonPath = "benchmark_kdtree.json";
+    std::size_t maxPoints = 10000000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--max-points") == 0 && i + 1 < argc)
+        {
+            maxPoints = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            std::printf("Usage: %s [--json path] [--max-points n]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+
+    std::printf("%-9s %-10s %4s %9s %5s %4s %10s %10s %10s %10s %8s\n",
+                "benchmark", "dist", "dim", "N", "leaf", "k",
+                "build (s)", "knn (us)", "knn2 (us)", "rad (us)", "rad n");
+
+    runSweep<2>(maxPoints, results);
+    runSweep<3>(maxPoints, results);
+    runSweep<4>(maxPoints, results);
+    runSweep<8>(maxPoints, results);
+
+    if (!writeJSON(jsonPath, results))
+    {
+        std::printf("\nFAILED: could not write %s.\n", jsonPath.c_str());
+        return 1;
+    }
+
+    std::printf("\nWrote %zu results to %s.\n", results.size(), jsonPath.c_str());
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "ofx/SpatialHash.h"
+
+
+// A headless benchmark comparing N dimensional indices.
+//
+// Points are drawn from a mixture of Gaussian clusters, which is closer to
+// real feature vectors than a uniform cube. Each index is built once and then
+// queried for the nearest neighbors of points drawn from the same mixture.
+//
+// The second table trades recall for speed with the approximate KDForest.
+// Recall is the fraction of the exact nearest neighbors that were returned.
+
+
+enum
+{
+    NUM_POINTS = 100000,
+    NUM_QUERIES = 1000,
+    NUM_CLUSTERS = 64,
+    NUM_NEAREST = 10
+};
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+double secondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+template<std::size_t Dimension>
+std::vector<std::array<float, Dimension>> makeClusteredPoints(std::size_t count,
+                                                              std::mt19937& random)
+{
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::normal_distribution<float> normal(0, 0.15f);
+    std::uniform_int_distribution<std::size_t> pickCluster(0, NUM_CLUSTERS - 1);
+
+    // The cluster centers are fixed by a separate generator so that points
+    // and queries share them.
+    std::mt19937 centerRandom(Dimension);
+    std::vector<std::array<float, Dimension>> centers(NUM_CLUSTERS);
+
+    for (auto& center: centers)
+    {
+        for (auto& value: center)
+        {
+            value = uniform(centerRandom);
+        }
+    }
+
+    std::vector<std::array<float, Dimension>> points(count);
+
+    for (auto& point: points)
+    {
+        const auto& center = centers[pickCluster(random)];
+
+        for (std::size_t j = 0; j < Dimension; ++j)
+        {
+            point[j] = center[j] + normal(random);
+        }
+    }
+
+    return points;
+}
+
+
+template<typename IndexType, typename QueriesType>
+double timeQueries(IndexType& index, const QueriesType& queries)
+{
+    typename IndexType::SearchResults results;
+
+    const auto start = Clock::now();
+
+    for (const auto& query: queries)
+    {
+        index.findNClosestPoints(query, NUM_NEAREST, results);
+    }
+
+    return secondsSince(start);
+}
+
+
+template<std::size_t Dimension>
+void runBenchmark()
+{
+    typedef std::array<float, Dimension> Point;
+
+    std::mt19937 random(42);
+
+    const std::vector<Point> points = makeClusteredPoints<Dimension>(NUM_POINTS, random);
+    const std::vector<Point> queries = makeClusteredPoints<Dimension>(NUM_QUERIES, random);
+
+    auto start = Clock::now();
+    ofx::KDTree<Point> kdTree(points);
+    const double kdTreeBuild = secondsSince(start);
+
+    start = Clock::now();
+    ofx::VPTree<Point> vpTree(points);
+    const double vpTreeBuild = secondsSince(start);
+
+    ofx::KDTree<Point> bruteForce(points, ofx::KDTree<Point>::DEFAULT_MAX_LEAF_SIZE, false);
+    bruteForce.setSearchBackend(ofx::KDTree<Point>::SEARCH_BACKEND_BRUTE_FORCE);
+    bruteForce.buildIndex();
+
+    const double kdTreeQuery = timeQueries(kdTree, queries);
+    const double vpTreeQuery = timeQueries(vpTree, queries);
+    const double bruteForceQuery = timeQueries(bruteForce, queries);
+
+    const double toMicroseconds = 1e6 / NUM_QUERIES;
+
+    std::printf("%5zu %12.3f %12.3f %12.1f %12.1f %12.1f\n",
+                Dimension,
+                kdTreeBuild,
+                vpTreeBuild,
+                kdTreeQuery * toMicroseconds,
+                vpTreeQuery * toMicroseconds,
+                bruteForceQuery * toMicroseconds);
+}
+
+
+template<std::size_t Dimension>
+void runRecallBenchmark()
+{
+    typedef std::array<float, Dimension> Point;
+
+    std::mt19937 random(42);
+
+    const std::vector<Point> points = makeClusteredPoints<Dimension>(NUM_POINTS, random);
+    const std::vector<Point> queries = makeClusteredPoints<Dimension>(NUM_QUERIES, random);
+
+    ofx::KDTree<Point> kdTree(points);
+
+    // The exact neighbors.
+    std::vector<typename ofx::KDTree<Point>::SearchResults> exact(queries.size());
+
+    const auto start = Clock::now();
+
+    for (std::size_t i = 0; i < queries.size(); ++i)
+    {
+        kdTree.findNClosestPoints(queries[i], NUM_NEAREST, exact[i]);
+    }
+
+    const double kdTreeQuery = secondsSince(start);
+
+    ofx::KDForest<Point> kdForest(points);
+
+    const int checks[] = { 32, 64, 128, 256, 512, 1024, 2048 };
+
+    for (int check: checks)
+    {
+        kdForest.setChecks(check);
+
+        std::vector<typename ofx::KDForest<Point>::SearchResults> approximate(queries.size());
+
+        const auto forestStart = Clock::now();
+
+        for (std::size_t i = 0; i < queries.size(); ++i)
+        {
+            kdForest.findNClosestPoints(queries[i], NUM_NEAREST, approximate[i]);
+        }
+
+        const double kdForestQuery = secondsSince(forestStart);
+
+        std::size_t found = 0;
+        std::size_t total = 0;
+
+        for (std::size_t i = 0; i < queries.size(); ++i)
+        {
+            for (const auto& result: exact[i])
+            {
+                for (const auto& candidate: approximate[i])
+                {
+                    if (candidate.first == result.first)
+                    {
+                        ++found;
+                        break;
+                    }
+                }
+            }
+
+            total += exact[i].size();
+        }
+
+        std::printf("%5zu %8d %10.3f %12.1f %10.1fx\n",
+                    Dimension,
+                    check,
+                    double(found) / total,
+                    kdForestQuery * 1e6 / NUM_QUERIES,
+                    kdTreeQuery / kdForestQuery);
+    }
+}
+
+
+int main()
+{
+    std::printf("%d points, %d queries, %d nearest neighbors\n\n", NUM_POINTS, NUM_QUERIES, NUM_NEAREST);
+    std::printf("%5s %12s %12s %12s %12s %12s\n", "", "KDTree", "VPTree", "KDTree", "VPTree", "Linear");
+    std::printf("%5s %12s %12s %12s %12s %12s\n", "dim", "build (s)", "build (s)", "query (us)", "query (us)", "query (us)");
+
+    runBenchmark<2>();
+    runBenchmark<4>();
+    runBenchmark<8>();
+    runBenchmark<16>();
+    runBenchmark<32>();
+    runBenchmark<64>();
+    runBenchmark<128>();
+
+    std::printf("\nKDForest with %d trees\n\n", int(ofx::KDForest<std::array<float, 2>>::DEFAULT_NUM_TREES));
+    std::printf("%5s %8s %10s %12s %11s\n", "dim", "checks", "recall", "query (us)", "vs KDTree");
+
+    runRecallBenchmark<32>();
+    runRecallBenchmark<128>();
+
+    return 0;
+}
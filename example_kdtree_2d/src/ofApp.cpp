@@ -44,9 +44,8 @@ void ofApp::update()
 
     if (MODE_RADIUS == mode)
     {
-        // An estimate of the number of points we are expecting to find.
-        searchResults.resize(NUM_POINTS / 4);
-
+        // The search reserves the results from its own estimate of the
+        // number of points within the radius.
         hash.findPointsWithinRadius(mouse, radius, searchResults);
     }
     else
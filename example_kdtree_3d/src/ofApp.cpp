@@ -50,24 +50,8 @@ void ofApp::update()
 
     if (MODE_RADIUS == mode)
     {
-        // An estimate of the number of points we are expecting to find.
-
-        // Estimate the volume of our seach envelope as a cube.
-        // A cube already overestimates a spherical search space.
-        float approxCubicSearchBoxSize = (radius * 2 * radius * 2 * radius * 2);
-
-        // Calculate the volume of our total search space as a cube.
-        float approxCubicSearchSpaceSize = (ofGetWidth() * ofGetHeight() * 2 * 500);
-
-        // Determine the percentage of the total search space we expect to capture.
-        float approxPercentageOfTotalPixels = approxCubicSearchBoxSize / approxCubicSearchSpaceSize;
-
-        // Assuming an uniform distribution of points in our search space,
-        // get a percentage of them.
-        std::size_t approximateNumPointsToFind = points.size() * approxPercentageOfTotalPixels;
-
-        searchResults.resize(approximateNumPointsToFind);
-        
+        // The search reserves the results from its own estimate of the
+        // number of points within the radius.
         hash.findPointsWithinRadius(firefly, radius, searchResults);
     }
     else
@@ -0,0 +1,1018 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "ofx/Box.h"
+#include "ofx/VectorData.h"
+
+
+namespace ofx {
+
+
+/// \brief A bounding volume hierarchy over 3D primitives.
+///
+/// Unlike the point indices, the BVH indexes triangles, line segments and axis
+/// aligned boxes, so closest point queries return the true closest point on a
+/// surface or polyline rather than the closest vertex. The hierarchy is built
+/// top-down with a binned surface area heuristic and stored as a flat node
+/// array.
+///
+/// Primitives are added with the add*() methods and become searchable after
+/// buildIndex() is called. Each add*() method returns the id of the first
+/// primitive it added. Ids are assigned consecutively in insertion order.
+///
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The primitive id type.
+template<typename FloatType = float,
+         typename IndexType = std::size_t>
+class BVH
+{
+public:
+    /// \brief A typedef for a 3D vector.
+    typedef std::array<FloatType, 3> Vec3;
+
+    /// \brief A typedef for a primitive id, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief The primitive types stored in the BVH.
+    enum PrimitiveType
+    {
+        /// \brief A triangle with vertices a, b and c.
+        PRIMITIVE_TRIANGLE,
+        /// \brief A line segment from a to b.
+        PRIMITIVE_SEGMENT,
+        /// \brief An axis aligned box from a (minimum) to b (maximum).
+        PRIMITIVE_BOX
+    };
+
+    /// \brief A primitive stored in the BVH.
+    struct Primitive
+    {
+        /// \brief The primitive type.
+        PrimitiveType type = PRIMITIVE_TRIANGLE;
+
+        /// \brief The first vertex, or the minimum corner of a box.
+        Vec3 a;
+
+        /// \brief The second vertex, or the maximum corner of a box.
+        Vec3 b;
+
+        /// \brief The third vertex of a triangle.
+        Vec3 c;
+    };
+
+    /// \brief The result of a closest primitive query.
+    struct ClosestPrimitive
+    {
+        /// \brief The id of the closest primitive.
+        IndexType primitive = 0;
+
+        /// \brief The squared distance to the closest point.
+        FloatType distanceSquared = std::numeric_limits<FloatType>::max();
+
+        /// \brief The closest point on the primitive.
+        Vec3 point;
+    };
+
+    /// \brief The result of a ray query.
+    struct RayHit
+    {
+        /// \brief The id of the primitive that was hit.
+        IndexType primitive = 0;
+
+        /// \brief The ray parameter of the hit, origin + t * direction.
+        FloatType t = std::numeric_limits<FloatType>::max();
+
+        /// \brief The hit point.
+        Vec3 point;
+    };
+
+    /// \brief Create an empty BVH.
+    /// \param maxLeafSize The maximum number of primitives in a leaf.
+    BVH(std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE):
+        _maxLeafSize(std::max(static_cast<std::size_t>(1), maxLeafSize))
+    {
+    }
+
+    /// \brief Destroy the BVH.
+    virtual ~BVH()
+    {
+    }
+
+    /// \brief Remove all primitives and the index.
+    void clear()
+    {
+        _primitives.clear();
+        _nodes.clear();
+        _order.clear();
+    }
+
+    /// \returns the number of primitives.
+    std::size_t size() const
+    {
+        return _primitives.size();
+    }
+
+    /// \returns the primitive with the given id.
+    const Primitive& getPrimitive(IndexType id) const
+    {
+        return _primitives[id];
+    }
+
+    /// \brief Add a triangle.
+    /// \returns the id of the triangle.
+    template <typename VectorType>
+    IndexType addTriangle(const VectorType& a, const VectorType& b, const VectorType& c)
+    {
+        Primitive primitive;
+        primitive.type = PRIMITIVE_TRIANGLE;
+        primitive.a = toVec3(a);
+        primitive.b = toVec3(b);
+        primitive.c = toVec3(c);
+        return add(primitive);
+    }
+
+    /// \brief Add a line segment.
+    /// \returns the id of the segment.
+    template <typename VectorType>
+    IndexType addSegment(const VectorType& a, const VectorType& b)
+    {
+        Primitive primitive;
+        primitive.type = PRIMITIVE_SEGMENT;
+        primitive.a = toVec3(a);
+        primitive.b = toVec3(b);
+        primitive.c = primitive.b;
+        return add(primitive);
+    }
+
+    /// \brief Add an axis aligned box.
+    /// \returns the id of the box.
+    template <typename VectorType>
+    IndexType addBox(const VectorType& minimum, const VectorType& maximum)
+    {
+        Primitive primitive;
+        primitive.type = PRIMITIVE_BOX;
+        primitive.a = toVec3(minimum);
+        primitive.b = toVec3(maximum);
+        primitive.c = primitive.b;
+        return add(primitive);
+    }
+
+    /// \brief Add indexed triangles.
+    /// \param vertices The vertex positions.
+    /// \param indices Three vertex indices per triangle.
+    /// \returns the id of the first triangle.
+    template <typename VectorType, typename VertexIndexType>
+    IndexType addTriangles(const std::vector<VectorType>& vertices,
+                           const std::vector<VertexIndexType>& indices)
+    {
+        const IndexType first = static_cast<IndexType>(_primitives.size());
+
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            addTriangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+        }
+
+        return first;
+    }
+
+    /// \brief Add the segments of a polyline.
+    /// \param vertices The polyline vertices.
+    /// \param closed True if the last vertex connects back to the first.
+    /// \returns the id of the first segment.
+    template <typename VectorType>
+    IndexType addPolyline(const std::vector<VectorType>& vertices, bool closed)
+    {
+        const IndexType first = static_cast<IndexType>(_primitives.size());
+
+        for (std::size_t i = 1; i < vertices.size(); ++i)
+        {
+            addSegment(vertices[i - 1], vertices[i]);
+        }
+
+        if (closed && vertices.size() > 2)
+        {
+            addSegment(vertices.back(), vertices.front());
+        }
+
+        return first;
+    }
+
+    /// \brief Add an indexed triangle strip.
+    ///
+    /// The winding of every other triangle is flipped to keep the strip
+    /// consistent.
+    ///
+    /// \param vertices The vertex positions.
+    /// \param indices The vertex indices of the strip.
+    /// \returns the id of the first triangle.
+    template <typename VectorType, typename VertexIndexType>
+    IndexType addTriangleStrip(const std::vector<VectorType>& vertices,
+                               const std::vector<VertexIndexType>& indices)
+    {
+        const IndexType first = static_cast<IndexType>(_primitives.size());
+
+        for (std::size_t i = 2; i < indices.size(); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                addTriangle(vertices[indices[i - 2]], vertices[indices[i - 1]], vertices[indices[i]]);
+            }
+            else
+            {
+                addTriangle(vertices[indices[i - 1]], vertices[indices[i - 2]], vertices[indices[i]]);
+            }
+        }
+
+        return first;
+    }
+
+    /// \brief Add an indexed triangle fan.
+    /// \param vertices The vertex positions.
+    /// \param indices The vertex indices of the fan, starting with the center.
+    /// \returns the id of the first triangle.
+    template <typename VectorType, typename VertexIndexType>
+    IndexType addTriangleFan(const std::vector<VectorType>& vertices,
+                             const std::vector<VertexIndexType>& indices)
+    {
+        const IndexType first = static_cast<IndexType>(_primitives.size());
+
+        for (std::size_t i = 2; i < indices.size(); ++i)
+        {
+            addTriangle(vertices[indices[0]], vertices[indices[i - 1]], vertices[indices[i]]);
+        }
+
+        return first;
+    }
+
+    /// \brief Build the hierarchy over all added primitives.
+    void buildIndex()
+    {
+        _nodes.clear();
+        _order.resize(_primitives.size());
+
+        if (_primitives.empty())
+        {
+            return;
+        }
+
+        _bounds.resize(_primitives.size());
+        _centroids.resize(_primitives.size());
+
+        for (std::size_t i = 0; i < _primitives.size(); ++i)
+        {
+            _order[i] = static_cast<IndexType>(i);
+            _bounds[i] = primitiveBounds(_primitives[i]);
+
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                _centroids[i][j] = (_bounds[i].low[j] + _bounds[i].high[j]) / 2;
+            }
+        }
+
+        _nodes.reserve(_primitives.size() * 2);
+        _nodes.push_back(Node());
+        subdivide(0, 0, _primitives.size());
+
+        _bounds = std::vector<Box>();
+        _centroids = std::vector<Vec3>();
+    }
+
+    /// \brief Find the primitive closest to a point.
+    /// \param point The query point.
+    /// \param result The closest primitive, its squared distance and closest point.
+    /// \param maxDistance Only primitives closer than this are considered.
+    /// \returns true iff a primitive was found.
+    template <typename VectorType>
+    bool findClosestPrimitive(const VectorType& point,
+                              ClosestPrimitive& result,
+                              FloatType maxDistance = std::numeric_limits<FloatType>::max()) const
+    {
+        const Vec3 p = toVec3(point);
+
+        result = ClosestPrimitive();
+
+        if (maxDistance < std::sqrt(std::numeric_limits<FloatType>::max()))
+        {
+            result.distanceSquared = maxDistance * maxDistance;
+        }
+
+        bool found = false;
+
+        if (_nodes.empty())
+        {
+            return false;
+        }
+
+        std::vector<std::pair<std::uint32_t, FloatType>> stack;
+        stack.reserve(64);
+        stack.push_back(std::make_pair(0u, _nodes[0].bounds.distanceSquared(p.data())));
+
+        while (!stack.empty())
+        {
+            const std::uint32_t nodeIndex = stack.back().first;
+            const FloatType nodeDistance = stack.back().second;
+            stack.pop_back();
+
+            if (nodeDistance >= result.distanceSquared)
+            {
+                continue;
+            }
+
+            const Node& node = _nodes[nodeIndex];
+
+            if (node.count > 0)
+            {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    Vec3 closest = {{ 0, 0, 0 }};
+                    const FloatType distance = closestPoint(_primitives[_order[i]], p, closest);
+
+                    if (distance < result.distanceSquared)
+                    {
+                        result.primitive = _order[i];
+                        result.distanceSquared = distance;
+                        result.point = closest;
+                        found = true;
+                    }
+                }
+            }
+            else
+            {
+                const FloatType distance0 = _nodes[node.first].bounds.distanceSquared(p.data());
+                const FloatType distance1 = _nodes[node.first + 1].bounds.distanceSquared(p.data());
+
+                // Push the farther child first so the nearer one is visited next.
+                if (distance0 < distance1)
+                {
+                    stack.push_back(std::make_pair(node.first + 1, distance1));
+                    stack.push_back(std::make_pair(node.first, distance0));
+                }
+                else
+                {
+                    stack.push_back(std::make_pair(node.first, distance0));
+                    stack.push_back(std::make_pair(node.first + 1, distance1));
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /// \brief Find all primitives within a radius of a point.
+    /// \param point The query point.
+    /// \param radius The radius to search within.
+    /// \param results The primitive ids and squared distances to their closest points.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of primitives found.
+    template <typename VectorType>
+    std::size_t findPrimitivesWithinRadius(const VectorType& point,
+                                           FloatType radius,
+                                           SearchResults& results,
+                                           bool sorted = true) const
+    {
+        results.clear();
+
+        if (_nodes.empty())
+        {
+            return 0;
+        }
+
+        const Vec3 p = toVec3(point);
+        const FloatType radiusSquared = radius * radius;
+
+        std::vector<std::uint32_t> stack;
+        stack.reserve(64);
+        stack.push_back(0);
+
+        while (!stack.empty())
+        {
+            const Node& node = _nodes[stack.back()];
+            stack.pop_back();
+
+            if (node.bounds.distanceSquared(p.data()) >= radiusSquared)
+            {
+                continue;
+            }
+
+            if (node.count > 0)
+            {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    Vec3 closest = {{ 0, 0, 0 }};
+                    const FloatType distance = closestPoint(_primitives[_order[i]], p, closest);
+
+                    if (distance < radiusSquared)
+                    {
+                        results.push_back(std::make_pair(_order[i], distance));
+                    }
+                }
+            }
+            else
+            {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+            }
+        }
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), [](const IndexDistanceSquaredPair& a,
+                                                         const IndexDistanceSquaredPair& b)
+            {
+                return a.second < b.second;
+            });
+        }
+
+        return results.size();
+    }
+
+    /// \brief Find the first primitive hit by a ray.
+    ///
+    /// Triangles and boxes can be hit. Segments have no area and are ignored.
+    ///
+    /// \param origin The ray origin.
+    /// \param direction The ray direction, which need not be normalized.
+    /// \param hit The closest hit.
+    /// \param tMax Only hits with t < tMax are considered.
+    /// \returns true iff a primitive was hit.
+    template <typename VectorType>
+    bool intersectRay(const VectorType& origin,
+                      const VectorType& direction,
+                      RayHit& hit,
+                      FloatType tMax = std::numeric_limits<FloatType>::max()) const
+    {
+        const Vec3 o = toVec3(origin);
+        const Vec3 d = toVec3(direction);
+
+        Vec3 inverse;
+
+        for (std::size_t j = 0; j < 3; ++j)
+        {
+            inverse[j] = FloatType(1) / d[j];
+        }
+
+        hit = RayHit();
+        hit.t = tMax;
+
+        bool found = false;
+
+        if (_nodes.empty())
+        {
+            return false;
+        }
+
+        std::vector<std::pair<std::uint32_t, FloatType>> stack;
+        stack.reserve(64);
+
+        FloatType entry = 0;
+
+        if (_nodes[0].bounds.intersectRay(o, inverse, hit.t, entry))
+        {
+            stack.push_back(std::make_pair(0u, entry));
+        }
+
+        while (!stack.empty())
+        {
+            const std::uint32_t nodeIndex = stack.back().first;
+            const FloatType nodeEntry = stack.back().second;
+            stack.pop_back();
+
+            if (nodeEntry >= hit.t)
+            {
+                continue;
+            }
+
+            const Node& node = _nodes[nodeIndex];
+
+            if (node.count > 0)
+            {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    FloatType t = 0;
+
+                    if (intersectPrimitive(_primitives[_order[i]], o, d, inverse, hit.t, t))
+                    {
+                        hit.primitive = _order[i];
+                        hit.t = t;
+                        found = true;
+                    }
+                }
+            }
+            else
+            {
+                FloatType entry0 = 0;
+                FloatType entry1 = 0;
+
+                const bool hit0 = _nodes[node.first].bounds.intersectRay(o, inverse, hit.t, entry0);
+                const bool hit1 = _nodes[node.first + 1].bounds.intersectRay(o, inverse, hit.t, entry1);
+
+                // Push the farther child first so the nearer one is visited next.
+                if (hit0 && hit1 && entry0 < entry1)
+                {
+                    stack.push_back(std::make_pair(node.first + 1, entry1));
+                    stack.push_back(std::make_pair(node.first, entry0));
+                }
+                else
+                {
+                    if (hit0)
+                    {
+                        stack.push_back(std::make_pair(node.first, entry0));
+                    }
+
+                    if (hit1)
+                    {
+                        stack.push_back(std::make_pair(node.first + 1, entry1));
+                    }
+                }
+            }
+        }
+
+        if (found)
+        {
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                hit.point[j] = o[j] + d[j] * hit.t;
+            }
+        }
+
+        return found;
+    }
+
+    enum
+    {
+        /// \brief The default maximum number of primitives in a leaf.
+        DEFAULT_MAX_LEAF_SIZE = 4,
+
+        /// \brief The number of bins used to evaluate split candidates.
+        NUM_BINS = 16
+    };
+
+protected:
+    /// \brief An axis aligned bounding box that starts empty.
+    struct Box: public ofx::Box<FloatType, 3>
+    {
+        Box()
+        {
+            this->reset();
+        }
+
+        /// \returns half of the surface area, or 0 for an empty box.
+        FloatType halfArea() const
+        {
+            if (this->low[0] > this->high[0])
+            {
+                return 0;
+            }
+
+            const FloatType x = this->high[0] - this->low[0];
+            const FloatType y = this->high[1] - this->low[1];
+            const FloatType z = this->high[2] - this->low[2];
+            return x * y + y * z + z * x;
+        }
+
+        /// \brief Intersect a ray with the box using the slab test.
+        /// \returns true iff the ray enters the box before tMax.
+        bool intersectRay(const Vec3& origin,
+                          const Vec3& inverse,
+                          FloatType tMax,
+                          FloatType& entry) const
+        {
+            FloatType tNear = 0;
+            FloatType tFar = tMax;
+
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                FloatType t0 = (this->low[j] - origin[j]) * inverse[j];
+                FloatType t1 = (this->high[j] - origin[j]) * inverse[j];
+
+                if (t0 > t1)
+                {
+                    std::swap(t0, t1);
+                }
+
+                // NaN from 0 * inf fails both comparisons and is ignored.
+                if (t0 > tNear)
+                {
+                    tNear = t0;
+                }
+
+                if (t1 < tFar)
+                {
+                    tFar = t1;
+                }
+
+                if (tNear > tFar)
+                {
+                    return false;
+                }
+            }
+
+            entry = tNear;
+            return true;
+        }
+    };
+
+    /// \brief A hierarchy node.
+    struct Node
+    {
+        /// \brief The node bounds.
+        Box bounds;
+
+        /// \brief The first primitive slot of a leaf, or the left child index.
+        std::uint32_t first = 0;
+
+        /// \brief The number of primitives in a leaf, or 0 for internal nodes.
+        std::uint32_t count = 0;
+    };
+
+    /// \brief A split candidate bin.
+    struct Bin
+    {
+        Box bounds;
+        std::size_t count = 0;
+    };
+
+    /// \brief Convert a vector to a Vec3, padding missing components with 0.
+    ///
+    /// The element type is deduced from the vector, so vectors of any
+    /// floating point type can be added to a BVH of any FloatType.
+    template <typename VectorType>
+    static Vec3 toVec3(const VectorType& vector)
+    {
+        typedef typename std::decay<decltype(vector[0])>::type ElementType;
+
+        const ElementType* pVector = VectorDataPointer<VectorType, ElementType>(vector);
+        const std::size_t dimension = VectorDataDim<VectorType>::DIM > 0 ? VectorDataDim<VectorType>::DIM : 3;
+
+        Vec3 result = {{ 0, 0, 0 }};
+
+        for (std::size_t j = 0; j < std::min(dimension, static_cast<std::size_t>(3)); ++j)
+        {
+            result[j] = static_cast<FloatType>(pVector[j]);
+        }
+
+        return result;
+    }
+
+    /// \brief Append a primitive.
+    IndexType add(const Primitive& primitive)
+    {
+        _primitives.push_back(primitive);
+        return static_cast<IndexType>(_primitives.size() - 1);
+    }
+
+    /// \returns the bounds of a primitive.
+    static Box primitiveBounds(const Primitive& primitive)
+    {
+        Box box;
+        box.grow(primitive.a.data());
+        box.grow(primitive.b.data());
+
+        if (primitive.type == PRIMITIVE_TRIANGLE)
+        {
+            box.grow(primitive.c.data());
+        }
+
+        return box;
+    }
+
+    /// \brief Recursively split a node using a binned surface area heuristic.
+    void subdivide(std::size_t nodeIndex, std::size_t first, std::size_t last)
+    {
+        Box bounds;
+        Box centroidBounds;
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            bounds.grow(_bounds[_order[i]]);
+            centroidBounds.grow(_centroids[_order[i]].data());
+        }
+
+        _nodes[nodeIndex].bounds = bounds;
+
+        const std::size_t count = last - first;
+
+        // Find the cheapest split over all axes and bin boundaries.
+        FloatType bestCost = std::numeric_limits<FloatType>::max();
+        std::size_t bestAxis = 0;
+        std::size_t bestSplit = 0;
+
+        if (count > _maxLeafSize)
+        {
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                const FloatType extent = centroidBounds.high[axis] - centroidBounds.low[axis];
+
+                if (extent <= 0)
+                {
+                    continue;
+                }
+
+                std::array<Bin, NUM_BINS> bins;
+
+                const FloatType scale = NUM_BINS / extent;
+
+                for (std::size_t i = first; i < last; ++i)
+                {
+                    const std::size_t bin = binIndex(_centroids[_order[i]][axis], centroidBounds.low[axis], scale);
+                    bins[bin].count++;
+                    bins[bin].bounds.grow(_bounds[_order[i]]);
+                }
+
+                // Sweep from the right to get the cost of each right side.
+                std::array<FloatType, NUM_BINS> rightCosts;
+                Box rightBox;
+                std::size_t rightCount = 0;
+
+                for (std::size_t bin = NUM_BINS - 1; bin > 0; --bin)
+                {
+                    rightBox.grow(bins[bin].bounds);
+                    rightCount += bins[bin].count;
+                    rightCosts[bin] = rightBox.halfArea() * rightCount;
+                }
+
+                Box leftBox;
+                std::size_t leftCount = 0;
+
+                for (std::size_t bin = 0; bin + 1 < NUM_BINS; ++bin)
+                {
+                    leftBox.grow(bins[bin].bounds);
+                    leftCount += bins[bin].count;
+
+                    const FloatType cost = leftBox.halfArea() * leftCount + rightCosts[bin + 1];
+
+                    if (leftCount > 0 && leftCount < count && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = bin + 1;
+                    }
+                }
+            }
+        }
+
+        // Make a leaf if splitting does not pay for the extra traversal.
+        const FloatType leafCost = bounds.halfArea() * count;
+
+        if (count <= _maxLeafSize
+        || (count <= MAX_LEAF_SIZE_LIMIT && (bestSplit == 0 || bestCost >= leafCost)))
+        {
+            _nodes[nodeIndex].first = static_cast<std::uint32_t>(first);
+            _nodes[nodeIndex].count = static_cast<std::uint32_t>(count);
+            return;
+        }
+
+        std::size_t middle = first;
+
+        if (bestSplit == 0)
+        {
+            // All centroids coincide, so split the range in half.
+            middle = first + count / 2;
+        }
+        else
+        {
+            const FloatType scale = NUM_BINS / (centroidBounds.high[bestAxis] - centroidBounds.low[bestAxis]);
+
+            middle = std::partition(_order.begin() + first, _order.begin() + last, [&](IndexType index)
+            {
+                return binIndex(_centroids[index][bestAxis], centroidBounds.low[bestAxis], scale) < bestSplit;
+            }) - _order.begin();
+        }
+
+        const std::size_t left = _nodes.size();
+
+        _nodes[nodeIndex].first = static_cast<std::uint32_t>(left);
+        _nodes[nodeIndex].count = 0;
+        _nodes.push_back(Node());
+        _nodes.push_back(Node());
+
+        subdivide(left, first, middle);
+        subdivide(left + 1, middle, last);
+    }
+
+    /// \returns the bin of a centroid coordinate.
+    static std::size_t binIndex(FloatType value, FloatType low, FloatType scale)
+    {
+        const std::size_t bin = static_cast<std::size_t>((value - low) * scale);
+        return std::min(bin, static_cast<std::size_t>(NUM_BINS - 1));
+    }
+
+    static Vec3 subtract(const Vec3& a, const Vec3& b)
+    {
+        Vec3 result = {{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }};
+        return result;
+    }
+
+    static FloatType dot(const Vec3& a, const Vec3& b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    static Vec3 cross(const Vec3& a, const Vec3& b)
+    {
+        Vec3 result = {{ a[1] * b[2] - a[2] * b[1],
+                         a[2] * b[0] - a[0] * b[2],
+                         a[0] * b[1] - a[1] * b[0] }};
+        return result;
+    }
+
+    static Vec3 madd(const Vec3& a, const Vec3& b, FloatType s)
+    {
+        Vec3 result = {{ a[0] + b[0] * s, a[1] + b[1] * s, a[2] + b[2] * s }};
+        return result;
+    }
+
+    /// \brief Compute the closest point on a primitive.
+    /// \returns the squared distance to the closest point.
+    static FloatType closestPoint(const Primitive& primitive, const Vec3& p, Vec3& closest)
+    {
+        switch (primitive.type)
+        {
+            case PRIMITIVE_TRIANGLE:
+                closest = closestPointOnTriangle(p, primitive.a, primitive.b, primitive.c);
+                break;
+            case PRIMITIVE_SEGMENT:
+            {
+                const Vec3 ab = subtract(primitive.b, primitive.a);
+                const FloatType length = dot(ab, ab);
+                FloatType t = length > 0 ? dot(subtract(p, primitive.a), ab) / length : 0;
+                t = std::min(std::max(t, FloatType(0)), FloatType(1));
+                closest = madd(primitive.a, ab, t);
+                break;
+            }
+            case PRIMITIVE_BOX:
+                for (std::size_t j = 0; j < 3; ++j)
+                {
+                    closest[j] = std::min(std::max(p[j], primitive.a[j]), primitive.b[j]);
+                }
+                break;
+        }
+
+        const Vec3 difference = subtract(p, closest);
+        return dot(difference, difference);
+    }
+
+    /// \brief The closest point on a triangle, by Voronoi region.
+    ///
+    /// See Ericson, "Real-Time Collision Detection", 5.1.5.
+    static Vec3 closestPointOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c)
+    {
+        const Vec3 ab = subtract(b, a);
+        const Vec3 ac = subtract(c, a);
+        const Vec3 ap = subtract(p, a);
+
+        const FloatType d1 = dot(ab, ap);
+        const FloatType d2 = dot(ac, ap);
+
+        if (d1 <= 0 && d2 <= 0)
+        {
+            return a;
+        }
+
+        const Vec3 bp = subtract(p, b);
+        const FloatType d3 = dot(ab, bp);
+        const FloatType d4 = dot(ac, bp);
+
+        if (d3 >= 0 && d4 <= d3)
+        {
+            return b;
+        }
+
+        const FloatType vc = d1 * d4 - d3 * d2;
+
+        if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        {
+            return madd(a, ab, d1 / (d1 - d3));
+        }
+
+        const Vec3 cp = subtract(p, c);
+        const FloatType d5 = dot(ab, cp);
+        const FloatType d6 = dot(ac, cp);
+
+        if (d6 >= 0 && d5 <= d6)
+        {
+            return c;
+        }
+
+        const FloatType vb = d5 * d2 - d1 * d6;
+
+        if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        {
+            return madd(a, ac, d2 / (d2 - d6));
+        }
+
+        const FloatType va = d3 * d6 - d5 * d4;
+
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        {
+            return madd(b, subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+
+        const FloatType denominator = 1 / (va + vb + vc);
+        return madd(madd(a, ab, vb * denominator), ac, vc * denominator);
+    }
+
+    /// \brief Intersect a ray with a primitive.
+    /// \returns true iff the primitive is hit with t < tMax.
+    static bool intersectPrimitive(const Primitive& primitive,
+                                   const Vec3& origin,
+                                   const Vec3& direction,
+                                   const Vec3& inverse,
+                                   FloatType tMax,
+                                   FloatType& t)
+    {
+        switch (primitive.type)
+        {
+            case PRIMITIVE_TRIANGLE:
+            {
+                // Moller-Trumbore.
+                const Vec3 edge1 = subtract(primitive.b, primitive.a);
+                const Vec3 edge2 = subtract(primitive.c, primitive.a);
+                const Vec3 h = cross(direction, edge2);
+                const FloatType determinant = dot(edge1, h);
+
+                if (std::abs(determinant) <= std::numeric_limits<FloatType>::epsilon())
+                {
+                    return false;
+                }
+
+                const FloatType f = 1 / determinant;
+                const Vec3 s = subtract(origin, primitive.a);
+                const FloatType u = f * dot(s, h);
+
+                if (u < 0 || u > 1)
+                {
+                    return false;
+                }
+
+                const Vec3 q = cross(s, edge1);
+                const FloatType v = f * dot(direction, q);
+
+                if (v < 0 || u + v > 1)
+                {
+                    return false;
+                }
+
+                t = f * dot(edge2, q);
+                return t >= 0 && t < tMax;
+            }
+            case PRIMITIVE_BOX:
+            {
+                Box box;
+                box.low = primitive.a;
+                box.high = primitive.b;
+                return box.intersectRay(origin, inverse, tMax, t) && t < tMax;
+            }
+            case PRIMITIVE_SEGMENT:
+                break;
+        }
+
+        return false;
+    }
+
+    enum
+    {
+        /// \brief Leaves are forced to split above this size regardless of cost.
+        MAX_LEAF_SIZE_LIMIT = 64
+    };
+
+    /// \brief The maximum number of primitives in a leaf.
+    std::size_t _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The primitives, indexed by id.
+    std::vector<Primitive> _primitives;
+
+    /// \brief The hierarchy nodes, the root first.
+    std::vector<Node> _nodes;
+
+    /// \brief The primitive ids, reordered so every leaf's primitives are contiguous.
+    std::vector<IndexType> _order;
+
+    /// \brief Scratch primitive bounds used while building.
+    std::vector<Box> _bounds;
+
+    /// \brief Scratch primitive centroids used while building.
+    std::vector<Vec3> _centroids;
+
+};
+
+
+} // namespace ofx
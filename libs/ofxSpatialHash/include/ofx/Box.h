@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+
+
+namespace ofx {
+
+
+/// \brief An axis aligned bounding box.
+///
+/// The box has no constructor so that it stays trivially copyable and can be
+/// stored in files. Call reset() before growing a new box.
+///
+/// \tparam FloatType The coordinate type.
+/// \tparam Dimension The number of dimensions.
+template <typename FloatType, std::size_t Dimension>
+struct Box
+{
+    /// \brief The lowest coordinate in each dimension.
+    std::array<FloatType, Dimension> low;
+
+    /// \brief The highest coordinate in each dimension.
+    std::array<FloatType, Dimension> high;
+
+    /// \brief Make the box empty, so that growing it by a point gives a box
+    ///        holding only that point.
+    void reset()
+    {
+        low.fill(std::numeric_limits<FloatType>::max());
+        high.fill(std::numeric_limits<FloatType>::lowest());
+    }
+
+    /// \brief Grow the box to hold a point.
+    /// \param pPoint A pointer to the 0th element of the point.
+    void grow(const FloatType* pPoint)
+    {
+        for (std::size_t j = 0; j < Dimension; ++j)
+        {
+            low[j] = std::min(low[j], pPoint[j]);
+            high[j] = std::max(high[j], pPoint[j]);
+        }
+    }
+
+    /// \brief Grow the box to hold another box.
+    /// \param other The other box.
+    void grow(const Box& other)
+    {
+        for (std::size_t j = 0; j < Dimension; ++j)
+        {
+            low[j] = std::min(low[j], other.low[j]);
+            high[j] = std::max(high[j], other.high[j]);
+        }
+    }
+
+    /// \param pVector A pointer to the 0th element of the point.
+    /// \returns the squared distance from a point to the box, or 0 if the
+    ///          point is inside the box.
+    FloatType distanceSquared(const FloatType* pVector) const
+    {
+        FloatType total = 0;
+
+        for (std::size_t j = 0; j < Dimension; ++j)
+        {
+            const FloatType below = low[j] - pVector[j];
+            const FloatType above = pVector[j] - high[j];
+            const FloatType distance = std::max(FloatType(0), std::max(below, above));
+            total += distance * distance;
+        }
+
+        return total;
+    }
+};
+
+
+} // namespace ofx
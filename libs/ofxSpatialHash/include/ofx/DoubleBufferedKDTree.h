@@ -0,0 +1,373 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ofx/KDTree.h"
+
+
+namespace ofx {
+
+
+/// \brief A KDTree that rebuilds on a worker thread while queries continue.
+///
+/// rebuild() snapshots the points and hands them to a worker thread, which
+/// builds a new KDTree while queries keep using the previous one. A finished
+/// build is published with an atomic shared pointer swap. Each query holds a
+/// reference to the snapshot it started with, so an old tree is freed only
+/// after its last reader is done.
+///
+/// If rebuild() is called again before the worker picks up the previous
+/// request, only the newest points are built.
+///
+/// Result indices refer to the points of the snapshot that answered the query.
+/// Callers that need the matching points should acquire() a snapshot and query
+/// it directly.
+///
+/// \tparam VectorType The VectorType used by this DoubleBufferedKDTree.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class DoubleBufferedKDTree
+{
+public:
+    /// \brief A typedef for the KDTree of each snapshot.
+    typedef KDTree<VectorType, VectorDimension, FloatType, IndexType> Tree;
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief An immutable set of points and the KDTree built over them.
+    class Snapshot
+    {
+    public:
+        /// \brief Create a snapshot, taking ownership of the points.
+        Snapshot(Points&& points, std::size_t maxLeafSize, std::uint64_t epoch):
+            _points(std::move(points)),
+            _tree(_points, maxLeafSize, false),
+            _epoch(epoch)
+        {
+        }
+
+        /// \returns the snapshot's points.
+        const Points& points() const
+        {
+            return _points;
+        }
+
+        /// \returns the snapshot's KDTree.
+        const Tree& tree() const
+        {
+            return _tree;
+        }
+
+        /// \returns the number of the rebuild that produced this snapshot.
+        std::uint64_t epoch() const
+        {
+            return _epoch;
+        }
+
+    private:
+        friend class DoubleBufferedKDTree;
+
+        /// \brief The snapshot's points.
+        Points _points;
+
+        /// \brief The KDTree over the snapshot's points.
+        Tree _tree;
+
+        /// \brief The number of the rebuild that produced this snapshot.
+        std::uint64_t _epoch = 0;
+    };
+
+    /// \brief A typedef for a shared pointer to a published snapshot.
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    /// \brief Create an empty DoubleBufferedKDTree.
+    /// \param maxLeafSize The maximum leaf size of each snapshot's KDTree.
+    DoubleBufferedKDTree(std::size_t maxLeafSize = Tree::DEFAULT_MAX_LEAF_SIZE):
+        _maxLeafSize(maxLeafSize)
+    {
+    }
+
+    /// \brief Stop the worker thread, abandoning any pending rebuild.
+    virtual ~DoubleBufferedKDTree()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _condition.notify_all();
+
+        if (_worker.joinable())
+        {
+            _worker.join();
+        }
+    }
+
+    /// \brief Snapshot the points and rebuild in the background.
+    /// \param points The points to index. They are copied before returning.
+    void rebuild(const Points& points)
+    {
+        rebuild(Points(points));
+    }
+
+    /// \brief Rebuild in the background, taking ownership of the points.
+    /// \param points The points to index.
+    void rebuild(Points&& points)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _pending.reset(new Points(std::move(points)));
+            ++_requested;
+
+            if (!_worker.joinable())
+            {
+                _worker = std::thread(&DoubleBufferedKDTree::run, this);
+            }
+        }
+
+        _condition.notify_all();
+    }
+
+    /// \brief Block until every requested rebuild has been published.
+    void waitForRebuild()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _condition.wait(lock, [this]()
+        {
+            return _published == _requested;
+        });
+    }
+
+    /// \returns true iff a requested rebuild has not been published yet.
+    bool isRebuilding() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _published != _requested;
+    }
+
+    /// \brief Acquire the current snapshot.
+    ///
+    /// The snapshot, and its KDTree, stay valid for as long as the returned
+    /// pointer is held, even if newer snapshots are published meanwhile.
+    ///
+    /// \returns the current snapshot, or nullptr before the first build.
+    SnapshotPtr acquire() const
+    {
+        return std::atomic_load(&_snapshot);
+    }
+
+    /// \returns the epoch of the current snapshot, or 0 before the first build.
+    std::uint64_t getEpoch() const
+    {
+        const SnapshotPtr snapshot = acquire();
+        return snapshot ? snapshot->epoch() : 0;
+    }
+
+    /// \brief Find neighbors in the current snapshot.
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The nanoflann search parameters.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet,
+                       const FloatType* pVector,
+                       const nanoflann::SearchParams& params) const
+    {
+        const SnapshotPtr snapshot = acquire();
+
+        if (snapshot && !snapshot->points().empty())
+        {
+            snapshot->tree().findNeighbors(resultSet, pVector, params);
+        }
+    }
+
+    /// \brief Find the N closest points in the current snapshot.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        const SnapshotPtr snapshot = acquire();
+
+        indices.clear();
+        distancesSquared.clear();
+
+        if (!snapshot || snapshot->points().empty())
+        {
+            return;
+        }
+
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(snapshot->points().size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        snapshot->tree().findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams());
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points in the current snapshot.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius in the current snapshot.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon The search epsilon (see nanoflann).
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams(0, epsilon, false));
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+protected:
+    /// \brief The worker thread loop.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (true)
+        {
+            _condition.wait(lock, [this]()
+            {
+                return _stop || _pending;
+            });
+
+            if (_stop)
+            {
+                return;
+            }
+
+            std::unique_ptr<Points> points = std::move(_pending);
+            const std::uint64_t epoch = _requested;
+
+            lock.unlock();
+
+            std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>(std::move(*points), _maxLeafSize, epoch);
+
+            if (!snapshot->_points.empty())
+            {
+                snapshot->_tree.buildIndex();
+            }
+
+            // Publish. Readers holding the previous snapshot keep it alive.
+            std::atomic_store(&_snapshot, SnapshotPtr(std::move(snapshot)));
+
+            lock.lock();
+
+            _published = epoch;
+
+            _condition.notify_all();
+        }
+    }
+
+    /// \brief The maximum leaf size of each snapshot's KDTree.
+    std::size_t _maxLeafSize = Tree::DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The current snapshot, accessed with std::atomic_load/store.
+    SnapshotPtr _snapshot;
+
+    /// \brief Guards the pending points and rebuild counters.
+    mutable std::mutex _mutex;
+
+    /// \brief Signals rebuild requests, publications and shutdown.
+    std::condition_variable _condition;
+
+    /// \brief The newest points waiting to be built.
+    std::unique_ptr<Points> _pending;
+
+    /// \brief The number of rebuilds requested.
+    std::uint64_t _requested = 0;
+
+    /// \brief The request number of the last published snapshot.
+    std::uint64_t _published = 0;
+
+    /// \brief True when the worker should exit.
+    bool _stop = false;
+
+    /// \brief The worker thread, started by the first rebuild.
+    std::thread _worker;
+
+};
+
+
+} // namespace ofx
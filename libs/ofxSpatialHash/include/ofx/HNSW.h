@@ -0,0 +1,962 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+
+
+namespace ofx {
+
+
+/// \brief A hierarchical navigable small world graph for approximate search.
+///
+/// The HNSW index links every point to its approximate nearest neighbors on a
+/// stack of increasingly sparse layers (Malkov and Yashunin, "Efficient and
+/// robust approximate nearest neighbor search using Hierarchical Navigable
+/// Small World graphs", 2016). A query descends greedily through the upper
+/// layers and then runs a best-first search of width efSearch on the bottom
+/// layer, which scales to tens of millions of high dimensional points where
+/// exact tree searches are no longer viable.
+///
+/// Unlike the tree indices, the HNSW stores its own copy of the points, so it
+/// can grow incrementally with add() and be saved and loaded. Points added in
+/// one call are inserted in parallel. Point ids are assigned consecutively in
+/// insertion order.
+///
+/// Queries are const and may run concurrently with each other, but not with
+/// add(), load() or clear().
+///
+/// \tparam VectorType The VectorType used by this HNSW.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The point id type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class HNSW
+{
+public:
+    static_assert(VectorDimension > 0, "The HNSW requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create an empty HNSW.
+    /// \param M The number of links per point on the upper layers. The bottom
+    ///        layer allows twice as many.
+    /// \param efConstruction The search width used while inserting.
+    /// \param seed The seed used to assign point layers.
+    HNSW(std::size_t M = DEFAULT_M,
+         std::size_t efConstruction = DEFAULT_EF_CONSTRUCTION,
+         std::uint64_t seed = DEFAULT_SEED):
+        _M(std::max(static_cast<std::size_t>(2), M)),
+        _efConstruction(std::max(static_cast<std::size_t>(1), efConstruction)),
+        _seed(seed)
+    {
+    }
+
+    /// \brief Destroy the HNSW.
+    virtual ~HNSW()
+    {
+    }
+
+    /// \brief Remove all points.
+    void clear()
+    {
+        _data.clear();
+        _levels.clear();
+        _links0.clear();
+        _upperLinks.clear();
+        _nodeMutexes.reset();
+        _entryPoint = INVALID;
+        _maxLevel = -1;
+
+        std::lock_guard<std::mutex> lock(_visitedMutex);
+        _visitedPool.clear();
+    }
+
+    /// \returns the number of points.
+    std::size_t size() const
+    {
+        return _levels.size();
+    }
+
+    /// \returns the number of links per point on the upper layers.
+    std::size_t getM() const
+    {
+        return _M;
+    }
+
+    /// \returns the search width used while inserting.
+    std::size_t getEfConstruction() const
+    {
+        return _efConstruction;
+    }
+
+    /// \brief Set the search width used by queries.
+    ///
+    /// Larger values trade speed for recall. Queries always search at least
+    /// as wide as the number of requested neighbors.
+    ///
+    /// \param efSearch The search width.
+    void setEfSearch(std::size_t efSearch)
+    {
+        _efSearch = std::max(static_cast<std::size_t>(1), efSearch);
+    }
+
+    /// \returns the search width used by queries.
+    std::size_t getEfSearch() const
+    {
+        return _efSearch;
+    }
+
+    /// \returns the number of the highest layer, or -1 if empty.
+    int getMaxLevel() const
+    {
+        return _maxLevel;
+    }
+
+    /// \brief Add a single point.
+    /// \param point The point to add.
+    /// \returns the id of the point.
+    IndexType add(const VectorType& point)
+    {
+        return add(Points(1, point));
+    }
+
+    /// \brief Add points, inserting them in parallel.
+    /// \param points The points to add.
+    /// \returns the id of the first point added.
+    IndexType add(const Points& points)
+    {
+        const std::size_t first = size();
+        const std::size_t count = points.size();
+        const std::size_t total = first + count;
+
+        // Grow every array before inserting, so that the parallel inserts
+        // never reallocate.
+        _data.resize(total * VectorDimension);
+        _levels.resize(total);
+        _links0.resize(total * linkStride0(), 0);
+        _upperLinks.resize(total);
+
+        const double levelScale = 1.0 / std::log(static_cast<double>(_M));
+
+        for (std::size_t i = first; i < total; ++i)
+        {
+            const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(points[i - first]);
+            std::copy(pPoint, pPoint + VectorDimension, &_data[i * VectorDimension]);
+
+            // Draw the layer from an exponential distribution. Hashing the id
+            // keeps layers independent of the insertion order.
+            const double uniform = (mix(_seed ^ i) >> 11) * (1.0 / 9007199254740992.0);
+            const int level = static_cast<int>(-std::log(std::max(uniform, 1e-300)) * levelScale);
+
+            _levels[i] = level;
+            _upperLinks[i].assign(level * linkStride(), 0);
+        }
+
+        _nodeMutexes.reset(new std::mutex[total]);
+
+        ParallelFor(count, ParallelChunkCount(count, MIN_POINTS_PER_THREAD), [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                insertNode(static_cast<std::uint32_t>(first + i));
+            }
+        });
+
+        return static_cast<IndexType>(first);
+    }
+
+    /// \brief Find the approximate N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        SearchResults results;
+
+        findNClosestPoints(point, numPointsToFind, results);
+
+        indices.resize(results.size());
+        distancesSquared.resize(results.size());
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            indices[i] = results[i].first;
+            distancesSquared[i] = results[i].second;
+        }
+    }
+
+    /// \brief Find the approximate N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        results.clear();
+
+        if (_entryPoint == INVALID || numPointsToFind == 0)
+        {
+            return;
+        }
+
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+        // Descend greedily through the upper layers.
+        std::uint32_t current = _entryPoint;
+        FloatType currentDistance = distanceSquared(pVector, pointData(current));
+
+        for (int level = _maxLevel; level > 0; --level)
+        {
+            greedySearch<false>(pVector, level, current, currentDistance);
+        }
+
+        VisitedList* visited = acquireVisitedList();
+
+        MaxHeap found = searchLayer<false>(pVector, current, currentDistance, std::max(_efSearch, numPointsToFind), 0, *visited);
+
+        releaseVisitedList(visited);
+
+        while (found.size() > numPointsToFind)
+        {
+            found.pop();
+        }
+
+        results.resize(found.size());
+
+        for (std::size_t i = found.size(); i > 0; --i)
+        {
+            results[i - 1] = std::make_pair(static_cast<IndexType>(found.top().second), found.top().first);
+            found.pop();
+        }
+    }
+
+    /// \brief Find the approximate N closest points to many points in parallel.
+    /// \param points The seed points to search near.
+    /// \param numPointsToFind the number of points to return per seed point.
+    /// \param results The results of each seed point.
+    void findNClosestPoints(const Points& points,
+                            std::size_t numPointsToFind,
+                            std::vector<SearchResults>& results) const
+    {
+        results.resize(points.size());
+
+        ParallelFor(points.size(), ParallelChunkCount(points.size(), MIN_QUERIES_PER_THREAD), [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                findNClosestPoints(points[i], numPointsToFind, results[i]);
+            }
+        });
+    }
+
+    /// \brief Save the index, including a copy of the points.
+    ///
+    /// The format is a raw native endian dump and is not portable between
+    /// platforms with different endianness or FloatType.
+    ///
+    /// \param stream The binary output stream.
+    /// \returns true iff the index was written.
+    bool save(std::ostream& stream) const
+    {
+        const std::uint32_t header[] = {
+            MAGIC,
+            VERSION,
+            static_cast<std::uint32_t>(VectorDimension),
+            static_cast<std::uint32_t>(sizeof(FloatType)),
+            static_cast<std::uint32_t>(_M),
+            static_cast<std::uint32_t>(_efConstruction),
+            static_cast<std::uint32_t>(_maxLevel + 1),
+            _entryPoint
+        };
+
+        const std::uint64_t count = size();
+
+        write(stream, header, sizeof(header));
+        write(stream, &count, sizeof(count));
+        write(stream, _data.data(), _data.size() * sizeof(FloatType));
+        write(stream, _levels.data(), _levels.size() * sizeof(int));
+        write(stream, _links0.data(), _links0.size() * sizeof(std::uint32_t));
+
+        for (const auto& links: _upperLinks)
+        {
+            write(stream, links.data(), links.size() * sizeof(std::uint32_t));
+        }
+
+        return stream.good();
+    }
+
+    /// \brief Save the index to a file.
+    /// \param path The file path.
+    /// \returns true iff the index was written.
+    bool save(const std::string& path) const
+    {
+        std::ofstream stream(path, std::ios::binary);
+        return stream.is_open() && save(stream);
+    }
+
+    /// \brief Load an index written by save(), replacing the current one.
+    /// \param stream The binary input stream.
+    /// \returns true iff the index was read. On failure the index is empty.
+    bool load(std::istream& stream)
+    {
+        clear();
+
+        std::uint32_t header[8];
+        std::uint64_t count = 0;
+
+        if (!read(stream, header, sizeof(header))
+        || header[0] != MAGIC
+        || header[1] != VERSION
+        || header[2] != static_cast<std::uint32_t>(VectorDimension)
+        || header[3] != static_cast<std::uint32_t>(sizeof(FloatType))
+        || header[4] < 2
+        || header[4] > MAX_M
+        || header[5] == 0
+        || header[6] > MAX_LEVELS
+        || !read(stream, &count, sizeof(count))
+        || count >= INVALID
+        || (count > 0) != (header[6] > 0)
+        || (count > 0 && header[7] >= count))
+        {
+            return false;
+        }
+
+        const std::size_t M = _M;
+        const std::size_t efConstruction = _efConstruction;
+
+        _M = header[4];
+        _efConstruction = header[5];
+
+        // Don't allocate more nodes than a seekable stream can hold.
+        const std::uint64_t nodeSize = VectorDimension * sizeof(FloatType)
+                                     + sizeof(int)
+                                     + linkStride0() * sizeof(std::uint32_t);
+
+        const std::uint64_t remaining = remainingSize(stream);
+
+        bool ok = count <= remaining / nodeSize;
+
+        if (ok)
+        {
+            _data.resize(count * VectorDimension);
+            _levels.resize(count);
+            _links0.resize(count * linkStride0());
+            _upperLinks.resize(count);
+
+            ok = read(stream, _data.data(), _data.size() * sizeof(FloatType))
+              && read(stream, _levels.data(), _levels.size() * sizeof(int))
+              && read(stream, _links0.data(), _links0.size() * sizeof(std::uint32_t));
+        }
+
+        for (std::size_t i = 0; ok && i < count; ++i)
+        {
+            ok = _levels[i] >= 0 && _levels[i] < static_cast<int>(header[6]);
+
+            if (ok)
+            {
+                _upperLinks[i].resize(_levels[i] * linkStride());
+                ok = read(stream, _upperLinks[i].data(), _upperLinks[i].size() * sizeof(std::uint32_t));
+            }
+        }
+
+        // Searches start at the entry point on the top layer and follow links
+        // without bounds checks.
+        ok = ok && (count == 0 || _levels[header[7]] == static_cast<int>(header[6]) - 1);
+
+        for (std::uint32_t i = 0; ok && i < count; ++i)
+        {
+            for (int level = 0; ok && level <= _levels[i]; ++level)
+            {
+                ok = areLinksValid(i, level);
+            }
+        }
+
+        if (!ok)
+        {
+            clear();
+            _M = M;
+            _efConstruction = efConstruction;
+            return false;
+        }
+
+        _nodeMutexes.reset(new std::mutex[count]);
+        _maxLevel = static_cast<int>(header[6]) - 1;
+        _entryPoint = count > 0 ? header[7] : INVALID;
+
+        return true;
+    }
+
+    /// \brief Load an index from a file.
+    /// \param path The file path.
+    /// \returns true iff the index was read.
+    bool load(const std::string& path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        return stream.is_open() && load(stream);
+    }
+
+    enum
+    {
+        /// \brief The default number of links per point on the upper layers.
+        DEFAULT_M = 16,
+
+        /// \brief The default search width used while inserting.
+        DEFAULT_EF_CONSTRUCTION = 200,
+
+        /// \brief The default search width used by queries.
+        DEFAULT_EF_SEARCH = 64,
+
+        /// \brief The default layer seed.
+        DEFAULT_SEED = 100,
+
+        /// \brief The minimum number of points inserted per thread.
+        MIN_POINTS_PER_THREAD = 256,
+
+        /// \brief The minimum number of batch queries per thread.
+        MIN_QUERIES_PER_THREAD = 64,
+
+        /// \brief The largest number of links per point load() accepts.
+        MAX_M = 4096,
+
+        /// \brief The largest number of layers load() accepts.
+        MAX_LEVELS = 1024
+    };
+
+protected:
+    /// \brief The invalid node sentinel.
+    static constexpr std::uint32_t INVALID = std::numeric_limits<std::uint32_t>::max();
+
+    /// \brief The file format magic number, "HNSW".
+    static constexpr std::uint32_t MAGIC = 0x57534E48;
+
+    /// \brief The file format version.
+    static constexpr std::uint32_t VERSION = 1;
+
+    /// \brief A distance, node pair.
+    typedef std::pair<FloatType, std::uint32_t> DistanceNode;
+
+    /// \brief A heap with the farthest node on top.
+    typedef std::priority_queue<DistanceNode> MaxHeap;
+
+    /// \brief A heap with the closest node on top.
+    typedef std::priority_queue<DistanceNode, std::vector<DistanceNode>, std::greater<DistanceNode>> MinHeap;
+
+    /// \brief Per-query visited marks, reset in O(1) by bumping the epoch.
+    struct VisitedList
+    {
+        std::vector<std::uint16_t> marks;
+        std::uint16_t epoch = 0;
+
+        void reset(std::size_t count)
+        {
+            if (marks.size() < count)
+            {
+                marks.resize(count, 0);
+            }
+
+            if (++epoch == 0)
+            {
+                std::fill(marks.begin(), marks.end(), 0);
+                epoch = 1;
+            }
+        }
+    };
+
+    /// \returns the number of entries per node on the bottom layer.
+    std::size_t linkStride0() const
+    {
+        return 2 * _M + 1;
+    }
+
+    /// \returns the number of entries per node and upper layer.
+    std::size_t linkStride() const
+    {
+        return _M + 1;
+    }
+
+    /// \returns the link list of a node on a layer. The first entry is the
+    ///          number of links.
+    std::uint32_t* links(std::uint32_t node, int level)
+    {
+        return level == 0 ? &_links0[node * linkStride0()]
+                          : &_upperLinks[node][(level - 1) * linkStride()];
+    }
+
+    /// \returns the link list of a node on a layer.
+    const std::uint32_t* links(std::uint32_t node, int level) const
+    {
+        return level == 0 ? &_links0[node * linkStride0()]
+                          : &_upperLinks[node][(level - 1) * linkStride()];
+    }
+
+    /// \returns the maximum number of links on a layer.
+    std::size_t maxLinks(int level) const
+    {
+        return level == 0 ? 2 * _M : _M;
+    }
+
+    /// \returns true iff a loaded link list of a node on a layer holds at
+    ///          most maxLinks(level) nodes that all reach that layer.
+    bool areLinksValid(std::uint32_t node, int level) const
+    {
+        const std::uint32_t* pLinks = links(node, level);
+
+        if (pLinks[0] > maxLinks(level))
+        {
+            return false;
+        }
+
+        for (std::size_t i = 1; i <= pLinks[0]; ++i)
+        {
+            if (pLinks[i] >= _levels.size() || _levels[pLinks[i]] < level)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// \returns a pointer to the 0th element of a stored point.
+    const FloatType* pointData(std::uint32_t node) const
+    {
+        return &_data[static_cast<std::size_t>(node) * VectorDimension];
+    }
+
+    /// \returns the Euclidean distance squared between two points.
+    static FloatType distanceSquared(const FloatType* a, const FloatType* b)
+    {
+        FloatType total = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType difference = a[j] - b[j];
+            total += difference * difference;
+        }
+
+        return total;
+    }
+
+    /// \brief The splitmix64 finalizer.
+    static std::uint64_t mix(std::uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    /// \brief Copy the links of a node, locking it while inserting.
+    template <bool Locked>
+    void copyLinks(std::uint32_t node, int level, std::vector<std::uint32_t>& result) const
+    {
+        std::unique_lock<std::mutex> lock;
+
+        if (Locked)
+        {
+            lock = std::unique_lock<std::mutex>(_nodeMutexes[node]);
+        }
+
+        const std::uint32_t* pLinks = links(node, level);
+        result.assign(pLinks + 1, pLinks + 1 + pLinks[0]);
+    }
+
+    /// \brief Move greedily towards the query on a layer.
+    template <bool Locked>
+    void greedySearch(const FloatType* pVector,
+                      int level,
+                      std::uint32_t& current,
+                      FloatType& currentDistance) const
+    {
+        std::vector<std::uint32_t> neighbors;
+
+        bool changed = true;
+
+        while (changed)
+        {
+            changed = false;
+
+            copyLinks<Locked>(current, level, neighbors);
+
+            for (std::uint32_t neighbor: neighbors)
+            {
+                const FloatType distance = distanceSquared(pVector, pointData(neighbor));
+
+                if (distance < currentDistance)
+                {
+                    currentDistance = distance;
+                    current = neighbor;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /// \brief Best-first search of width ef on one layer.
+    /// \returns up to ef closest nodes found, the farthest on top.
+    template <bool Locked>
+    MaxHeap searchLayer(const FloatType* pVector,
+                        std::uint32_t entry,
+                        FloatType entryDistance,
+                        std::size_t ef,
+                        int level,
+                        VisitedList& visited) const
+    {
+        visited.reset(size());
+
+        MinHeap candidates;
+        MaxHeap found;
+
+        candidates.push(DistanceNode(entryDistance, entry));
+        found.push(DistanceNode(entryDistance, entry));
+        visited.marks[entry] = visited.epoch;
+
+        std::vector<std::uint32_t> neighbors;
+
+        while (!candidates.empty())
+        {
+            const DistanceNode candidate = candidates.top();
+
+            if (candidate.first > found.top().first && found.size() >= ef)
+            {
+                break;
+            }
+
+            candidates.pop();
+
+            copyLinks<Locked>(candidate.second, level, neighbors);
+
+            for (std::uint32_t neighbor: neighbors)
+            {
+                if (visited.marks[neighbor] == visited.epoch)
+                {
+                    continue;
+                }
+
+                visited.marks[neighbor] = visited.epoch;
+
+                const FloatType distance = distanceSquared(pVector, pointData(neighbor));
+
+                if (found.size() < ef || distance < found.top().first)
+                {
+                    candidates.push(DistanceNode(distance, neighbor));
+                    found.push(DistanceNode(distance, neighbor));
+
+                    if (found.size() > ef)
+                    {
+                        found.pop();
+                    }
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /// \brief Select diverse neighbors with the HNSW heuristic.
+    ///
+    /// A candidate is kept only if it is closer to the base point than to
+    /// every neighbor already kept, which spreads the links around the point.
+    ///
+    /// \param candidates The candidates sorted by ascending distance.
+    /// \param maxCount The maximum number of neighbors to keep.
+    void selectNeighbors(std::vector<DistanceNode>& candidates, std::size_t maxCount) const
+    {
+        if (candidates.size() <= maxCount)
+        {
+            return;
+        }
+
+        std::vector<DistanceNode> selected;
+        selected.reserve(maxCount);
+
+        for (const DistanceNode& candidate: candidates)
+        {
+            bool keep = true;
+
+            for (const DistanceNode& kept: selected)
+            {
+                if (distanceSquared(pointData(candidate.second), pointData(kept.second)) < candidate.first)
+                {
+                    keep = false;
+                    break;
+                }
+            }
+
+            if (keep)
+            {
+                selected.push_back(candidate);
+
+                if (selected.size() >= maxCount)
+                {
+                    break;
+                }
+            }
+        }
+
+        candidates.swap(selected);
+    }
+
+    /// \returns a visited list from the pool.
+    VisitedList* acquireVisitedList() const
+    {
+        std::lock_guard<std::mutex> lock(_visitedMutex);
+
+        if (_visitedPool.empty())
+        {
+            return new VisitedList();
+        }
+
+        VisitedList* visited = _visitedPool.back().release();
+        _visitedPool.pop_back();
+        return visited;
+    }
+
+    /// \brief Return a visited list to the pool.
+    void releaseVisitedList(VisitedList* visited) const
+    {
+        std::lock_guard<std::mutex> lock(_visitedMutex);
+        _visitedPool.push_back(std::unique_ptr<VisitedList>(visited));
+    }
+
+    /// \brief Insert a node whose point and layer are already stored.
+    void insertNode(std::uint32_t node)
+    {
+        const int level = _levels[node];
+
+        // Hold the global lock for the whole insert if this node becomes the
+        // new entry point.
+        std::unique_lock<std::mutex> globalLock(_globalMutex);
+
+        const int maxLevel = _maxLevel;
+        std::uint32_t current = _entryPoint;
+
+        if (level <= maxLevel)
+        {
+            globalLock.unlock();
+        }
+
+        if (current != INVALID)
+        {
+            const FloatType* pVector = pointData(node);
+
+            FloatType currentDistance = distanceSquared(pVector, pointData(current));
+
+            for (int l = maxLevel; l > level; --l)
+            {
+                greedySearch<true>(pVector, l, current, currentDistance);
+            }
+
+            VisitedList* visited = acquireVisitedList();
+
+            for (int l = std::min(level, maxLevel); l >= 0; --l)
+            {
+                MaxHeap found = searchLayer<true>(pVector, current, currentDistance, _efConstruction, l, *visited);
+
+                std::vector<DistanceNode> candidates(found.size());
+
+                for (std::size_t i = found.size(); i > 0; --i)
+                {
+                    candidates[i - 1] = found.top();
+                    found.pop();
+                }
+
+                current = candidates.front().second;
+                currentDistance = candidates.front().first;
+
+                selectNeighbors(candidates, _M);
+
+                {
+                    std::lock_guard<std::mutex> lock(_nodeMutexes[node]);
+
+                    std::uint32_t* pLinks = links(node, l);
+                    pLinks[0] = static_cast<std::uint32_t>(candidates.size());
+
+                    for (std::size_t i = 0; i < candidates.size(); ++i)
+                    {
+                        pLinks[i + 1] = candidates[i].second;
+                    }
+                }
+
+                for (const DistanceNode& candidate: candidates)
+                {
+                    connect(candidate.second, node, candidate.first, l);
+                }
+            }
+
+            releaseVisitedList(visited);
+        }
+
+        if (level > maxLevel)
+        {
+            _entryPoint = node;
+            _maxLevel = level;
+        }
+    }
+
+    /// \brief Add a back link, pruning the link list if it overflows.
+    void connect(std::uint32_t node, std::uint32_t neighbor, FloatType distance, int level)
+    {
+        std::lock_guard<std::mutex> lock(_nodeMutexes[node]);
+
+        std::uint32_t* pLinks = links(node, level);
+        const std::size_t count = pLinks[0];
+        const std::size_t maxCount = maxLinks(level);
+
+        if (count < maxCount)
+        {
+            pLinks[count + 1] = neighbor;
+            pLinks[0] = static_cast<std::uint32_t>(count + 1);
+            return;
+        }
+
+        std::vector<DistanceNode> candidates;
+        candidates.reserve(count + 1);
+        candidates.push_back(DistanceNode(distance, neighbor));
+
+        for (std::size_t i = 1; i <= count; ++i)
+        {
+            candidates.push_back(DistanceNode(distanceSquared(pointData(node), pointData(pLinks[i])), pLinks[i]));
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+
+        selectNeighbors(candidates, maxCount);
+
+        pLinks[0] = static_cast<std::uint32_t>(candidates.size());
+
+        for (std::size_t i = 0; i < candidates.size(); ++i)
+        {
+            pLinks[i + 1] = candidates[i].second;
+        }
+    }
+
+    static void write(std::ostream& stream, const void* pData, std::size_t size)
+    {
+        stream.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+    }
+
+    static bool read(std::istream& stream, void* pData, std::size_t size)
+    {
+        stream.read(static_cast<char*>(pData), static_cast<std::streamsize>(size));
+        return stream.good() || (size == 0 && !stream.bad());
+    }
+
+    /// \returns the number of bytes left in a seekable stream, or the largest
+    ///          size if the stream can't seek.
+    static std::uint64_t remainingSize(std::istream& stream)
+    {
+        const std::istream::pos_type position = stream.tellg();
+
+        if (position == std::istream::pos_type(-1) || !stream.seekg(0, std::ios::end))
+        {
+            stream.clear();
+            return std::numeric_limits<std::uint64_t>::max();
+        }
+
+        const std::streamoff size = stream.tellg() - position;
+        stream.seekg(position);
+
+        return size > 0 ? static_cast<std::uint64_t>(size) : 0;
+    }
+
+    /// \brief The number of links per point on the upper layers.
+    std::size_t _M = DEFAULT_M;
+
+    /// \brief The search width used while inserting.
+    std::size_t _efConstruction = DEFAULT_EF_CONSTRUCTION;
+
+    /// \brief The search width used by queries.
+    std::size_t _efSearch = DEFAULT_EF_SEARCH;
+
+    /// \brief The layer seed.
+    std::uint64_t _seed = DEFAULT_SEED;
+
+    /// \brief The point coordinates.
+    std::vector<FloatType> _data;
+
+    /// \brief The top layer of each point.
+    std::vector<int> _levels;
+
+    /// \brief The bottom layer link lists, a count followed by 2 * M links.
+    std::vector<std::uint32_t> _links0;
+
+    /// \brief The upper layer link lists of each point, a count followed by M
+    ///        links per layer.
+    std::vector<std::vector<std::uint32_t>> _upperLinks;
+
+    /// \brief The entry point on the top layer.
+    std::uint32_t _entryPoint = INVALID;
+
+    /// \brief The top layer.
+    int _maxLevel = -1;
+
+    /// \brief Guards the entry point and top layer while inserting.
+    std::mutex _globalMutex;
+
+    /// \brief Guards each node's link lists while inserting.
+    std::unique_ptr<std::mutex[]> _nodeMutexes;
+
+    /// \brief Guards the visited list pool.
+    mutable std::mutex _visitedMutex;
+
+    /// \brief Visited lists reused across queries.
+    mutable std::vector<std::unique_ptr<VisitedList>> _visitedPool;
+
+};
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::uint32_t HNSW<VectorType, VectorDimension, FloatType, IndexType>::INVALID;
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::uint32_t HNSW<VectorType, VectorDimension, FloatType, IndexType>::MAGIC;
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::uint32_t HNSW<VectorType, VectorDimension, FloatType, IndexType>::VERSION;
+
+
+} // namespace ofx
@@ -0,0 +1,322 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include "ofx/SparseSpatialHash.h"
+
+
+namespace ofx {
+
+
+/// \brief A multi-resolution spatial hash for mixed query radii.
+///
+/// The HierarchicalSpatialHash keeps a stack of SparseSpatialHash levels whose
+/// cell sizes grow geometrically from a base cell size. Each radius query is
+/// answered by the finest level whose cells are at least as large as the query
+/// radius, so small collision checks and large influence queries both visit
+/// only a handful of cells.
+///
+/// Points are inserted at every level. Sphere objects can instead be inserted
+/// with an extent, in which case they are stored only at the finest level
+/// whose cells are at least as large as their diameter, and are found with
+/// findObjectsOverlappingSphere().
+///
+/// \tparam VectorType The VectorType used by this HierarchicalSpatialHash.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The point id type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class HierarchicalSpatialHash
+{
+public:
+    /// \brief A typedef for the hash used at each level.
+    typedef SparseSpatialHash<VectorType, VectorDimension, FloatType, IndexType> Level;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create an empty HierarchicalSpatialHash.
+    /// \param baseCellSize The cell size of the finest level.
+    /// \param numLevels The number of levels.
+    /// \param levelRatio The cell size ratio between consecutive levels.
+    HierarchicalSpatialHash(FloatType baseCellSize,
+                            std::size_t numLevels = DEFAULT_NUM_LEVELS,
+                            FloatType levelRatio = 2)
+    {
+        numLevels = std::max(static_cast<std::size_t>(1), numLevels);
+
+        FloatType cellSize = baseCellSize;
+
+        for (std::size_t i = 0; i < numLevels; ++i)
+        {
+            _levels.push_back(Level(cellSize));
+            cellSize *= levelRatio;
+        }
+
+        _numObjects.resize(numLevels, 0);
+        _maxExtents.resize(numLevels, 0);
+    }
+
+    /// \brief Destroy the HierarchicalSpatialHash.
+    virtual ~HierarchicalSpatialHash()
+    {
+    }
+
+    /// \returns the number of levels.
+    std::size_t getNumLevels() const
+    {
+        return _levels.size();
+    }
+
+    /// \returns the level with the given index, 0 being the finest.
+    const Level& getLevel(std::size_t level) const
+    {
+        return _levels[level];
+    }
+
+    /// \brief Get the level used for queries of the given radius.
+    /// \param radius The query radius.
+    /// \returns the finest level whose cells are at least radius wide.
+    std::size_t levelForRadius(FloatType radius) const
+    {
+        for (std::size_t i = 0; i < _levels.size(); ++i)
+        {
+            if (_levels[i].getCellSize() >= radius)
+            {
+                return i;
+            }
+        }
+
+        return _levels.size() - 1;
+    }
+
+    /// \brief Insert or move a point, storing it at every level.
+    /// \param id The point id.
+    /// \param position The point's position.
+    void insert(IndexType id, const VectorType& position)
+    {
+        remove(id);
+        setLevel(id, ALL_LEVELS, 0);
+
+        for (auto& level: _levels)
+        {
+            level.insert(id, position);
+        }
+    }
+
+    /// \brief Insert or move a sphere object, storing it at a single level.
+    /// \param id The object id.
+    /// \param position The object's center.
+    /// \param extent The object's radius.
+    void insert(IndexType id, const VectorType& position, FloatType extent)
+    {
+        remove(id);
+
+        const std::size_t level = levelForRadius(extent * 2);
+
+        setLevel(id, level, extent);
+        _levels[level].insert(id, position);
+        _maxExtents[level] = std::max(_maxExtents[level], extent);
+        ++_numObjects[level];
+    }
+
+    /// \brief Move a point or object, keeping its extent.
+    /// \param id The point or object id.
+    /// \param position The new position.
+    void move(IndexType id, const VectorType& position)
+    {
+        if (id >= _idLevels.size() || _idLevels[id] == NOT_PRESENT)
+        {
+            return;
+        }
+
+        if (_idLevels[id] == ALL_LEVELS)
+        {
+            for (auto& level: _levels)
+            {
+                level.move(id, position);
+            }
+        }
+        else
+        {
+            _levels[_idLevels[id]].move(id, position);
+        }
+    }
+
+    /// \brief Remove a point or object.
+    /// \param id The point or object id.
+    void remove(IndexType id)
+    {
+        if (id >= _idLevels.size() || _idLevels[id] == NOT_PRESENT)
+        {
+            return;
+        }
+
+        if (_idLevels[id] == ALL_LEVELS)
+        {
+            for (auto& level: _levels)
+            {
+                level.remove(id);
+            }
+        }
+        else
+        {
+            _levels[_idLevels[id]].remove(id);
+            --_numObjects[_idLevels[id]];
+        }
+
+        _idLevels[id] = NOT_PRESENT;
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    ///
+    /// Only ids inserted as points are returned. The query is answered by the
+    /// level returned by levelForRadius().
+    ///
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point ids and distances squared.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        const std::size_t level = levelForRadius(radius);
+
+        _levels[level].findPointsWithinRadius(point, radius, results, epsilon, sorted);
+
+        if (_numObjects[level] > 0)
+        {
+            // Drop objects stored at this level.
+            results.erase(std::remove_if(results.begin(), results.end(), [this](const IndexDistanceSquaredPair& result)
+            {
+                return _idLevels[result.first] != ALL_LEVELS;
+            }), results.end());
+        }
+
+        return results.size();
+    }
+
+    /// \brief Find all sphere objects that overlap a query sphere.
+    ///
+    /// Each level holding objects is searched with the query radius expanded
+    /// by the largest extent stored at that level, and the candidates are then
+    /// tested against their own extents. The returned distances are the
+    /// squared distances between centers.
+    ///
+    /// \param point The center of the query sphere.
+    /// \param radius The radius of the query sphere.
+    /// \param results A collection of object ids and distances squared.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of overlapping objects.
+    std::size_t findObjectsOverlappingSphere(const VectorType& point,
+                                             FloatType radius,
+                                             SearchResults& results,
+                                             bool sorted = true) const
+    {
+        results.clear();
+
+        SearchResults candidates;
+
+        for (std::size_t level = 0; level < _levels.size(); ++level)
+        {
+            if (_numObjects[level] == 0)
+            {
+                continue;
+            }
+
+            _levels[level].findPointsWithinRadius(point, radius + _maxExtents[level], candidates, 0, false);
+
+            for (const auto& candidate: candidates)
+            {
+                if (_idLevels[candidate.first] == level)
+                {
+                    const FloatType reach = radius + _extents[candidate.first];
+
+                    if (candidate.second < reach * reach)
+                    {
+                        results.push_back(candidate);
+                    }
+                }
+            }
+        }
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    enum
+    {
+        /// \brief The default number of levels.
+        DEFAULT_NUM_LEVELS = 8
+    };
+
+protected:
+    /// \brief Marks ids that are stored at every level.
+    static constexpr std::size_t ALL_LEVELS = std::numeric_limits<std::size_t>::max() - 1;
+
+    /// \brief Marks ids that are not in the hash.
+    static constexpr std::size_t NOT_PRESENT = std::numeric_limits<std::size_t>::max();
+
+    /// \brief Record the level and extent of an id.
+    void setLevel(IndexType id, std::size_t level, FloatType extent)
+    {
+        if (id >= _idLevels.size())
+        {
+            _idLevels.resize(id + 1, NOT_PRESENT);
+            _extents.resize(id + 1, 0);
+        }
+
+        _idLevels[id] = level;
+        _extents[id] = extent;
+    }
+
+    /// \brief The levels, finest first.
+    std::vector<Level> _levels;
+
+    /// \brief The number of objects stored at each level.
+    std::vector<std::size_t> _numObjects;
+
+    /// \brief The level of each id, ALL_LEVELS or NOT_PRESENT.
+    std::vector<std::size_t> _idLevels;
+
+    /// \brief The largest extent inserted at each level.
+    std::vector<FloatType> _maxExtents;
+
+    /// \brief The extent of each object id.
+    std::vector<FloatType> _extents;
+
+};
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::size_t HierarchicalSpatialHash<VectorType, VectorDimension, FloatType, IndexType>::ALL_LEVELS;
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::size_t HierarchicalSpatialHash<VectorType, VectorDimension, FloatType, IndexType>::NOT_PRESENT;
+
+
+} // namespace ofx
@@ -0,0 +1,670 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+
+
+namespace ofx {
+
+
+/// \brief A randomized kd-forest for approximate high dimensional search.
+///
+/// The KDForest builds several kd-trees over the same points. Each tree picks
+/// its split dimension at random among the dimensions of highest variance, so
+/// the trees partition the space differently. A query descends every tree and
+/// then explores the most promising unvisited branches of all trees from a
+/// single shared priority queue, stopping once the requested number of points
+/// has been checked (Silpa-Anan and Hartley, "Optimised KD-trees for fast image
+/// descriptor matching", 2008; Muja and Lowe, FLANN, 2009).
+///
+/// The number of checks is taken from nanoflann::SearchParams::checks, which
+/// nanoflann itself ignores, and trades recall for speed. A non-positive
+/// number of checks removes the limit. Branches are still pruned with FLANN's
+/// approximate distance bound, so even unlimited searches are near exact
+/// rather than exact.
+///
+/// \tparam VectorType The internal VectorType used by this KDForest.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class KDForest
+{
+public:
+    static_assert(VectorDimension > 0, "The KDForest requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create a KDForest with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() method, otherwise search results will be
+    /// invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param numTrees The number of randomized trees.
+    /// \param maxLeafSize The maximum number of points in a leaf.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    KDForest(const Points& points,
+             std::size_t numTrees = DEFAULT_NUM_TREES,
+             std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE,
+             bool autoBuildIndex = true):
+        _points(points),
+        _numTrees(std::max(static_cast<std::size_t>(1), numTrees)),
+        _maxLeafSize(std::max(static_cast<std::size_t>(1), maxLeafSize))
+    {
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the KDForest.
+    virtual ~KDForest()
+    {
+    }
+
+    /// \brief Rebuild all trees. The trees are built in parallel.
+    void buildIndex()
+    {
+        _trees.clear();
+        _trees.resize(_numTrees);
+
+        if (_points.empty())
+        {
+            return;
+        }
+
+        ParallelFor(_numTrees, ParallelChunkCount(_numTrees, 1), [this](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t tree = begin; tree < end; ++tree)
+            {
+                buildTree(_trees[tree], RANDOM_SEED + tree);
+            }
+        });
+    }
+
+    /// \brief Set the number of checks used by the convenience queries.
+    /// \param checks The number of points to check, or 0 for no limit.
+    void setChecks(int checks)
+    {
+        _checks = checks;
+    }
+
+    /// \returns the number of checks used by the convenience queries.
+    int getChecks() const
+    {
+        return _checks;
+    }
+
+    /// \returns the number of trees.
+    std::size_t getNumTrees() const
+    {
+        return _numTrees;
+    }
+
+    /// \brief Find neighbors using a custom nanoflann compatible result set.
+    ///
+    /// Each point is reported at most once, even though every tree holds it.
+    ///
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The search parameters. Only checks is used.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet,
+                       const FloatType* pVector,
+                       const nanoflann::SearchParams& params) const
+    {
+        if (_points.empty())
+        {
+            return;
+        }
+
+        const std::size_t maxChecks = params.checks > 0
+                                    ? static_cast<std::size_t>(params.checks)
+                                    : std::numeric_limits<std::size_t>::max();
+
+        // The first descent of every tree checks up to a leaf per tree.
+        VisitedSet visited(maxChecks == std::numeric_limits<std::size_t>::max()
+                           ? _points.size()
+                           : maxChecks + _numTrees * _maxLeafSize,
+                           _points.size());
+
+        std::priority_queue<Branch, std::vector<Branch>, std::greater<Branch>> branches;
+
+        std::size_t numChecks = 0;
+
+        for (std::size_t tree = 0; tree < _trees.size(); ++tree)
+        {
+            searchLevel(resultSet, pVector, tree, 0, 0, numChecks, maxChecks, branches, visited);
+        }
+
+        while (!branches.empty() && (numChecks < maxChecks || !resultSet.full()))
+        {
+            const Branch branch = branches.top();
+            branches.pop();
+
+            searchLevel(resultSet, pVector, branch.tree, branch.node, branch.distanceSquared, numChecks, maxChecks, branches, visited);
+        }
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams(_checks));
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    ///
+    /// Like the nearest neighbor queries, the search stops after the
+    /// configured number of checks, so points may be missed.
+    ///
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams(_checks));
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    enum
+    {
+        /// \brief The default number of trees.
+        DEFAULT_NUM_TREES = 4,
+
+        /// \brief The default maximum number of points in a leaf.
+        DEFAULT_MAX_LEAF_SIZE = 10,
+
+        /// \brief The default number of checks.
+        DEFAULT_CHECKS = 128,
+
+        /// \brief The number of highest variance dimensions a split picks from.
+        NUM_RANDOM_DIMENSIONS = 5,
+
+        /// \brief The number of points sampled to estimate the variance.
+        NUM_VARIANCE_SAMPLES = 100,
+
+        /// \brief The seed of the first tree.
+        RANDOM_SEED = 5489
+    };
+
+protected:
+    /// \brief A tree node.
+    ///
+    /// The left child always follows its parent. The right child index is
+    /// stored explicitly.
+    struct Node
+    {
+        /// \brief The split dimension, or -1 for leaves.
+        int divfeat = -1;
+
+        /// \brief The split value.
+        FloatType divval = 0;
+
+        /// \brief The right child index.
+        std::uint32_t right = 0;
+
+        /// \brief The first point of a leaf in the tree's index order.
+        std::uint32_t first = 0;
+
+        /// \brief One past the last point of a leaf.
+        std::uint32_t last = 0;
+    };
+
+    /// \brief A randomized tree.
+    struct Tree
+    {
+        /// \brief The nodes in depth first order.
+        std::vector<Node> nodes;
+
+        /// \brief The point indices in leaf order.
+        Indicies indices;
+    };
+
+    /// \brief An unexplored branch of one of the trees.
+    struct Branch
+    {
+        /// \brief An approximate lower bound of the distance to the branch.
+        FloatType distanceSquared;
+
+        /// \brief The tree of the branch.
+        std::uint32_t tree;
+
+        /// \brief The node of the branch.
+        std::uint32_t node;
+
+        bool operator > (const Branch& other) const
+        {
+            return distanceSquared > other.distanceSquared;
+        }
+    };
+
+    /// \brief The set of points already checked by a query.
+    ///
+    /// Bounded queries only check a few points, so a small open addressed hash
+    /// set is used instead of clearing a flag per point for every query.
+    class VisitedSet
+    {
+    public:
+        VisitedSet(std::size_t maxVisits, std::size_t numPoints):
+            _useBitmap(maxVisits >= numPoints / 16)
+        {
+            if (_useBitmap)
+            {
+                _flags.assign(numPoints, false);
+            }
+            else
+            {
+                std::size_t capacity = 16;
+
+                while (capacity < maxVisits * 2)
+                {
+                    capacity *= 2;
+                }
+
+                _slots.assign(capacity, EMPTY);
+                _mask = capacity - 1;
+            }
+        }
+
+        /// \returns true iff the index had not been visited yet.
+        bool insert(IndexType index)
+        {
+            if (_useBitmap)
+            {
+                if (_flags[index])
+                {
+                    return false;
+                }
+
+                _flags[index] = true;
+                return true;
+            }
+
+            std::size_t slot = findSlot(index);
+
+            if (_slots[slot] == index)
+            {
+                return false;
+            }
+
+            // Searches that keep going past maxVisits to fill the result set
+            // grow the table, so it stays at most half full and probing ends.
+            if ((_size + 1) * 2 > _slots.size())
+            {
+                grow();
+                slot = findSlot(index);
+            }
+
+            _slots[slot] = index;
+            ++_size;
+            return true;
+        }
+
+    private:
+        static constexpr IndexType EMPTY = std::numeric_limits<IndexType>::max();
+
+        /// \returns the slot holding the index, or the empty slot ending its probe.
+        std::size_t findSlot(IndexType index) const
+        {
+            std::size_t slot = (static_cast<std::size_t>(index) * 0x9E3779B97F4A7C15ull) & _mask;
+
+            while (_slots[slot] != EMPTY && _slots[slot] != index)
+            {
+                slot = (slot + 1) & _mask;
+            }
+
+            return slot;
+        }
+
+        /// \brief Double the table and reinsert every index.
+        void grow()
+        {
+            std::vector<IndexType> slots(_slots.size() * 2, EMPTY);
+            slots.swap(_slots);
+            _mask = _slots.size() - 1;
+
+            for (const IndexType index: slots)
+            {
+                if (index != EMPTY)
+                {
+                    _slots[findSlot(index)] = index;
+                }
+            }
+        }
+
+        bool _useBitmap = false;
+        std::size_t _size = 0;
+        std::size_t _mask = 0;
+        std::vector<IndexType> _slots;
+        std::vector<bool> _flags;
+    };
+
+    /// \returns a pointer to the 0th element of a point.
+    const FloatType* pointData(IndexType index) const
+    {
+        return VectorDataPointer<VectorType, FloatType>(_points[index]);
+    }
+
+    /// \brief Build one randomized tree.
+    void buildTree(Tree& tree, std::size_t seed) const
+    {
+        std::mt19937 random(static_cast<std::mt19937::result_type>(seed));
+
+        tree.indices.resize(_points.size());
+
+        for (std::size_t i = 0; i < _points.size(); ++i)
+        {
+            tree.indices[i] = static_cast<IndexType>(i);
+        }
+
+        // Shuffle so the first points of any range are a random sample.
+        std::shuffle(tree.indices.begin(), tree.indices.end(), random);
+
+        tree.nodes.clear();
+        tree.nodes.reserve(2 * _points.size() / _maxLeafSize + 1);
+
+        buildNode(tree, 0, _points.size(), random);
+    }
+
+    /// \brief Recursively build the node for the given range of points.
+    void buildNode(Tree& tree,
+                   std::size_t first,
+                   std::size_t last,
+                   std::mt19937& random) const
+    {
+        const std::size_t nodeIndex = tree.nodes.size();
+        tree.nodes.push_back(Node());
+
+        const std::size_t count = last - first;
+
+        if (count <= _maxLeafSize)
+        {
+            tree.nodes[nodeIndex].first = static_cast<std::uint32_t>(first);
+            tree.nodes[nodeIndex].last = static_cast<std::uint32_t>(last);
+            return;
+        }
+
+        // Estimate the mean and variance of each dimension from a sample.
+        const std::size_t numSamples = std::min(count, static_cast<std::size_t>(NUM_VARIANCE_SAMPLES));
+
+        std::array<FloatType, VectorDimension> mean;
+        std::array<FloatType, VectorDimension> variance;
+        mean.fill(0);
+        variance.fill(0);
+
+        for (std::size_t i = first; i < first + numSamples; ++i)
+        {
+            const FloatType* pPoint = pointData(tree.indices[i]);
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                mean[j] += pPoint[j];
+            }
+        }
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            mean[j] /= numSamples;
+        }
+
+        for (std::size_t i = first; i < first + numSamples; ++i)
+        {
+            const FloatType* pPoint = pointData(tree.indices[i]);
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                const FloatType difference = pPoint[j] - mean[j];
+                variance[j] += difference * difference;
+            }
+        }
+
+        // Pick one of the highest variance dimensions at random.
+        const std::size_t numCandidates = std::min(static_cast<std::size_t>(NUM_RANDOM_DIMENSIONS),
+                                                   static_cast<std::size_t>(VectorDimension));
+
+        std::array<std::size_t, VectorDimension> dimensions;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            dimensions[j] = j;
+        }
+
+        std::partial_sort(dimensions.begin(), dimensions.begin() + numCandidates, dimensions.end(), [&](std::size_t a, std::size_t b)
+        {
+            return variance[a] > variance[b];
+        });
+
+        const std::size_t divfeat = dimensions[std::uniform_int_distribution<std::size_t>(0, numCandidates - 1)(random)];
+
+        FloatType divval = mean[divfeat];
+
+        auto begin = tree.indices.begin() + first;
+        auto end = tree.indices.begin() + last;
+
+        auto middle = std::partition(begin, end, [&](IndexType index)
+        {
+            return pointData(index)[divfeat] < divval;
+        });
+
+        if (middle == begin || middle == end)
+        {
+            // The sample mean did not split the range, so split at the median.
+            middle = begin + count / 2;
+
+            std::nth_element(begin, middle, end, [&](IndexType a, IndexType b)
+            {
+                return pointData(a)[divfeat] < pointData(b)[divfeat];
+            });
+
+            divval = pointData(*middle)[divfeat];
+        }
+
+        const std::size_t split = first + (middle - begin);
+
+        tree.nodes[nodeIndex].divfeat = static_cast<int>(divfeat);
+        tree.nodes[nodeIndex].divval = divval;
+
+        buildNode(tree, first, split, random);
+
+        tree.nodes[nodeIndex].right = static_cast<std::uint32_t>(tree.nodes.size());
+
+        buildNode(tree, split, last, random);
+    }
+
+    /// \brief Descend one tree to a leaf, queueing the branches not taken.
+    template <typename ResultSetType, typename BranchQueue>
+    void searchLevel(ResultSetType& resultSet,
+                     const FloatType* pVector,
+                     std::size_t treeIndex,
+                     std::size_t nodeIndex,
+                     FloatType minDistanceSquared,
+                     std::size_t& numChecks,
+                     std::size_t maxChecks,
+                     BranchQueue& branches,
+                     VisitedSet& visited) const
+    {
+        const Tree& tree = _trees[treeIndex];
+
+        if (minDistanceSquared > resultSet.worstDist())
+        {
+            return;
+        }
+
+        while (tree.nodes[nodeIndex].divfeat >= 0)
+        {
+            const Node& node = tree.nodes[nodeIndex];
+
+            const FloatType difference = pVector[node.divfeat] - node.divval;
+
+            const std::size_t nearChild = difference < 0 ? nodeIndex + 1 : node.right;
+            const std::size_t farChild = difference < 0 ? node.right : nodeIndex + 1;
+
+            // As in FLANN, the far branch bound accumulates the squared
+            // distances to the planes crossed along the way.
+            const FloatType farDistanceSquared = minDistanceSquared + difference * difference;
+
+            if (farDistanceSquared < resultSet.worstDist())
+            {
+                Branch branch;
+                branch.distanceSquared = farDistanceSquared;
+                branch.tree = static_cast<std::uint32_t>(treeIndex);
+                branch.node = static_cast<std::uint32_t>(farChild);
+                branches.push(branch);
+            }
+
+            nodeIndex = nearChild;
+        }
+
+        if (numChecks >= maxChecks && resultSet.full())
+        {
+            return;
+        }
+
+        const Node& leaf = tree.nodes[nodeIndex];
+
+        for (std::uint32_t i = leaf.first; i < leaf.last; ++i)
+        {
+            const IndexType index = tree.indices[i];
+
+            if (!visited.insert(index))
+            {
+                continue;
+            }
+
+            ++numChecks;
+
+            const FloatType* pPoint = pointData(index);
+
+            FloatType distance = 0;
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                const FloatType difference = pVector[j] - pPoint[j];
+                distance += difference * difference;
+            }
+
+            if (distance < resultSet.worstDist())
+            {
+                resultSet.addPoint(distance, index);
+            }
+        }
+    }
+
+    /// \brief A const reference to the points.
+    const Points& _points;
+
+    /// \brief The number of trees.
+    std::size_t _numTrees = DEFAULT_NUM_TREES;
+
+    /// \brief The maximum number of points in a leaf.
+    std::size_t _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The number of checks used by the convenience queries.
+    int _checks = DEFAULT_CHECKS;
+
+    /// \brief The randomized trees.
+    std::vector<Tree> _trees;
+
+};
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr IndexType KDForest<VectorType, VectorDimension, FloatType, IndexType>::VisitedSet::EMPTY;
+
+
+} // namespace ofx
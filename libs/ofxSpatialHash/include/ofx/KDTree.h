@@ -10,64 +10,29 @@
 
 #include "nanoflann.hpp"
 #include <array>
-#include "ofVec2f.h"
-#include "ofVec3f.h"
-#include "ofVec4f.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <random>
+#include <type_traits>
+#include "ofx/ResultSets.h"
+#include "ofx/SearchStats.h"
+#include "ofx/VectorData.h"
 
 
 namespace ofx {
 
 
-/// \brief Helpers for getting data pointer.
-template <typename VectorType, typename FloatType>
-const FloatType* VectorDataPointer(const VectorType& v) { return v.data(); }
-
-template <>
-inline const float* VectorDataPointer(const ofVec2f& v) { return v.getPtr(); }
-
-template <>
-inline const float* VectorDataPointer(const ofVec3f& v) { return v.getPtr(); }
-
-template <>
-inline const float* VectorDataPointer(const ofVec4f& v) { return v.getPtr(); }
-
-template <>
-inline const float* VectorDataPointer(const glm::vec2& v) { return &v[0]; }
-
-template <>
-inline const float* VectorDataPointer(const glm::vec3& v) { return &v[0]; }
-
-template <>
-inline const float* VectorDataPointer(const glm::vec4& v) { return &v[0]; }
-
-
-/// \brief Helpers for getting data vector dimensions.
-template <typename VectorType>
-struct VectorDataDim { static const int DIM = -1; };
-
-template <>
-struct VectorDataDim<ofVec2f> { static const int DIM = ofVec2f::DIM; };
-
-template <>
-struct VectorDataDim<ofVec3f> { static const int DIM = ofVec3f::DIM; };
-
-template <>
-struct VectorDataDim<ofVec4f> { static const int DIM = ofVec4f::DIM; };
-
-template <>
-struct VectorDataDim<glm::vec2> { static const int DIM = 2; };//glm::vec2::components; };
-
-template <>
-struct VectorDataDim<glm::vec3> { static const int DIM = 3; };//glm::vec3::components; };
-
-template <>
-struct VectorDataDim<glm::vec4> { static const int DIM = 4; };//glm::vec4::components; };
-
-template <typename FloatType, std::size_t N>
-struct VectorDataDim<std::array<FloatType, N>> { static const int DIM = N; };
-
-
 /// \brief A KDTree optimized for 2D/3D point clouds.
+///
+/// All query methods are const and reentrant. They keep their working state
+/// on the stack or in caller supplied containers, so any number of threads may
+/// query the same KDTree concurrently without locking, as long as no thread
+/// calls buildIndex() or modifies the points meanwhile. A WarmStartQuery or
+/// NearestNeighborIterator holds per-query state and must not be shared
+/// between threads, but each thread may create its own.
+///
 /// \tparam VectorType The internal VectorType used by this KDTree.
 /// \tparam VectorDimension The number of dimensions in the VectorType used by this KDTree.
 /// \tparam FloatType The internal floating point type used by this KDTree.
@@ -111,6 +76,123 @@ public:
     /// \brief A typedef for a KDTreeSingleIndexAdaptorParams.
     typedef nanoflann::KDTreeSingleIndexAdaptorParams KDTreeParams;
 
+    /// \brief The search backends available to the KDTree.
+    enum SearchBackend
+    {
+        /// \brief Use a linear scan below the brute force threshold.
+        SEARCH_BACKEND_AUTO,
+        /// \brief Always build and search the tree.
+        SEARCH_BACKEND_TREE,
+        /// \brief Always use a linear scan and never build the tree.
+        SEARCH_BACKEND_BRUTE_FORCE
+    };
+
+    /// \brief Settings for autotune().
+    struct AutotuneSettings
+    {
+        /// \brief The candidate maximum leaf sizes.
+        std::vector<std::size_t> leafSizes = { 1, 2, 4, 8, 12, 16, 24, 32, 48, 64 };
+
+        /// \brief The maximum number of points sampled from the point set.
+        std::size_t maxSamplePoints = 100000;
+
+        /// \brief The maximum number of workload queries timed.
+        std::size_t maxSampleQueries = 1000;
+
+        /// \brief The number of nearest neighbors per query, or 0 for none.
+        std::size_t numPointsToFind = 16;
+
+        /// \brief The radius of a radius search per query, or 0 for none.
+        FloatType radius = 0;
+
+        /// \brief The number of queries expected between rebuilds.
+        ///
+        /// This weighs the build time against the query time. Use 0 to
+        /// optimize build time alone.
+        std::size_t queriesPerBuild = 10000;
+
+        /// \brief The number of timing repetitions. The fastest is kept.
+        std::size_t numRepetitions = 3;
+
+        /// \brief The seed used to sample points and queries.
+        unsigned int seed = 0;
+    };
+
+    /// \brief The timings of one candidate leaf size.
+    struct AutotuneMeasurement
+    {
+        /// \brief The maximum leaf size.
+        std::size_t leafSize = 0;
+
+        /// \brief The build time of the sample, in seconds.
+        double buildSeconds = 0;
+
+        /// \brief The time per sample query, in seconds.
+        double querySeconds = 0;
+
+        /// \brief The estimated cost of one build and queriesPerBuild queries
+        ///        on the full point set, in seconds.
+        double cost = 0;
+    };
+
+    /// \brief The result of autotune().
+    struct AutotuneResult
+    {
+        /// \brief The parameters with the lowest estimated cost.
+        KDTreeParams params;
+
+        /// \brief The timings of every candidate leaf size.
+        std::vector<AutotuneMeasurement> measurements;
+    };
+
+    /// \brief The shape and memory footprint of a built KDTree.
+    struct TreeStats
+    {
+        /// \brief The number of indexed points.
+        std::size_t numPoints = 0;
+
+        /// \brief The number of nodes, including leaves.
+        std::size_t numNodes = 0;
+
+        /// \brief The number of leaves.
+        std::size_t numLeaves = 0;
+
+        /// \brief The depth of the shallowest leaf. The root has depth 0.
+        std::size_t minDepth = 0;
+
+        /// \brief The depth of the deepest leaf.
+        std::size_t maxDepth = 0;
+
+        /// \brief The mean depth of the leaves.
+        double averageDepth = 0;
+
+        /// \brief The number of leaves holding each number of points.
+        ///
+        /// leafSizeHistogram[n] is the number of leaves with n points.
+        std::vector<std::size_t> leafSizeHistogram;
+
+        /// \brief The bytes allocated for nodes by the nanoflann pool,
+        ///        including the unused tail of each pool block.
+        std::size_t poolBytes = 0;
+
+        /// \brief The bytes allocated for the reordered point indices.
+        std::size_t indexBytes = 0;
+
+        /// \brief The fraction of the root bounding box not covered by the
+        ///        bounding boxes of the points in each leaf.
+        ///
+        /// Dimensions in which all points are equal are ignored. Values near
+        /// one are normal for small leaves and clustered data; a rising value
+        /// over time for the same kind of data indicates a degrading tree.
+        double emptySpaceRatio = 0;
+
+        /// \returns the total bytes used by the index, excluding the points.
+        std::size_t totalBytes() const
+        {
+            return poolBytes + indexBytes;
+        }
+    };
+
     /// \brief Create a spatial hash with a reference to a vector or points.
     ///
     /// Users should initialize the KDTree with a const reference to a
@@ -149,9 +231,395 @@ public:
     /// \brief Rebuild the spatial hash index.
     ///
     /// If the internal data is ever
+    ///
+    /// If the brute force backend is selected for the current number of
+    /// points, the tree is not built and searches use a linear scan.
     inline void buildIndex()
     {
-        _KDTree.buildIndex();
+        _isBruteForce = (SEARCH_BACKEND_BRUTE_FORCE == _searchBackend)
+                     || (SEARCH_BACKEND_AUTO == _searchBackend
+                         && _points.size() < _bruteForceThreshold);
+
+        if (_isBruteForce)
+        {
+            _KDTree.freeIndex(_KDTree);
+        }
+        else
+        {
+            _KDTree.buildIndex();
+        }
+
+        buildDensityCache();
+    }
+
+    /// \brief Set the search backend.
+    ///
+    /// The backend takes effect the next time buildIndex() is called.
+    ///
+    /// \param searchBackend The search backend to use.
+    void setSearchBackend(SearchBackend searchBackend)
+    {
+        _searchBackend = searchBackend;
+    }
+
+    /// \returns the requested search backend.
+    SearchBackend getSearchBackend() const
+    {
+        return _searchBackend;
+    }
+
+    /// \brief Set the point count below which SEARCH_BACKEND_AUTO scans.
+    ///
+    /// The threshold takes effect the next time buildIndex() is called.
+    ///
+    /// \param bruteForceThreshold The brute force threshold.
+    void setBruteForceThreshold(std::size_t bruteForceThreshold)
+    {
+        _bruteForceThreshold = bruteForceThreshold;
+    }
+
+    /// \returns the point count below which SEARCH_BACKEND_AUTO scans.
+    std::size_t getBruteForceThreshold() const
+    {
+        return _bruteForceThreshold;
+    }
+
+    /// \returns true iff the last buildIndex() selected a linear scan.
+    bool isBruteForce() const
+    {
+        return _isBruteForce;
+    }
+
+    /// \brief Set the tree parameters.
+    ///
+    /// The parameters take effect the next time buildIndex() is called.
+    ///
+    /// \param params The tree parameters.
+    void setParams(const KDTreeParams& params)
+    {
+        _KDTree.m_leaf_max_size = params.leaf_max_size;
+    }
+
+    /// \returns the tree parameters.
+    KDTreeParams getParams() const
+    {
+        return KDTreeParams(_KDTree.m_leaf_max_size);
+    }
+
+    /// \brief Measure the shape and memory footprint of the index.
+    ///
+    /// This walks every node and reads every point once, so it is meant for
+    /// monitoring and tuning, not for every frame. If a linear scan was
+    /// selected, there is no tree and only numPoints is set.
+    ///
+    /// \returns the tree statistics.
+    TreeStats stats() const
+    {
+        TreeStats result;
+        result.numPoints = _points.size();
+
+        if (_isBruteForce || !_KDTree.root_node)
+        {
+            return result;
+        }
+
+        result.poolBytes = _KDTree.pool.usedMemory + _KDTree.pool.wastedMemory;
+        result.indexBytes = _KDTree.vind.capacity() * sizeof(IndexType);
+        result.minDepth = std::numeric_limits<std::size_t>::max();
+
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+
+        std::vector<FloatType> rootExtents(dimension);
+
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            rootExtents[d] = _KDTree.root_bbox[d].high - _KDTree.root_bbox[d].low;
+        }
+
+        std::vector<FloatType> low(dimension);
+        std::vector<FloatType> high(dimension);
+
+        double coveredRatio = 0;
+        double depthSum = 0;
+
+        std::vector<std::pair<typename KDTreeAdapter::NodePtr, std::size_t>> stack;
+        stack.emplace_back(_KDTree.root_node, 0);
+
+        while (!stack.empty())
+        {
+            const typename KDTreeAdapter::NodePtr node = stack.back().first;
+            const std::size_t depth = stack.back().second;
+            stack.pop_back();
+
+            ++result.numNodes;
+
+            if (node->child1 != nullptr || node->child2 != nullptr)
+            {
+                if (node->child1 != nullptr)
+                {
+                    stack.emplace_back(node->child1, depth + 1);
+                }
+
+                if (node->child2 != nullptr)
+                {
+                    stack.emplace_back(node->child2, depth + 1);
+                }
+
+                continue;
+            }
+
+            ++result.numLeaves;
+            result.minDepth = std::min(result.minDepth, depth);
+            result.maxDepth = std::max(result.maxDepth, depth);
+            depthSum += depth;
+
+            const std::size_t left = node->node_type.lr.left;
+            const std::size_t right = node->node_type.lr.right;
+            const std::size_t count = right - left;
+
+            if (result.leafSizeHistogram.size() <= count)
+            {
+                result.leafSizeHistogram.resize(count + 1, 0);
+            }
+
+            ++result.leafSizeHistogram[count];
+
+            if (count == 0)
+            {
+                continue;
+            }
+
+            for (std::size_t d = 0; d < dimension; ++d)
+            {
+                low[d] = high[d] = kdtree_get_pt(_KDTree.vind[left], d);
+            }
+
+            for (std::size_t i = left + 1; i < right; ++i)
+            {
+                for (std::size_t d = 0; d < dimension; ++d)
+                {
+                    const FloatType value = kdtree_get_pt(_KDTree.vind[i], d);
+                    low[d] = std::min(low[d], value);
+                    high[d] = std::max(high[d], value);
+                }
+            }
+
+            // Accumulate the leaf volume relative to the root volume, one
+            // dimension at a time, so that high dimensions do not overflow.
+            double ratio = 1;
+
+            for (std::size_t d = 0; d < dimension; ++d)
+            {
+                if (rootExtents[d] > 0)
+                {
+                    ratio *= double(high[d] - low[d]) / rootExtents[d];
+                }
+            }
+
+            coveredRatio += ratio;
+        }
+
+        result.averageDepth = depthSum / result.numLeaves;
+        result.emptySpaceRatio = std::max(0.0, 1.0 - coveredRatio);
+
+        return result;
+    }
+
+    /// \brief Find the best maximum leaf size for the points and a workload.
+    ///
+    /// A random sample of the points is indexed once per candidate leaf size,
+    /// and the build and a sample of the workload queries are timed. Each
+    /// candidate's cost is estimated for the full point set as one build plus
+    /// AutotuneSettings::queriesPerBuild queries, and the cheapest wins. When
+    /// the points are sampled, the search radius is scaled so that a query
+    /// finds about as many sample points as it would find points.
+    ///
+    /// The index itself is not changed. Pass the result to setParams() and
+    /// call buildIndex(), or use autotuneIndex() to do both.
+    ///
+    /// \param queries Representative query points. If empty, queries are
+    ///        sampled from the points.
+    /// \param settings The autotune settings.
+    /// \returns the best parameters and the timings of every candidate.
+    AutotuneResult autotune(const Points& queries = Points(),
+                            const AutotuneSettings& settings = AutotuneSettings()) const
+    {
+        AutotuneResult result;
+        result.params = getParams();
+
+        const std::size_t numPoints = _points.size();
+
+        if (numPoints == 0 || settings.leafSizes.empty())
+        {
+            return result;
+        }
+
+        std::mt19937 random(settings.seed);
+
+        // Sample the points with a partial Fisher-Yates shuffle.
+        Points samplePoints;
+
+        if (numPoints <= settings.maxSamplePoints)
+        {
+            samplePoints = _points;
+        }
+        else
+        {
+            std::vector<std::size_t> order(numPoints);
+
+            for (std::size_t i = 0; i < numPoints; ++i)
+            {
+                order[i] = i;
+            }
+
+            samplePoints.reserve(settings.maxSamplePoints);
+
+            for (std::size_t i = 0; i < settings.maxSamplePoints; ++i)
+            {
+                std::swap(order[i], order[std::uniform_int_distribution<std::size_t>(i, numPoints - 1)(random)]);
+                samplePoints.push_back(_points[order[i]]);
+            }
+        }
+
+        // Sample the queries.
+        const Points& queryPool = queries.empty() ? _points : queries;
+
+        Points sampleQueries;
+
+        for (std::size_t i = 0; i < std::min(queryPool.size(), settings.maxSampleQueries); ++i)
+        {
+            sampleQueries.push_back(queryPool[std::uniform_int_distribution<std::size_t>(0, queryPool.size() - 1)(random)]);
+        }
+
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+        const double sampleRatio = double(numPoints) / samplePoints.size();
+
+        // Keep the expected number of radius results of the full point set.
+        const FloatType sampleRadius = settings.radius * static_cast<FloatType>(std::pow(sampleRatio, 1.0 / dimension));
+
+        // Builds scale as n log n and queries roughly as log n.
+        const double logRatio = std::log(double(std::max(numPoints, static_cast<std::size_t>(2))))
+                              / std::log(double(std::max(samplePoints.size(), static_cast<std::size_t>(2))));
+
+        typedef std::chrono::high_resolution_clock Clock;
+
+        double bestCost = std::numeric_limits<double>::max();
+
+        Indicies indices;
+        DistancesSquared distancesSquared;
+        SearchResults results;
+
+        for (std::size_t leafSize: settings.leafSizes)
+        {
+            AutotuneMeasurement measurement;
+            measurement.leafSize = std::max(static_cast<std::size_t>(1), leafSize);
+            measurement.buildSeconds = std::numeric_limits<double>::max();
+            measurement.querySeconds = std::numeric_limits<double>::max();
+
+            KDTree tree(samplePoints, measurement.leafSize, false);
+            tree.setSearchBackend(SEARCH_BACKEND_TREE);
+
+            for (std::size_t repetition = 0; repetition < std::max(static_cast<std::size_t>(1), settings.numRepetitions); ++repetition)
+            {
+                auto start = Clock::now();
+                tree.buildIndex();
+                measurement.buildSeconds = std::min(measurement.buildSeconds, std::chrono::duration<double>(Clock::now() - start).count());
+
+                start = Clock::now();
+
+                for (const VectorType& query: sampleQueries)
+                {
+                    if (settings.numPointsToFind > 0)
+                    {
+                        tree.findNClosestPoints(query, settings.numPointsToFind, indices, distancesSquared);
+                    }
+
+                    if (settings.radius > 0)
+                    {
+                        tree.findPointsWithinRadius(query, sampleRadius, results, 0, false);
+                    }
+                }
+
+                const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                measurement.querySeconds = std::min(measurement.querySeconds, seconds / std::max(static_cast<std::size_t>(1), sampleQueries.size()));
+            }
+
+            measurement.cost = measurement.buildSeconds * sampleRatio * logRatio
+                             + measurement.querySeconds * logRatio * settings.queriesPerBuild;
+
+            if (measurement.cost < bestCost)
+            {
+                bestCost = measurement.cost;
+                result.params = KDTreeParams(measurement.leafSize);
+            }
+
+            result.measurements.push_back(measurement);
+        }
+
+        return result;
+    }
+
+    /// \brief Autotune the maximum leaf size, apply it and rebuild the index.
+    /// \param queries Representative query points. If empty, queries are
+    ///        sampled from the points.
+    /// \param settings The autotune settings.
+    /// \returns the applied parameters.
+    KDTreeParams autotuneIndex(const Points& queries = Points(),
+                               const AutotuneSettings& settings = AutotuneSettings())
+    {
+        const KDTreeParams params = autotune(queries, settings).params;
+        setParams(params);
+        buildIndex();
+        return params;
+    }
+
+    /// \brief Find neighbors using a custom nanoflann compatible result set.
+    ///
+    /// This is the search primitive used by all other query methods. It
+    /// searches the tree, or scans all points if the brute force backend was
+    /// selected when the index was built.
+    ///
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// When OFX_SPATIAL_HASH_ENABLE_STATS is defined, each search records its
+    /// traversal counters in lastSearchStats() and adds them to
+    /// threadSearchStats(). Otherwise nothing is counted.
+    ///
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The nanoflann search parameters.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet,
+                       const FloatType* pVector,
+                       const nanoflann::SearchParams& params) const
+    {
+#ifdef OFX_SPATIAL_HASH_ENABLE_STATS
+        SearchStats stats;
+        stats.queries = 1;
+
+        CountingResultSet<ResultSetType> countingResultSet(resultSet, stats);
+
+        if (_isBruteForce)
+        {
+            stats.distanceEvaluations = _points.size();
+            bruteForceSearch(countingResultSet, pVector);
+        }
+        else
+        {
+            instrumentedSearch(countingResultSet, pVector, params, stats);
+        }
+
+        lastSearchStats() = stats;
+        threadSearchStats() += stats;
+#else
+        if (_isBruteForce)
+        {
+            bruteForceSearch(resultSet, pVector);
+        }
+        else
+        {
+            _KDTree.findNeighbors(resultSet, pVector, params);
+        }
+#endif
     }
 
     /// \brief Find the N closest points to the given point.
@@ -162,7 +630,7 @@ public:
     void findNClosestPoints(const VectorType& point,
                             std::size_t numPointsToFind,
                             Indicies& indices,
-                            DistancesSquared& distancesSquared)
+                            DistancesSquared& distancesSquared) const
     {
         // Ensure reasonable parameters.
         numPointsToFind = std::min(_points.size(), numPointsToFind);
@@ -171,10 +639,12 @@ public:
         indices.resize(numPointsToFind);
         distancesSquared.resize(numPointsToFind);
 
-        _KDTree.knnSearch(VectorDataPointer<VectorType, FloatType>(point),
-                          numPointsToFind,
-                          &indices[0],
-                          &distancesSquared[0]);
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        findNeighbors(resultSet,
+                      VectorDataPointer<VectorType, FloatType>(point),
+                      nanoflann::SearchParams());
     }
 
     /// \brief Find the N closest points to the given point.
@@ -186,7 +656,7 @@ public:
     /// \param results A collection of point indices for the nearby points.
     void findNClosestPoints(const VectorType& point,
                             std::size_t numPointsToFind,
-                            SearchResults& results)
+                            SearchResults& results) const
     {
         // Ensure reasonable parameters.
         numPointsToFind = std::min(_points.size(), numPointsToFind);
@@ -209,11 +679,66 @@ public:
         }
     }
 
+    /// \brief Estimate the number of points within a radius of a point.
+    ///
+    /// The estimate walks the top of the tree, where buildIndex() caches the
+    /// point count and bounding box of each node. Nodes entirely inside or
+    /// outside the search sphere count exactly. Partially covered nodes are
+    /// assumed to be uniformly filled and contribute their point count scaled
+    /// by the covered fraction of their volume.
+    ///
+    /// If the brute force backend was selected, there is no tree and the
+    /// points are counted exactly, at the cost of a linear scan.
+    ///
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \returns the estimated number of points within the radius.
+    std::size_t estimateRadiusResultCount(const VectorType& point,
+                                          FloatType radius) const
+    {
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+
+        if (_isBruteForce && radius >= 0)
+        {
+            const FloatType radiusSquared = radius * radius;
+
+            std::size_t count = 0;
+
+            for (std::size_t i = 0; i < _points.size(); ++i)
+            {
+                if (kdtree_distance(pVector, i, dimension) < radiusSquared)
+                {
+                    ++count;
+                }
+            }
+
+            return count;
+        }
+
+        if (_densityNodes.empty() || radius < 0)
+        {
+            return 0;
+        }
+
+        // The fraction of a cube filled by its inscribed sphere.
+        const double sphereFraction = std::pow(std::acos(-1.0) / 4, dimension / 2.0)
+                                    / std::tgamma(dimension / 2.0 + 1);
+
+        double count = 0;
+
+        countDensityNode(findDensityNode(pVector, radius), pVector, radius, sphereFraction, std::numeric_limits<std::size_t>::max(), count);
+
+        return static_cast<std::size_t>(std::ceil(count));
+    }
+
     /// \brief Find the all points within a radius of the given point.
     ///
-    /// For best results, the memory in the passed results std::vector should be
-    /// preallocated using .resize() in order to prevent
-    /// std::vector resizes during the search process.
+    /// Before searching, the results are reserved for the expected result
+    /// count, taken from the same node cache as estimateRadiusResultCount(),
+    /// so they are usually allocated once rather than grown during the
+    /// search. There is no need to preallocate them. Results reused between
+    /// searches stop allocating once they have held the largest result.
     ///
     /// \param point The seed point to search near.
     /// \param radius The radius to search within.
@@ -226,62 +751,654 @@ public:
                                        FloatType radius,
                                        SearchResults& results,
                                        float epsilon = 0,
-                                       bool sorted = true)
+                                       bool sorted = true) const
     {
         nanoflann::SearchParams params;
         params.eps = epsilon;
         params.sorted = sorted;
 
-        return _KDTree.radiusSearch(VectorDataPointer<VectorType, FloatType>(point),
-                                    radius* radius,
-                                    results,
-                                    params);
-    }
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
 
+        reserveRadiusResults(results, pVector, radius);
 
-    /// \brief Get the number of data points.
-    ///
-    /// This method is an interface requirement for nanoflann point cloud.
-    ///
-    /// \returns the number of data points.
-    inline std::size_t kdtree_get_point_count() const
-    {
-        return _points.size();
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, pVector, params);
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
     }
 
-    /// \brief Get distance between the given vector and one in the point cloud.
+    /// \brief Find the N closest points within a radius of the given point.
     ///
-    /// This method is an interface requirement for nanoflann point cloud.
+    /// Unlike findPointsWithinRadius(), which collects and then sorts every
+    /// point within the radius, this keeps the N closest points found so far
+    /// in a bounded heap. Once N points are found, the search prunes with the
+    /// distance of the farthest kept point instead of the radius, so dense
+    /// regions cost about as much as a N closest points search, and results
+    /// never hold more than N points. Sorting costs O(N log N).
     ///
-    /// \param pVector a pointer to the 0th element of a vector.
-    /// \param index The index of a vector in our referenced point cloud.
-    /// \param dim The number of dimensions in our VectorType.
-    /// \returns The accumulated Euclidean distance between two vectors.
-    inline FloatType kdtree_distance(const FloatType* pVector,
-                                     const std::size_t index,
-                                     const std::size_t dim) const
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind The maximum number of points to return.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon The epsilon used for calculating distance equality.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points found, at most numPointsToFind.
+    std::size_t findNClosestPointsWithinRadius(const VectorType& point,
+                                               std::size_t numPointsToFind,
+                                               FloatType radius,
+                                               SearchResults& results,
+                                               float epsilon = 0,
+                                               bool sorted = true) const
     {
-        FloatType total = 0;
+        BoundedRadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                               std::min(numPointsToFind, _points.size()),
+                                                               results);
 
-        for (std::size_t i = 0; i < dim; ++i)
+        if (numPointsToFind > 0)
         {
-            const FloatType distance = pVector[i] - _points[index][i];
+            findNeighbors(resultSet,
+                          VectorDataPointer<VectorType, FloatType>(point),
+                          nanoflann::SearchParams(0, epsilon, false));
+        }
 
-            total += (distance * distance);
+        if (sorted)
+        {
+            resultSet.sort();
         }
 
-        return total;
+        return results.size();
     }
 
-    /// \brief Get the dim'th component of the idx'th vector in the point cloud.
+    /// \brief Find the N closest points accepted by the given predicate.
     ///
-    /// This method is an interface requirement for nanoflann point cloud.
+    /// Rejected points are skipped in the leaf loop and do not count toward
+    /// the N points found, so masked points can stay in the point collection
+    /// without rebuilding the index.
     ///
-    /// \param index The index of the vector in the point cloud.
-    /// \param dimension The dimension (i.e. 0 = x, 1 = y, 2 = z, etc) to get.
-    /// \returns the FloatType value from the vector.
-    inline FloatType kdtree_get_pt(const std::size_t index,
-                                   std::size_t dimension) const
+    /// \tparam Predicate A callable with the signature bool(IndexType).
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the maximum number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    /// \param predicate Returns true for points that may be returned.
+    /// \returns The number of accepted points found.
+    template <typename Predicate>
+    std::size_t findNClosestPoints(const VectorType& point,
+                                   std::size_t numPointsToFind,
+                                   Indicies& indices,
+                                   DistancesSquared& distancesSquared,
+                                   const Predicate& predicate) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        FilteredResultSet<nanoflann::KNNResultSet<FloatType, IndexType>,
+                          Predicate> filteredResultSet(resultSet, predicate);
+
+        findNeighbors(filteredResultSet,
+                      VectorDataPointer<VectorType, FloatType>(point),
+                      nanoflann::SearchParams());
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+
+        return resultSet.size();
+    }
+
+    /// \brief Find the N closest points accepted by the given predicate.
+    /// \tparam Predicate A callable with the signature bool(IndexType).
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the maximum number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param predicate Returns true for points that may be returned.
+    /// \returns The number of accepted points found.
+    template <typename Predicate>
+    std::size_t findNClosestPoints(const VectorType& point,
+                                   std::size_t numPointsToFind,
+                                   SearchResults& results,
+                                   const Predicate& predicate) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        std::size_t numPointsFound = findNClosestPoints(point,
+                                                        numPointsToFind,
+                                                        indices,
+                                                        distancesSquared,
+                                                        predicate);
+
+        results.resize(numPointsFound);
+
+        // Copy the results.
+        for (std::size_t i = 0; i < numPointsFound; ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+
+        return numPointsFound;
+    }
+
+    /// \brief Find the N closest points whose bit is set in the given mask.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the maximum number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    /// \param mask A mask indexed by point index, true for accepted points.
+    /// \returns The number of accepted points found.
+    std::size_t findNClosestPoints(const VectorType& point,
+                                   std::size_t numPointsToFind,
+                                   Indicies& indices,
+                                   DistancesSquared& distancesSquared,
+                                   const std::vector<bool>& mask) const
+    {
+        return findNClosestPoints(point,
+                                  numPointsToFind,
+                                  indices,
+                                  distancesSquared,
+                                  MaskPredicate(mask));
+    }
+
+    /// \brief Find the N closest points whose bit is set in the given mask.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the maximum number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param mask A mask indexed by point index, true for accepted points.
+    /// \returns The number of accepted points found.
+    std::size_t findNClosestPoints(const VectorType& point,
+                                   std::size_t numPointsToFind,
+                                   SearchResults& results,
+                                   const std::vector<bool>& mask) const
+    {
+        return findNClosestPoints(point,
+                                  numPointsToFind,
+                                  results,
+                                  MaskPredicate(mask));
+    }
+
+    /// \brief Find all points within a radius accepted by the given predicate.
+    /// \tparam Predicate A callable with the signature bool(IndexType).
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param predicate Returns true for points that may be returned.
+    /// \param epsilon The epsilon used for calculating distance equality.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of accepted points within the search radius.
+    template <typename Predicate>
+    typename std::enable_if<!std::is_arithmetic<Predicate>::value, std::size_t>::type
+    findPointsWithinRadius(const VectorType& point,
+                           FloatType radius,
+                           SearchResults& results,
+                           const Predicate& predicate,
+                           float epsilon = 0,
+                           bool sorted = true) const
+    {
+        nanoflann::SearchParams params;
+        params.eps = epsilon;
+        params.sorted = sorted;
+
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+        reserveRadiusResults(results, pVector, radius);
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        FilteredResultSet<nanoflann::RadiusResultSet<FloatType, IndexType>,
+                          Predicate> filteredResultSet(resultSet, predicate);
+
+        findNeighbors(filteredResultSet, pVector, params);
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \brief Find all points within a radius whose bit is set in the mask.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param mask A mask indexed by point index, true for accepted points.
+    /// \param epsilon The epsilon used for calculating distance equality.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of accepted points within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       const std::vector<bool>& mask,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        return findPointsWithinRadius(point,
+                                      radius,
+                                      results,
+                                      MaskPredicate(mask),
+                                      epsilon,
+                                      sorted);
+    }
+
+
+    /// \brief An incremental nearest neighbor search.
+    ///
+    /// The NearestNeighborIterator yields the points of the KDTree in order of
+    /// ascending distance from a seed point, one point per call to next(). It
+    /// performs a best-first traversal using a priority queue of tree nodes
+    /// and points, so each neighbor costs amortized O(log n) and the caller
+    /// does not need to know the number of neighbors up front.
+    ///
+    /// The iterator references the KDTree and is invalidated if the index is
+    /// rebuilt.
+    class NearestNeighborIterator
+    {
+    public:
+        /// \brief Create a NearestNeighborIterator.
+        /// \param tree The KDTree to search.
+        /// \param point The seed point to search near.
+        NearestNeighborIterator(const KDTree& tree, const VectorType& point):
+            _tree(tree),
+            _dimension(VectorDimension > 0 ? VectorDimension : tree._KDTree.dim)
+        {
+            const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+            _point.assign(pVector, pVector + _dimension);
+
+            if (tree._isBruteForce)
+            {
+                // Without a tree, every point is queued up front.
+                for (std::size_t i = 0; i < tree._points.size(); ++i)
+                {
+                    _queue.push(Entry(tree.kdtree_distance(&_point[0], i, _dimension),
+                                      nullptr,
+                                      static_cast<IndexType>(i),
+                                      0));
+                }
+
+                return;
+            }
+
+            if (tree._KDTree.root_node == nullptr || tree._points.empty())
+            {
+                return;
+            }
+
+            // Compute the distance from the point to the root bounding box.
+            FloatType distanceSquared = 0;
+
+            std::size_t offsets = _offsets.size();
+            _offsets.resize(offsets + _dimension, 0);
+
+            for (std::size_t i = 0; i < _dimension; ++i)
+            {
+                const FloatType low = tree._KDTree.root_bbox[i].low;
+                const FloatType high = tree._KDTree.root_bbox[i].high;
+
+                if (_point[i] < low)
+                {
+                    _offsets[offsets + i] = tree._KDTree.distance.accum_dist(_point[i], low, i);
+                }
+                else if (_point[i] > high)
+                {
+                    _offsets[offsets + i] = tree._KDTree.distance.accum_dist(_point[i], high, i);
+                }
+
+                distanceSquared += _offsets[offsets + i];
+            }
+
+            _queue.push(Entry(distanceSquared, tree._KDTree.root_node, 0, offsets));
+        }
+
+        /// \brief Get the next nearest point.
+        /// \param result The index and distance squared of the next point.
+        /// \returns true if a point was found, false if all points were visited.
+        bool next(IndexDistanceSquaredPair& result)
+        {
+            while (!_queue.empty())
+            {
+                Entry entry = _queue.top();
+                _queue.pop();
+
+                if (entry.node == nullptr)
+                {
+                    result = std::make_pair(entry.index, entry.distanceSquared);
+                    return true;
+                }
+
+                if (entry.node->child1 == nullptr && entry.node->child2 == nullptr)
+                {
+                    // Queue all points in the leaf.
+                    for (IndexType i = entry.node->node_type.lr.left;
+                         i < entry.node->node_type.lr.right;
+                         ++i)
+                    {
+                        const IndexType index = _tree._KDTree.vind[i];
+
+                        _queue.push(Entry(_tree.kdtree_distance(&_point[0], index, _dimension),
+                                          nullptr,
+                                          index,
+                                          0));
+                    }
+                }
+                else
+                {
+                    const int divfeat = entry.node->node_type.sub.divfeat;
+                    const FloatType value = _point[divfeat];
+                    const FloatType diff1 = value - entry.node->node_type.sub.divlow;
+                    const FloatType diff2 = value - entry.node->node_type.sub.divhigh;
+
+                    NodePtr bestChild = nullptr;
+                    NodePtr otherChild = nullptr;
+                    FloatType cutDistance = 0;
+
+                    if ((diff1 + diff2) < 0)
+                    {
+                        bestChild = entry.node->child1;
+                        otherChild = entry.node->child2;
+                        cutDistance = _tree._KDTree.distance.accum_dist(value, entry.node->node_type.sub.divhigh, divfeat);
+                    }
+                    else
+                    {
+                        bestChild = entry.node->child2;
+                        otherChild = entry.node->child1;
+                        cutDistance = _tree._KDTree.distance.accum_dist(value, entry.node->node_type.sub.divlow, divfeat);
+                    }
+
+                    // The best child shares the parent's bounds.
+                    _queue.push(Entry(entry.distanceSquared, bestChild, 0, entry.offsets));
+
+                    // The other child is at least as far as the cutting plane.
+                    std::size_t offsets = _offsets.size();
+                    _offsets.resize(offsets + _dimension);
+
+                    std::copy(_offsets.begin() + entry.offsets,
+                              _offsets.begin() + entry.offsets + _dimension,
+                              _offsets.begin() + offsets);
+
+                    FloatType distanceSquared = entry.distanceSquared
+                                              + cutDistance
+                                              - _offsets[offsets + divfeat];
+
+                    _offsets[offsets + divfeat] = cutDistance;
+
+                    _queue.push(Entry(distanceSquared, otherChild, 0, offsets));
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        typedef typename KDTreeAdapter::NodePtr NodePtr;
+
+        /// \brief A queued node or point.
+        struct Entry
+        {
+            Entry(FloatType _distanceSquared,
+                  NodePtr _node,
+                  IndexType _index,
+                  std::size_t _offsets):
+                distanceSquared(_distanceSquared),
+                node(_node),
+                index(_index),
+                offsets(_offsets)
+            {
+            }
+
+            /// \brief The (minimum) distance squared to the entry.
+            FloatType distanceSquared;
+
+            /// \brief The node, or nullptr if this entry is a point.
+            NodePtr node;
+
+            /// \brief The point index, if this entry is a point.
+            IndexType index;
+
+            /// \brief The offset of the node's per-dimension distances.
+            std::size_t offsets;
+
+            /// \brief Order entries so the closest is at the top of the queue.
+            bool operator < (const Entry& other) const
+            {
+                return distanceSquared > other.distanceSquared;
+            }
+        };
+
+        /// \brief The KDTree being searched.
+        const KDTree& _tree;
+
+        /// \brief The number of dimensions.
+        std::size_t _dimension;
+
+        /// \brief A copy of the seed point.
+        std::vector<FloatType> _point;
+
+        /// \brief Per-dimension distances from the seed to queued nodes.
+        std::vector<FloatType> _offsets;
+
+        /// \brief The queue of unvisited nodes and points.
+        std::priority_queue<Entry> _queue;
+
+    };
+
+    /// \brief A stateful nearest neighbor query for a slowly moving probe.
+    ///
+    /// The WarmStartQuery remembers the results of its last search. When the
+    /// probe is queried again, the distances from the new position to the
+    /// previous N results bound the distance to the new N-th closest point, so
+    /// the search starts with a tight worst distance instead of an unbounded
+    /// one and most subtrees are pruned immediately. Results are identical to
+    /// KDTree::findNClosestPoints().
+    ///
+    /// The query references the KDTree. If the index is rebuilt with a
+    /// different set of points, call reset().
+    class WarmStartQuery
+    {
+    public:
+        /// \brief Create a WarmStartQuery.
+        /// \param tree The KDTree to search.
+        /// \param numPointsToFind the number of points to return.
+        WarmStartQuery(const KDTree& tree, std::size_t numPointsToFind):
+            _tree(tree),
+            _numPointsToFind(numPointsToFind)
+        {
+        }
+
+        /// \brief Find the N closest points to the given point.
+        /// \param point The seed point to search near.
+        /// \param indices A collection of point indices for the nearby points.
+        /// \param distancesSquared A collection of the point distances squared.
+        /// \returns The number of points found.
+        std::size_t findNClosestPoints(const VectorType& point,
+                                       Indicies& indices,
+                                       DistancesSquared& distancesSquared)
+        {
+            // Ensure reasonable parameters.
+            std::size_t numPointsToFind = std::min(_tree._points.size(), _numPointsToFind);
+            numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+            indices.resize(numPointsToFind);
+            distancesSquared.resize(numPointsToFind);
+
+            const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+            const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _tree._KDTree.dim);
+
+            nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+            resultSet.init(&indices[0], &distancesSquared[0]);
+
+            if (_previous.size() == numPointsToFind)
+            {
+                // The previous results are all within this distance of the
+                // new point, so the N closest points must be too.
+                FloatType bound = 0;
+
+                for (std::size_t i = 0; i < _previous.size(); ++i)
+                {
+                    if (_previous[i] >= _tree._points.size())
+                    {
+                        bound = std::numeric_limits<FloatType>::max();
+                        break;
+                    }
+
+                    bound = std::max(bound, _tree.kdtree_distance(pVector, _previous[i], dimension));
+                }
+
+                // The result set only accepts points strictly closer than the
+                // bound, so step past the farthest previous result.
+                distancesSquared[numPointsToFind - 1] = std::nextafter(bound, std::numeric_limits<FloatType>::max());
+            }
+
+            _tree.findNeighbors(resultSet, pVector, nanoflann::SearchParams());
+
+            indices.resize(resultSet.size());
+            distancesSquared.resize(resultSet.size());
+
+            _previous = indices;
+
+            return resultSet.size();
+        }
+
+        /// \brief Find the N closest points to the given point.
+        /// \param point The seed point to search near.
+        /// \param results A collection of point indices for the nearby points.
+        /// \returns The number of points found.
+        std::size_t findNClosestPoints(const VectorType& point,
+                                       SearchResults& results)
+        {
+            std::size_t numPointsFound = findNClosestPoints(point,
+                                                            _indices,
+                                                            _distancesSquared);
+
+            results.resize(numPointsFound);
+
+            // Copy the results.
+            for (std::size_t i = 0; i < numPointsFound; ++i)
+            {
+                results[i] = std::make_pair(_indices[i], _distancesSquared[i]);
+            }
+
+            return numPointsFound;
+        }
+
+        /// \brief Set the number of points to find.
+        /// \param numPointsToFind the number of points to return.
+        void setNumPointsToFind(std::size_t numPointsToFind)
+        {
+            if (numPointsToFind != _numPointsToFind)
+            {
+                _numPointsToFind = numPointsToFind;
+                reset();
+            }
+        }
+
+        /// \returns the number of points to find.
+        std::size_t getNumPointsToFind() const
+        {
+            return _numPointsToFind;
+        }
+
+        /// \brief Forget the previous results.
+        ///
+        /// The next search will start from an unbounded worst distance.
+        void reset()
+        {
+            _previous.clear();
+        }
+
+    private:
+        /// \brief The KDTree being searched.
+        const KDTree& _tree;
+
+        /// \brief The number of points to find.
+        std::size_t _numPointsToFind = 0;
+
+        /// \brief The indices found by the previous search.
+        Indicies _previous;
+
+        /// \brief Scratch indices for the SearchResults overload.
+        Indicies _indices;
+
+        /// \brief Scratch distances for the SearchResults overload.
+        DistancesSquared _distancesSquared;
+
+    };
+
+    /// \brief Create an incremental nearest neighbor search.
+    ///
+    /// Calling next() on the returned iterator yields points in order of
+    /// ascending distance until all points have been returned. This is useful
+    /// when the number of points needed is not known before the search.
+    ///
+    /// \param point The seed point to search near.
+    /// \returns a NearestNeighborIterator seeded at the given point.
+    NearestNeighborIterator nearestNeighbors(const VectorType& point) const
+    {
+        return NearestNeighborIterator(*this, point);
+    }
+
+
+    /// \brief Get the number of data points.
+    ///
+    /// This method is an interface requirement for nanoflann point cloud.
+    ///
+    /// \returns the number of data points.
+    inline std::size_t kdtree_get_point_count() const
+    {
+        return _points.size();
+    }
+
+    /// \brief Get distance between the given vector and one in the point cloud.
+    ///
+    /// This method is an interface requirement for nanoflann point cloud.
+    ///
+    /// \param pVector a pointer to the 0th element of a vector.
+    /// \param index The index of a vector in our referenced point cloud.
+    /// \param dim The number of dimensions in our VectorType.
+    /// \returns The accumulated Euclidean distance between two vectors.
+    inline FloatType kdtree_distance(const FloatType* pVector,
+                                     const std::size_t index,
+                                     const std::size_t dim) const
+    {
+        FloatType total = 0;
+
+        for (std::size_t i = 0; i < dim; ++i)
+        {
+            const FloatType distance = pVector[i] - _points[index][i];
+
+            total += (distance * distance);
+        }
+
+        return total;
+    }
+
+    /// \brief Get the dim'th component of the idx'th vector in the point cloud.
+    ///
+    /// This method is an interface requirement for nanoflann point cloud.
+    ///
+    /// \param index The index of the vector in the point cloud.
+    /// \param dimension The dimension (i.e. 0 = x, 1 = y, 2 = z, etc) to get.
+    /// \returns the FloatType value from the vector.
+    inline FloatType kdtree_get_pt(const std::size_t index,
+                                   std::size_t dimension) const
     {
         return _points[index][dimension];
     }
@@ -305,16 +1422,480 @@ public:
     {
         /// \brief The default maximum leaf size.
         DEFAULT_MAX_LEAF_SIZE = 10,
+
+        /// \brief The default point count below which a linear scan is used.
+        ///
+        /// Below this size, skipping the tree build pays for the slower linear
+        /// scan when the index is rebuilt every frame and queried up to around
+        /// a hundred times between rebuilds.
+        DEFAULT_BRUTE_FORCE_THRESHOLD = 1024,
+
+        /// \brief The number of distances computed per linear scan block.
+        BRUTE_FORCE_BLOCK_SIZE = 256,
+
+        /// \brief The point count at or below which the density cache stops
+        ///        subdividing a node.
+        DENSITY_CACHE_MIN_COUNT = 256,
+
+        /// \brief The expected result count below which radius searches do not
+        ///        reserve their results.
+        DENSITY_RESERVE_MIN = 32,
+
+        /// \brief The number of density cache levels walked to reserve radius
+        ///        search results.
+        DENSITY_RESERVE_DEPTH = 8
     };
 
 
 protected:
+    /// \brief Search all points with a linear scan.
+    ///
+    /// Distances are computed in fixed size blocks with a tight loop that the
+    /// compiler can vectorize, and only then offered to the result set.
+    ///
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    template <typename ResultSetType>
+    void bruteForceSearch(ResultSetType& resultSet,
+                          const FloatType* pVector) const
+    {
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+        const std::size_t numPoints = _points.size();
+
+        FloatType distances[BRUTE_FORCE_BLOCK_SIZE];
+
+        for (std::size_t first = 0; first < numPoints; first += BRUTE_FORCE_BLOCK_SIZE)
+        {
+            const std::size_t count = std::min(static_cast<std::size_t>(BRUTE_FORCE_BLOCK_SIZE),
+                                               numPoints - first);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[first + i]);
+
+                FloatType total = 0;
+
+                for (std::size_t j = 0; j < dimension; ++j)
+                {
+                    const FloatType distance = pVector[j] - pPoint[j];
+                    total += (distance * distance);
+                }
+
+                distances[i] = total;
+            }
+
+            FloatType worstDistance = resultSet.worstDist();
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (distances[i] < worstDistance)
+                {
+                    if (!resultSet.addPoint(distances[i], static_cast<IndexType>(first + i)))
+                    {
+                        return;
+                    }
+
+                    worstDistance = resultSet.worstDist();
+                }
+            }
+        }
+    }
+
+#ifdef OFX_SPATIAL_HASH_ENABLE_STATS
+    /// \brief Search the tree like KDTreeAdapter::findNeighbors(), counting
+    ///        the traversal.
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The nanoflann search parameters.
+    /// \param stats The counters to update.
+    template <typename ResultSetType>
+    void instrumentedSearch(ResultSetType& resultSet,
+                            const FloatType* pVector,
+                            const nanoflann::SearchParams& params,
+                            SearchStats& stats) const
+    {
+        if (_points.empty())
+        {
+            return;
+        }
+
+        if (!_KDTree.root_node)
+        {
+            throw std::runtime_error("[ofxSpatialHash] findNeighbors() called before building the index.");
+        }
+
+        typename KDTreeAdapter::distance_vector_t distances;
+        nanoflann::assign(distances, (VectorDimension > 0 ? VectorDimension : _KDTree.dim), static_cast<FloatType>(0));
+
+        const FloatType distanceSquared = _KDTree.computeInitialDistances(_KDTree, pVector, distances);
+
+        searchLevel(resultSet, pVector, _KDTree.root_node, distanceSquared, distances, 1 + params.eps, stats);
+    }
+
+    /// \brief Search a subtree, counting the traversal.
+    ///
+    /// This mirrors KDTreeAdapter::searchLevel().
+    ///
+    /// \returns false if the result set stopped the search.
+    template <typename ResultSetType>
+    bool searchLevel(ResultSetType& resultSet,
+                     const FloatType* pVector,
+                     const typename KDTreeAdapter::NodePtr node,
+                     FloatType minDistanceSquared,
+                     typename KDTreeAdapter::distance_vector_t& distances,
+                     float epsError,
+                     SearchStats& stats) const
+    {
+        ++stats.nodesVisited;
+
+        if (node->child1 == nullptr && node->child2 == nullptr)
+        {
+            ++stats.leavesVisited;
+
+            const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+
+            FloatType worstDistance = resultSet.worstDist();
+
+            for (IndexType i = node->node_type.lr.left; i < node->node_type.lr.right; ++i)
+            {
+                const IndexType index = _KDTree.vind[i];
+                const FloatType distance = kdtree_distance(pVector, index, dimension);
+
+                ++stats.distanceEvaluations;
+
+                if (distance < worstDistance)
+                {
+                    if (!resultSet.addPoint(distance, index))
+                    {
+                        return false;
+                    }
+
+                    worstDistance = resultSet.worstDist();
+                }
+            }
+
+            return true;
+        }
+
+        const int dimension = node->node_type.sub.divfeat;
+        const FloatType value = pVector[dimension];
+        const FloatType diffLow = value - node->node_type.sub.divlow;
+        const FloatType diffHigh = value - node->node_type.sub.divhigh;
+
+        typename KDTreeAdapter::NodePtr bestChild = node->child1;
+        typename KDTreeAdapter::NodePtr otherChild = node->child2;
+        FloatType cutDistance = _KDTree.distance.accum_dist(value, node->node_type.sub.divhigh, dimension);
+
+        if ((diffLow + diffHigh) >= 0)
+        {
+            std::swap(bestChild, otherChild);
+            cutDistance = _KDTree.distance.accum_dist(value, node->node_type.sub.divlow, dimension);
+        }
+
+        if (!searchLevel(resultSet, pVector, bestChild, minDistanceSquared, distances, epsError, stats))
+        {
+            return false;
+        }
+
+        const FloatType previousDistance = distances[dimension];
+        minDistanceSquared = minDistanceSquared + cutDistance - previousDistance;
+        distances[dimension] = cutDistance;
+
+        if (minDistanceSquared * epsError <= resultSet.worstDist())
+        {
+            if (!searchLevel(resultSet, pVector, otherChild, minDistanceSquared, distances, epsError, stats))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            ++stats.prunedSubtrees;
+        }
+
+        distances[dimension] = previousDistance;
+
+        return true;
+    }
+#endif
+
+    /// \brief A node of the density cache.
+    struct DensityNode
+    {
+        /// \brief The number of points in the node.
+        std::size_t count = 0;
+
+        /// \brief The index of the first node after this node's subtree.
+        std::size_t next = 0;
+
+        /// \brief The split dimension of a subdivided node.
+        int splitDimension = 0;
+
+        /// \brief The largest split coordinate of the first child.
+        FloatType splitLow = 0;
+
+        /// \brief The smallest split coordinate of the second child.
+        FloatType splitHigh = 0;
+    };
+
+    /// \brief Cache the point counts and bounds of the top of the tree.
+    ///
+    /// The nodes are stored in preorder down to nodes with at most
+    /// DENSITY_CACHE_MIN_COUNT points. Bounds are derived from the root
+    /// bounding box and the split planes, so no points are read.
+    void buildDensityCache()
+    {
+        _densityNodes.clear();
+        _densityBounds.clear();
+
+        // A linear scan has no tree to cache, and reading every point here
+        // would cost as much as a search.
+        if (_points.empty() || _isBruteForce)
+        {
+            return;
+        }
+
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+
+        std::vector<FloatType> low(dimension);
+        std::vector<FloatType> high(dimension);
+
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            low[d] = _KDTree.root_bbox[d].low;
+            high[d] = _KDTree.root_bbox[d].high;
+        }
+
+        cacheDensityNode(_KDTree.root_node, low, high);
+    }
+
+    /// \brief Cache a node and, if it is large enough, its children.
+    /// \param node The node to cache.
+    /// \param low The minimum corner of the node's bounds.
+    /// \param high The maximum corner of the node's bounds.
+    void cacheDensityNode(const typename KDTreeAdapter::NodePtr node,
+                          std::vector<FloatType>& low,
+                          std::vector<FloatType>& high)
+    {
+        // The points of a subtree are contiguous in vind, between its leftmost
+        // and rightmost leaves.
+        typename KDTreeAdapter::NodePtr first = node;
+        typename KDTreeAdapter::NodePtr last = node;
+
+        while (first->child1 != nullptr)
+        {
+            first = first->child1;
+        }
+
+        while (last->child2 != nullptr)
+        {
+            last = last->child2;
+        }
+
+        const std::size_t index = _densityNodes.size();
+
+        DensityNode densityNode;
+        densityNode.count = last->node_type.lr.right - first->node_type.lr.left;
+
+        _densityNodes.push_back(densityNode);
+        _densityBounds.insert(_densityBounds.end(), low.begin(), low.end());
+        _densityBounds.insert(_densityBounds.end(), high.begin(), high.end());
+
+        if (densityNode.count > DENSITY_CACHE_MIN_COUNT
+         && node->child1 != nullptr
+         && node->child2 != nullptr)
+        {
+            const int dimension = node->node_type.sub.divfeat;
+
+            _densityNodes[index].splitDimension = dimension;
+            _densityNodes[index].splitLow = node->node_type.sub.divlow;
+            _densityNodes[index].splitHigh = node->node_type.sub.divhigh;
+
+            const FloatType previousHigh = high[dimension];
+            high[dimension] = node->node_type.sub.divlow;
+            cacheDensityNode(node->child1, low, high);
+            high[dimension] = previousHigh;
+
+            const FloatType previousLow = low[dimension];
+            low[dimension] = node->node_type.sub.divhigh;
+            cacheDensityNode(node->child2, low, high);
+            low[dimension] = previousLow;
+        }
+
+        _densityNodes[index].next = _densityNodes.size();
+    }
+
+    /// \brief Find the smallest density cache node holding a whole sphere.
+    /// \param pVector A pointer to the 0th element of the sphere's center.
+    /// \param radius The sphere's radius.
+    /// \returns the index of the node in the density cache.
+    std::size_t findDensityNode(const FloatType* pVector, FloatType radius) const
+    {
+        std::size_t index = 0;
+
+        while (_densityNodes[index].next != index + 1)
+        {
+            const DensityNode& node = _densityNodes[index];
+            const FloatType value = pVector[node.splitDimension];
+
+            if (value + radius <= node.splitHigh)
+            {
+                index = index + 1;
+            }
+            else if (value - radius >= node.splitLow)
+            {
+                index = _densityNodes[index + 1].next;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        return index;
+    }
+
+    /// \brief Reserve radius search results for the expected count.
+    ///
+    /// The smallest node holding the whole search sphere bounds the result
+    /// count. Below it, a few levels of the density cache are walked to
+    /// estimate the points inside the sphere's bounding cube. Results are
+    /// reserved for that, but never more than the bound, unless they already
+    /// hold enough or the estimate is small enough to grow cheaply.
+    ///
+    /// \param results The results to reserve.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param radius The radius to search within.
+    void reserveRadiusResults(SearchResults& results,
+                              const FloatType* pVector,
+                              FloatType radius) const
+    {
+        if (_densityNodes.empty() || radius < 0)
+        {
+            return;
+        }
+
+        const std::size_t index = findDensityNode(pVector, radius);
+        const std::size_t count = _densityNodes[index].count;
+
+        // Growing small results is cheaper than reserving for them.
+        if (count <= results.capacity() || count <= DENSITY_CACHE_MIN_COUNT)
+        {
+            return;
+        }
+
+        // Count the sphere's bounding cube, which leaves room for error.
+        double expected = 0;
+
+        countDensityNode(index, pVector, radius, 1, DENSITY_RESERVE_DEPTH, expected);
+
+        if (expected < DENSITY_RESERVE_MIN)
+        {
+            return;
+        }
+
+        results.reserve(std::min(count, static_cast<std::size_t>(std::ceil(expected))));
+    }
+
+    /// \brief Add the estimated points of a density cache subtree within a
+    ///        radius.
+    /// \param index The index of the subtree's root in the density cache.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param radius The radius to search within.
+    /// \param sphereFraction The fraction of a cube filled by its sphere, or
+    ///        1 to estimate the points in the sphere's bounding cube.
+    /// \param depth The number of levels to descend below the node.
+    /// \param count The count to add to.
+    void countDensityNode(std::size_t index,
+                          const FloatType* pVector,
+                          FloatType radius,
+                          double sphereFraction,
+                          std::size_t depth,
+                          double& count) const
+    {
+        const std::size_t dimension = (VectorDimension > 0 ? VectorDimension : _KDTree.dim);
+        const FloatType radiusSquared = radius * radius;
+
+        const DensityNode& node = _densityNodes[index];
+        const FloatType* low = &_densityBounds[index * dimension * 2];
+        const FloatType* high = low + dimension;
+
+        FloatType nearSquared = 0;
+        FloatType farSquared = 0;
+
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            const FloatType toLow = pVector[d] - low[d];
+            const FloatType toHigh = high[d] - pVector[d];
+            const FloatType near = std::max(FloatType(0), std::max(-toLow, -toHigh));
+            const FloatType far = std::max(toLow, toHigh);
+
+            nearSquared += near * near;
+            farSquared += far * far;
+        }
+
+        if (nearSquared > radiusSquared)
+        {
+            return;
+        }
+
+        const bool inside = (farSquared <= radiusSquared);
+        const bool terminal = (node.next == index + 1 || depth == 0);
+
+        if (inside)
+        {
+            count += node.count;
+        }
+        else if (terminal)
+        {
+            // Scale by the part of the node inside the sphere's bounding
+            // cube, then by the part of that cube inside the sphere.
+            double fraction = 1;
+
+            for (std::size_t d = 0; d < dimension; ++d)
+            {
+                const FloatType extent = high[d] - low[d];
+
+                if (extent > 0)
+                {
+                    const FloatType overlap = std::min(high[d], pVector[d] + radius)
+                                            - std::max(low[d], pVector[d] - radius);
+                    fraction *= double(overlap) / extent;
+                }
+            }
+
+            count += node.count * fraction * sphereFraction;
+        }
+        else
+        {
+            countDensityNode(index + 1, pVector, radius, sphereFraction, depth - 1, count);
+            countDensityNode(_densityNodes[index + 1].next, pVector, radius, sphereFraction, depth - 1, count);
+        }
+    }
+
     /// \brief Const reference to the points.
     const std::vector<VectorType>& _points;
 
     /// \brief The KDTree structure.
     KDTreeAdapter _KDTree;
 
+    /// \brief The requested search backend.
+    SearchBackend _searchBackend = SEARCH_BACKEND_AUTO;
+
+    /// \brief The point count below which SEARCH_BACKEND_AUTO scans.
+    std::size_t _bruteForceThreshold = DEFAULT_BRUTE_FORCE_THRESHOLD;
+
+    /// \brief True iff the last buildIndex() selected a linear scan.
+    bool _isBruteForce = false;
+
+    /// \brief The density cache nodes in preorder.
+    std::vector<DensityNode> _densityNodes;
+
+    /// \brief The minimum and maximum corners of each density cache node.
+    std::vector<FloatType> _densityBounds;
+
 };
 
 
@@ -0,0 +1,675 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include "ofx/Box.h"
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+
+
+namespace ofx {
+
+
+/// \brief A linear bounding volume hierarchy built from Morton codes.
+///
+/// The LinearBVH sorts points along a Morton (Z-order) curve with a parallel
+/// radix sort, groups consecutive points into leaves and emits the hierarchy
+/// over the leaves in O(n) with every internal node computed independently
+/// (Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and
+/// k-d Trees", 2012). Bounding boxes are then fitted bottom-up in parallel.
+///
+/// Every build stage is parallel, so per-frame rebuilds of millions of points
+/// scale with the number of cores, at the cost of somewhat looser nodes than
+/// the KDTree's median splits.
+///
+/// \tparam VectorType The internal VectorType used by this LinearBVH.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class LinearBVH
+{
+public:
+    static_assert(VectorDimension > 0, "The LinearBVH requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create a LinearBVH with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() method, otherwise search results will be
+    /// invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param maxLeafSize The number of consecutive Morton ordered points per leaf.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    LinearBVH(const Points& points,
+              std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE,
+              bool autoBuildIndex = true):
+        _points(points),
+        _maxLeafSize(std::max(static_cast<std::size_t>(1), maxLeafSize))
+    {
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the LinearBVH.
+    virtual ~LinearBVH()
+    {
+    }
+
+    /// \brief Rebuild the hierarchy.
+    void buildIndex()
+    {
+        const std::size_t numPoints = _points.size();
+
+        _nodes.clear();
+        _sortedIndices.clear();
+        _sortedPoints.clear();
+
+        if (numPoints == 0)
+        {
+            return;
+        }
+
+        const std::size_t numChunks = ParallelChunkCount(numPoints, MIN_POINTS_PER_THREAD);
+
+        // Compute the bounding box.
+        std::vector<Box> chunkBounds(numChunks);
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t chunk)
+        {
+            Box& bounds = chunkBounds[chunk];
+            bounds.reset();
+
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                bounds.grow(VectorDataPointer<VectorType, FloatType>(_points[i]));
+            }
+        });
+
+        Box bounds;
+        bounds.reset();
+
+        for (const Box& chunk: chunkBounds)
+        {
+            bounds.grow(chunk);
+        }
+
+        // Compute the Morton codes.
+        std::array<FloatType, VectorDimension> scale;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType extent = bounds.high[j] - bounds.low[j];
+            scale[j] = extent > 0 ? static_cast<FloatType>(MAX_QUANTIZED) / extent : 0;
+        }
+
+        std::vector<std::pair<std::uint64_t, IndexType>> codes(numPoints);
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[i]);
+
+                std::uint64_t code = 0;
+
+                for (std::size_t j = 0; j < MORTON_DIMENSIONS; ++j)
+                {
+                    const std::uint64_t quantized = static_cast<std::uint64_t>((pPoint[j] - bounds.low[j]) * scale[j]);
+                    code |= spreadBits(std::min(quantized, static_cast<std::uint64_t>(MAX_QUANTIZED))) << j;
+                }
+
+                codes[i] = std::make_pair(code, static_cast<IndexType>(i));
+            }
+        });
+
+        radixSort(codes, numChunks);
+
+        // Gather the points in Morton order for cache friendly leaf scans.
+        _sortedIndices.resize(numPoints);
+        _sortedPoints.resize(numPoints * VectorDimension);
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const IndexType index = codes[i].second;
+                const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[index]);
+
+                _sortedIndices[i] = index;
+                std::copy(pPoint, pPoint + VectorDimension, &_sortedPoints[i * VectorDimension]);
+            }
+        });
+
+        // Emit the hierarchy. Internal nodes come first, then the leaves.
+        const std::size_t numLeaves = (numPoints + _maxLeafSize - 1) / _maxLeafSize;
+        const std::size_t numInternal = numLeaves - 1;
+
+        _numInternalNodes = numInternal;
+        _nodes.resize(numInternal + numLeaves);
+
+        std::vector<std::uint64_t> leafCodes(numLeaves);
+
+        for (std::size_t i = 0; i < numLeaves; ++i)
+        {
+            leafCodes[i] = codes[i * _maxLeafSize].first;
+        }
+
+        codes = std::vector<std::pair<std::uint64_t, IndexType>>();
+
+        _nodes[rootIndex()].parent = INVALID_NODE;
+
+        ParallelFor(numInternal, ParallelChunkCount(numInternal, MIN_POINTS_PER_THREAD), [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                emitInternalNode(leafCodes, static_cast<std::int64_t>(i));
+            }
+        });
+
+        // Fit the bounding boxes from the leaves up. The second child to
+        // finish a parent fits it, so each node is fitted exactly once.
+        std::unique_ptr<std::atomic<std::uint32_t>[]> visits(new std::atomic<std::uint32_t>[numInternal + 1]);
+
+        for (std::size_t i = 0; i < numInternal; ++i)
+        {
+            visits[i].store(0, std::memory_order_relaxed);
+        }
+
+        ParallelFor(numLeaves, ParallelChunkCount(numLeaves, MIN_POINTS_PER_THREAD / _maxLeafSize + 1), [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t leaf = begin; leaf < end; ++leaf)
+            {
+                const std::size_t nodeIndex = numInternal + leaf;
+                Node& node = _nodes[nodeIndex];
+
+                node.first = static_cast<IndexType>(leaf * _maxLeafSize);
+                node.last = static_cast<IndexType>(std::min((leaf + 1) * _maxLeafSize, numPoints));
+                node.bounds.reset();
+
+                for (IndexType i = node.first; i < node.last; ++i)
+                {
+                    node.bounds.grow(&_sortedPoints[i * VectorDimension]);
+                }
+
+                std::uint32_t parent = node.parent;
+
+                while (parent != INVALID_NODE)
+                {
+                    if (visits[parent].fetch_add(1, std::memory_order_acq_rel) == 0)
+                    {
+                        break;
+                    }
+
+                    Node& current = _nodes[parent];
+                    current.bounds = _nodes[current.children[0]].bounds;
+                    current.bounds.grow(_nodes[current.children[1]].bounds);
+                    parent = current.parent;
+                }
+            }
+        });
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        search(VectorDataPointer<VectorType, FloatType>(point), resultSet);
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        search(VectorDataPointer<VectorType, FloatType>(point), resultSet);
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \returns the number of nodes in the hierarchy.
+    std::size_t getNumNodes() const
+    {
+        return _nodes.size();
+    }
+
+    enum
+    {
+        /// \brief The default number of points per leaf.
+        DEFAULT_MAX_LEAF_SIZE = 8,
+
+        /// \brief The minimum number of points processed per thread.
+        MIN_POINTS_PER_THREAD = 16384,
+
+        /// \brief The number of leading dimensions ordered by the Morton code.
+        ///
+        /// Later dimensions don't affect the order of the points, but are
+        /// still bounded by the hierarchy.
+        MORTON_DIMENSIONS = (VectorDimension < 64) ? VectorDimension : 64,
+
+        /// \brief The number of Morton code bits per dimension.
+        BITS_PER_DIMENSION = (64 / MORTON_DIMENSIONS > 21) ? 21 : 64 / MORTON_DIMENSIONS,
+
+        /// \brief The number of bits sorted per radix sort pass.
+        RADIX_BITS = 8
+    };
+
+protected:
+    /// \brief The largest quantized coordinate.
+    static constexpr std::uint64_t MAX_QUANTIZED = (std::uint64_t(1) << BITS_PER_DIMENSION) - 1;
+
+    /// \brief The invalid node sentinel.
+    static constexpr std::uint32_t INVALID_NODE = std::numeric_limits<std::uint32_t>::max();
+
+    /// \brief An axis aligned bounding box.
+    typedef ofx::Box<FloatType, VectorDimension> Box;
+
+    /// \brief A hierarchy node.
+    struct Node
+    {
+        /// \brief The node bounds.
+        Box bounds;
+
+        /// \brief The child node indices of an internal node.
+        std::array<std::uint32_t, 2> children;
+
+        /// \brief The parent node index, or INVALID_NODE for the root.
+        std::uint32_t parent = INVALID_NODE;
+
+        /// \brief The first sorted point of a leaf.
+        IndexType first = 0;
+
+        /// \brief One past the last sorted point of a leaf.
+        IndexType last = 0;
+    };
+
+    /// \returns the index of the root node.
+    std::size_t rootIndex() const
+    {
+        // A single leaf is its own root.
+        return 0;
+    }
+
+    /// \returns true iff the node is a leaf.
+    bool isLeaf(std::size_t node) const
+    {
+        return node >= _numInternalNodes;
+    }
+
+    /// \brief Spread the bits of a quantized coordinate MORTON_DIMENSIONS apart.
+    static std::uint64_t spreadBits(std::uint64_t value)
+    {
+        std::uint64_t result = 0;
+
+        for (std::size_t bit = 0; bit < BITS_PER_DIMENSION; ++bit)
+        {
+            result |= ((value >> bit) & 1) << (bit * MORTON_DIMENSIONS);
+        }
+
+        return result;
+    }
+
+    /// \returns the number of leading zero bits.
+    static int countLeadingZeros(std::uint64_t value)
+    {
+        if (value == 0)
+        {
+            return 64;
+        }
+
+        int count = 0;
+
+        while ((value & (std::uint64_t(1) << 63)) == 0)
+        {
+            value <<= 1;
+            ++count;
+        }
+
+        return count;
+    }
+
+    /// \brief The length of the common prefix of two leaf keys.
+    ///
+    /// Duplicate codes are disambiguated by their leaf index.
+    ///
+    /// \returns the common prefix length, or -1 if j is out of range.
+    static int commonPrefix(const std::vector<std::uint64_t>& codes,
+                            std::int64_t i,
+                            std::int64_t j)
+    {
+        if (j < 0 || j >= static_cast<std::int64_t>(codes.size()))
+        {
+            return -1;
+        }
+
+        if (codes[i] == codes[j])
+        {
+            return 64 + countLeadingZeros(static_cast<std::uint64_t>(i ^ j));
+        }
+
+        return countLeadingZeros(codes[i] ^ codes[j]);
+    }
+
+    /// \brief Determine the range and split of one internal node.
+    void emitInternalNode(const std::vector<std::uint64_t>& codes, std::int64_t i)
+    {
+        // Determine the direction of the range.
+        const int direction = (commonPrefix(codes, i, i + 1) - commonPrefix(codes, i, i - 1)) >= 0 ? 1 : -1;
+
+        // Compute an upper bound for the length of the range.
+        const int minPrefix = commonPrefix(codes, i, i - direction);
+
+        std::int64_t maxLength = 2;
+
+        while (commonPrefix(codes, i, i + maxLength * direction) > minPrefix)
+        {
+            maxLength *= 2;
+        }
+
+        // Find the other end with a binary search.
+        std::int64_t length = 0;
+
+        for (std::int64_t step = maxLength / 2; step >= 1; step /= 2)
+        {
+            if (commonPrefix(codes, i, i + (length + step) * direction) > minPrefix)
+            {
+                length += step;
+            }
+        }
+
+        const std::int64_t j = i + length * direction;
+
+        // Find the split position with a binary search.
+        const int nodePrefix = commonPrefix(codes, i, j);
+
+        std::int64_t split = 0;
+        std::int64_t step = length;
+
+        do
+        {
+            step = (step + 1) / 2;
+
+            if (commonPrefix(codes, i, i + (split + step) * direction) > nodePrefix)
+            {
+                split += step;
+            }
+        }
+        while (step > 1);
+
+        const std::int64_t gamma = i + split * direction + std::min(direction, 0);
+
+        const std::size_t numInternal = _numInternalNodes;
+
+        const std::uint32_t left = static_cast<std::uint32_t>(std::min(i, j) == gamma ? numInternal + gamma : gamma);
+        const std::uint32_t right = static_cast<std::uint32_t>(std::max(i, j) == gamma + 1 ? numInternal + gamma + 1 : gamma + 1);
+
+        _nodes[i].children[0] = left;
+        _nodes[i].children[1] = right;
+        _nodes[left].parent = static_cast<std::uint32_t>(i);
+        _nodes[right].parent = static_cast<std::uint32_t>(i);
+    }
+
+    /// \brief Sort Morton codes with a parallel least significant digit radix sort.
+    void radixSort(std::vector<std::pair<std::uint64_t, IndexType>>& codes,
+                   std::size_t numChunks) const
+    {
+        const std::size_t numPoints = codes.size();
+        const std::size_t numBuckets = std::size_t(1) << RADIX_BITS;
+        const std::size_t numBits = BITS_PER_DIMENSION * MORTON_DIMENSIONS;
+
+        std::vector<std::pair<std::uint64_t, IndexType>> buffer(numPoints);
+        std::vector<std::size_t> histograms(numChunks * numBuckets);
+
+        for (std::size_t shift = 0; shift < numBits; shift += RADIX_BITS)
+        {
+            std::fill(histograms.begin(), histograms.end(), 0);
+
+            ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t chunk)
+            {
+                std::size_t* histogram = &histograms[chunk * numBuckets];
+
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    ++histogram[(codes[i].first >> shift) & (numBuckets - 1)];
+                }
+            });
+
+            // Skip passes where every code has the same digit.
+            bool isUniform = false;
+
+            for (std::size_t bucket = 0; bucket < numBuckets; ++bucket)
+            {
+                std::size_t count = 0;
+
+                for (std::size_t chunk = 0; chunk < numChunks; ++chunk)
+                {
+                    count += histograms[chunk * numBuckets + bucket];
+                }
+
+                if (count == numPoints)
+                {
+                    isUniform = true;
+                }
+            }
+
+            if (isUniform)
+            {
+                continue;
+            }
+
+            // Turn the histograms into stable per-chunk output offsets.
+            std::size_t offset = 0;
+
+            for (std::size_t bucket = 0; bucket < numBuckets; ++bucket)
+            {
+                for (std::size_t chunk = 0; chunk < numChunks; ++chunk)
+                {
+                    const std::size_t count = histograms[chunk * numBuckets + bucket];
+                    histograms[chunk * numBuckets + bucket] = offset;
+                    offset += count;
+                }
+            }
+
+            ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t chunk)
+            {
+                std::size_t* offsets = &histograms[chunk * numBuckets];
+
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    buffer[offsets[(codes[i].first >> shift) & (numBuckets - 1)]++] = codes[i];
+                }
+            });
+
+            codes.swap(buffer);
+        }
+    }
+
+    /// \brief Search the hierarchy, nearest child first.
+    template <typename ResultSetType>
+    void search(const FloatType* pVector, ResultSetType& resultSet) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<std::pair<std::uint32_t, FloatType>> stack;
+        stack.reserve(64);
+
+        stack.push_back(std::make_pair(static_cast<std::uint32_t>(rootIndex()),
+                                       _nodes[rootIndex()].bounds.distanceSquared(pVector)));
+
+        while (!stack.empty())
+        {
+            const std::uint32_t nodeIndex = stack.back().first;
+            const FloatType nodeDistance = stack.back().second;
+            stack.pop_back();
+
+            if (nodeDistance >= resultSet.worstDist())
+            {
+                continue;
+            }
+
+            const Node& node = _nodes[nodeIndex];
+
+            if (isLeaf(nodeIndex))
+            {
+                for (IndexType i = node.first; i < node.last; ++i)
+                {
+                    const FloatType* pPoint = &_sortedPoints[i * VectorDimension];
+
+                    FloatType total = 0;
+
+                    for (std::size_t j = 0; j < VectorDimension; ++j)
+                    {
+                        const FloatType distance = pVector[j] - pPoint[j];
+                        total += (distance * distance);
+                    }
+
+                    if (total < resultSet.worstDist())
+                    {
+                        resultSet.addPoint(total, _sortedIndices[i]);
+                    }
+                }
+            }
+            else
+            {
+                const FloatType distance0 = _nodes[node.children[0]].bounds.distanceSquared(pVector);
+                const FloatType distance1 = _nodes[node.children[1]].bounds.distanceSquared(pVector);
+
+                // Push the farther child first so the nearer one is visited next.
+                if (distance0 < distance1)
+                {
+                    stack.push_back(std::make_pair(node.children[1], distance1));
+                    stack.push_back(std::make_pair(node.children[0], distance0));
+                }
+                else
+                {
+                    stack.push_back(std::make_pair(node.children[0], distance0));
+                    stack.push_back(std::make_pair(node.children[1], distance1));
+                }
+            }
+        }
+    }
+
+    /// \brief Const reference to the points.
+    const std::vector<VectorType>& _points;
+
+    /// \brief The number of Morton ordered points per leaf.
+    std::size_t _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The number of internal nodes.
+    std::size_t _numInternalNodes = 0;
+
+    /// \brief The internal nodes followed by the leaves.
+    std::vector<Node> _nodes;
+
+    /// \brief The point indices in Morton order.
+    Indicies _sortedIndices;
+
+    /// \brief The point coordinates in Morton order.
+    std::vector<FloatType> _sortedPoints;
+
+};
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::uint64_t LinearBVH<VectorType, VectorDimension, FloatType, IndexType>::MAX_QUANTIZED;
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr std::uint32_t LinearBVH<VectorType, VectorDimension, FloatType, IndexType>::INVALID_NODE;
+
+
+} // namespace ofx
@@ -0,0 +1,305 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+namespace ofx {
+
+
+/// \brief A read-only memory mapped file.
+///
+/// Pages are read from disk when first touched and may be dropped by the
+/// operating system under memory pressure, so files larger than memory can be
+/// mapped in full.
+class MappedFile
+{
+public:
+    /// \brief Create an unopened MappedFile.
+    MappedFile()
+    {
+    }
+
+    /// \brief Create a MappedFile and open a file.
+    /// \param path The file path.
+    explicit MappedFile(const std::string& path)
+    {
+        open(path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    /// \brief Unmap the file.
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /// \brief Map a file, closing any file mapped before.
+    /// \param path The file path.
+    /// \returns true iff the file was mapped. Empty files are open with a
+    ///          null data() pointer.
+    bool open(const std::string& path)
+    {
+        close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(),
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        if (size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            if (mapping == nullptr)
+            {
+                CloseHandle(file);
+                return false;
+            }
+
+            void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+            // The view keeps the mapping and file alive.
+            CloseHandle(mapping);
+
+            if (data == nullptr)
+            {
+                CloseHandle(file);
+                return false;
+            }
+
+            _data = static_cast<const char*>(data);
+        }
+
+        CloseHandle(file);
+
+        _size = static_cast<std::size_t>(size.QuadPart);
+#else
+        const int file = ::open(path.c_str(), O_RDONLY);
+
+        if (file < 0)
+        {
+            return false;
+        }
+
+        struct stat status;
+
+        if (::fstat(file, &status) != 0)
+        {
+            ::close(file);
+            return false;
+        }
+
+        if (status.st_size > 0)
+        {
+            void* data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+
+            if (data == MAP_FAILED)
+            {
+                ::close(file);
+                return false;
+            }
+
+            _data = static_cast<const char*>(data);
+        }
+
+        // The mapping keeps the file alive.
+        ::close(file);
+
+        _size = static_cast<std::size_t>(status.st_size);
+#endif
+
+        _isOpen = true;
+        return true;
+    }
+
+    /// \brief Unmap the file.
+    void close()
+    {
+        if (_data != nullptr)
+        {
+#if defined(_WIN32)
+            UnmapViewOfFile(_data);
+#else
+            ::munmap(const_cast<char*>(_data), _size);
+#endif
+        }
+
+        _data = nullptr;
+        _size = 0;
+        _isOpen = false;
+    }
+
+    /// \returns true iff a file is mapped.
+    bool isOpen() const
+    {
+        return _isOpen;
+    }
+
+    /// \returns a pointer to the first byte of the file.
+    const char* data() const
+    {
+        return _data;
+    }
+
+    /// \returns the size of the file in bytes.
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    /// \brief Hint that the file will be read front to back.
+    ///
+    /// The operating system may read ahead aggressively. This is a no-op on
+    /// platforms without madvise().
+    void adviseSequential() const
+    {
+        advise(0, _size, true);
+    }
+
+    /// \brief Hint that the file will be read in random order.
+    ///
+    /// The operating system should read only the touched pages instead of
+    /// reading ahead. This is a no-op on platforms without madvise().
+    void adviseRandom() const
+    {
+        advise(0, _size, false);
+    }
+
+    /// \brief Start reading a byte range from disk in the background.
+    ///
+    /// Call this for the next block of a file while processing the current
+    /// one, so reading overlaps processing. This is a no-op on platforms
+    /// without madvise().
+    ///
+    /// \param offset The first byte of the range.
+    /// \param length The number of bytes in the range.
+    void willNeed(std::size_t offset, std::size_t length) const
+    {
+#if defined(_WIN32)
+        (void)offset;
+        (void)length;
+#else
+        if (_data == nullptr || offset >= _size)
+        {
+            return;
+        }
+
+        const std::size_t page = pageSize();
+        const std::size_t begin = offset / page * page;
+        const std::size_t end = std::min(_size, offset + length);
+
+        ::madvise(const_cast<char*>(_data) + begin, end - begin, MADV_WILLNEED);
+#endif
+    }
+
+    /// \brief Drop the pages of a byte range from this process's working set.
+    ///
+    /// The data stays valid and is read again from disk when touched. This
+    /// keeps resident memory bounded while streaming through a large file.
+    ///
+    /// \param offset The first byte of the range.
+    /// \param length The number of bytes in the range.
+    void release(std::size_t offset, std::size_t length) const
+    {
+        if (_data == nullptr || offset >= _size)
+        {
+            return;
+        }
+
+        const std::size_t page = pageSize();
+        const std::size_t begin = offset / page * page;
+        const std::size_t end = std::min(_size, offset + length);
+
+#if defined(_WIN32)
+        VirtualUnlock(const_cast<char*>(_data) + begin, end - begin);
+#else
+        ::madvise(const_cast<char*>(_data) + begin, end - begin, MADV_DONTNEED);
+#endif
+    }
+
+    /// \returns the virtual memory page size in bytes.
+    static std::size_t pageSize()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<std::size_t>(info.dwPageSize);
+#else
+        const long size = ::sysconf(_SC_PAGESIZE);
+        return size > 0 ? static_cast<std::size_t>(size) : 4096;
+#endif
+    }
+
+protected:
+    /// \brief Apply an access pattern hint to a byte range.
+    void advise(std::size_t offset, std::size_t length, bool sequential) const
+    {
+#if defined(_WIN32)
+        (void)offset;
+        (void)length;
+        (void)sequential;
+#else
+        if (_data != nullptr && length > 0)
+        {
+            ::madvise(const_cast<char*>(_data) + offset, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+#endif
+    }
+
+    /// \brief The mapped data, or nullptr for an empty or unopened file.
+    const char* _data = nullptr;
+
+    /// \brief The size of the file in bytes.
+    std::size_t _size = 0;
+
+    /// \brief True iff a file is mapped.
+    bool _isOpen = false;
+
+};
+
+
+} // namespace ofx
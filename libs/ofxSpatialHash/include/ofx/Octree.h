@@ -0,0 +1,513 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "ofx/KDTree.h"
+
+
+namespace ofx {
+
+
+/// \brief A pointer-free octree with an adaptive bucket size.
+///
+/// The Octree recursively splits cubic cells into 2^VectorDimension children
+/// until a cell holds at most maxBucketSize points or maxDepth is reached, so
+/// dense regions are refined while sparse regions stay shallow. The nodes are
+/// stored in a flat array in breadth-first order. Each node records a child
+/// mask and the index of its first child, and the children of a node are
+/// stored contiguously in mask order. Every node also owns a contiguous range
+/// of a reordered index array, so the points of any cell can be enumerated
+/// directly, e.g. for LOD or visibility.
+///
+/// A 2D VectorType produces a quadtree.
+///
+/// \tparam VectorType The internal VectorType used by this Octree.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class Octree
+{
+public:
+    static_assert(VectorDimension > 0 && VectorDimension <= 3, "The Octree supports 1, 2 and 3 dimensions.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief An octree node.
+    struct Node
+    {
+        /// \brief The center of the node's cube.
+        std::array<FloatType, VectorDimension> center;
+
+        /// \brief Half of the node's edge length.
+        FloatType halfSize = 0;
+
+        /// \brief The index of the first child, valid if childMask != 0.
+        std::uint32_t firstChild = 0;
+
+        /// \brief A bit per child octant, set if the child exists.
+        std::uint8_t childMask = 0;
+
+        /// \brief The depth of the node, 0 for the root.
+        std::uint8_t depth = 0;
+
+        /// \brief The first slot of the node's points in getIndices().
+        IndexType first = 0;
+
+        /// \brief One past the last slot of the node's points in getIndices().
+        IndexType last = 0;
+
+        /// \returns true iff the node has no children.
+        bool isLeaf() const
+        {
+            return childMask == 0;
+        }
+    };
+
+    /// \brief Create an Octree with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() method, otherwise search results will be
+    /// invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param maxBucketSize The maximum number of points in a leaf.
+    /// \param maxDepth The maximum depth, at which leaves may exceed maxBucketSize.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    Octree(const Points& points,
+           std::size_t maxBucketSize = DEFAULT_MAX_BUCKET_SIZE,
+           std::size_t maxDepth = DEFAULT_MAX_DEPTH,
+           bool autoBuildIndex = true):
+        _points(points),
+        _maxBucketSize(std::max(static_cast<std::size_t>(1), maxBucketSize)),
+        _maxDepth(std::min(maxDepth, static_cast<std::size_t>(MAX_DEPTH)))
+    {
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the Octree.
+    virtual ~Octree()
+    {
+    }
+
+    /// \brief Rebuild the octree.
+    void buildIndex()
+    {
+        _nodes.clear();
+        _indices.resize(_points.size());
+
+        for (std::size_t i = 0; i < _indices.size(); ++i)
+        {
+            _indices[i] = static_cast<IndexType>(i);
+        }
+
+        if (_points.empty())
+        {
+            return;
+        }
+
+        // The root is the cube around the bounding box.
+        std::array<FloatType, VectorDimension> low;
+        std::array<FloatType, VectorDimension> high;
+
+        low.fill(std::numeric_limits<FloatType>::max());
+        high.fill(std::numeric_limits<FloatType>::lowest());
+
+        for (const auto& point: _points)
+        {
+            const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(point);
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                low[j] = std::min(low[j], pPoint[j]);
+                high[j] = std::max(high[j], pPoint[j]);
+            }
+        }
+
+        Node root;
+        root.first = 0;
+        root.last = static_cast<IndexType>(_points.size());
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            root.center[j] = (low[j] + high[j]) / 2;
+            root.halfSize = std::max(root.halfSize, (high[j] - low[j]) / 2);
+        }
+
+        _nodes.push_back(root);
+
+        // Split nodes breadth-first so siblings are contiguous.
+        std::array<IndexType, NUM_CHILDREN + 1> starts;
+
+        for (std::size_t nodeIndex = 0; nodeIndex < _nodes.size(); ++nodeIndex)
+        {
+            const Node node = _nodes[nodeIndex];
+
+            if (node.last - node.first <= _maxBucketSize
+             || node.depth >= _maxDepth
+             || node.halfSize <= 0)
+            {
+                continue;
+            }
+
+            partition(node, starts);
+
+            std::uint8_t childMask = 0;
+
+            _nodes[nodeIndex].firstChild = static_cast<std::uint32_t>(_nodes.size());
+
+            for (std::size_t octant = 0; octant < NUM_CHILDREN; ++octant)
+            {
+                if (starts[octant] == starts[octant + 1])
+                {
+                    continue;
+                }
+
+                Node child;
+                child.halfSize = node.halfSize / 2;
+                child.depth = node.depth + 1;
+                child.first = starts[octant];
+                child.last = starts[octant + 1];
+
+                for (std::size_t j = 0; j < VectorDimension; ++j)
+                {
+                    child.center[j] = node.center[j] + ((octant >> j) & 1 ? child.halfSize : -child.halfSize);
+                }
+
+                childMask |= static_cast<std::uint8_t>(1 << octant);
+                _nodes.push_back(child);
+            }
+
+            _nodes[nodeIndex].childMask = childMask;
+        }
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        search(VectorDataPointer<VectorType, FloatType>(point), resultSet);
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        search(VectorDataPointer<VectorType, FloatType>(point), resultSet);
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \returns the nodes in breadth-first order, the root first.
+    const std::vector<Node>& getNodes() const
+    {
+        return _nodes;
+    }
+
+    /// \brief Get the reordered point indices.
+    ///
+    /// The points of a node are getIndices()[node.first, node.last).
+    ///
+    /// \returns the reordered point indices.
+    const Indicies& getIndices() const
+    {
+        return _indices;
+    }
+
+    /// \brief Get the index of a child node.
+    /// \param node The parent node.
+    /// \param octant The child octant, which must be set in the child mask.
+    /// \returns the index of the child in getNodes().
+    std::size_t getChild(const Node& node, std::size_t octant) const
+    {
+        const std::uint32_t lowerBits = node.childMask & ((1u << octant) - 1);
+        return node.firstChild + countBits(lowerBits);
+    }
+
+    enum
+    {
+        /// \brief The number of children of a node.
+        NUM_CHILDREN = 1 << VectorDimension,
+
+        /// \brief The default maximum number of points in a leaf.
+        DEFAULT_MAX_BUCKET_SIZE = 16,
+
+        /// \brief The default maximum depth.
+        DEFAULT_MAX_DEPTH = 20,
+
+        /// \brief The largest supported maximum depth.
+        MAX_DEPTH = 255
+    };
+
+protected:
+    /// \returns the number of set bits.
+    static std::size_t countBits(std::uint32_t value)
+    {
+        std::size_t count = 0;
+
+        while (value != 0)
+        {
+            value &= value - 1;
+            ++count;
+        }
+
+        return count;
+    }
+
+    /// \returns the octant of a point relative to a node center.
+    std::size_t octant(const Node& node, IndexType index) const
+    {
+        const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[index]);
+
+        std::size_t result = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            if (pPoint[j] >= node.center[j])
+            {
+                result |= (std::size_t(1) << j);
+            }
+        }
+
+        return result;
+    }
+
+    /// \brief Counting sort a node's index range by octant.
+    /// \param node The node to partition.
+    /// \param starts Filled with the first slot of each octant, plus the end.
+    void partition(const Node& node, std::array<IndexType, NUM_CHILDREN + 1>& starts)
+    {
+        std::array<IndexType, NUM_CHILDREN> counts;
+        counts.fill(0);
+
+        _octants.resize(node.last - node.first);
+
+        for (IndexType i = node.first; i < node.last; ++i)
+        {
+            const std::uint8_t value = static_cast<std::uint8_t>(octant(node, _indices[i]));
+            _octants[i - node.first] = value;
+            ++counts[value];
+        }
+
+        starts[0] = node.first;
+
+        for (std::size_t i = 0; i < NUM_CHILDREN; ++i)
+        {
+            starts[i + 1] = starts[i] + counts[i];
+        }
+
+        std::array<IndexType, NUM_CHILDREN> cursors;
+        std::copy(starts.begin(), starts.end() - 1, cursors.begin());
+
+        _scratch.resize(node.last - node.first);
+
+        for (IndexType i = node.first; i < node.last; ++i)
+        {
+            _scratch[cursors[_octants[i - node.first]]++ - node.first] = _indices[i];
+        }
+
+        std::copy(_scratch.begin(), _scratch.end(), _indices.begin() + node.first);
+    }
+
+    /// \returns the squared distance from a point to a node's cube.
+    static FloatType distanceSquared(const Node& node, const FloatType* pVector)
+    {
+        FloatType total = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType distance = std::max(FloatType(0), std::abs(pVector[j] - node.center[j]) - node.halfSize);
+            total += distance * distance;
+        }
+
+        return total;
+    }
+
+    /// \brief Search the octree, nearest children first.
+    template <typename ResultSetType>
+    void search(const FloatType* pVector, ResultSetType& resultSet) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<std::pair<std::uint32_t, FloatType>> stack;
+        stack.reserve(64);
+        stack.push_back(std::make_pair(0u, distanceSquared(_nodes[0], pVector)));
+
+        std::array<std::pair<std::uint32_t, FloatType>, NUM_CHILDREN> children;
+
+        while (!stack.empty())
+        {
+            const std::uint32_t nodeIndex = stack.back().first;
+            const FloatType nodeDistance = stack.back().second;
+            stack.pop_back();
+
+            if (nodeDistance >= resultSet.worstDist())
+            {
+                continue;
+            }
+
+            const Node& node = _nodes[nodeIndex];
+
+            if (node.isLeaf())
+            {
+                for (IndexType i = node.first; i < node.last; ++i)
+                {
+                    const IndexType index = _indices[i];
+                    const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[index]);
+
+                    FloatType total = 0;
+
+                    for (std::size_t j = 0; j < VectorDimension; ++j)
+                    {
+                        const FloatType distance = pVector[j] - pPoint[j];
+                        total += (distance * distance);
+                    }
+
+                    if (total < resultSet.worstDist())
+                    {
+                        resultSet.addPoint(total, index);
+                    }
+                }
+
+                continue;
+            }
+
+            std::size_t numChildren = 0;
+
+            for (std::uint32_t child = node.firstChild,
+                 end = node.firstChild + static_cast<std::uint32_t>(countBits(node.childMask));
+                 child < end;
+                 ++child)
+            {
+                children[numChildren++] = std::make_pair(child, distanceSquared(_nodes[child], pVector));
+            }
+
+            // Push the farthest first so the nearest child is visited next.
+            std::sort(children.begin(), children.begin() + numChildren, [](const std::pair<std::uint32_t, FloatType>& a,
+                                                                           const std::pair<std::uint32_t, FloatType>& b)
+            {
+                return a.second > b.second;
+            });
+
+            stack.insert(stack.end(), children.begin(), children.begin() + numChildren);
+        }
+    }
+
+    /// \brief Const reference to the points.
+    const std::vector<VectorType>& _points;
+
+    /// \brief The maximum number of points in a leaf.
+    std::size_t _maxBucketSize = DEFAULT_MAX_BUCKET_SIZE;
+
+    /// \brief The maximum depth.
+    std::size_t _maxDepth = DEFAULT_MAX_DEPTH;
+
+    /// \brief The nodes in breadth-first order.
+    std::vector<Node> _nodes;
+
+    /// \brief The point indices, reordered so every node's points are contiguous.
+    Indicies _indices;
+
+    /// \brief Scratch octant labels used while partitioning.
+    std::vector<std::uint8_t> _octants;
+
+    /// \brief Scratch indices used while partitioning.
+    Indicies _scratch;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,933 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "nanoflann.hpp"
+#include "ofx/Box.h"
+#include "ofx/MappedFile.h"
+#include "ofx/Parallel.h"
+#include "ofx/VectorData.h"
+
+
+namespace ofx {
+
+
+/// \brief A point index that is built and searched on disk.
+///
+/// build() reads a raw binary point file, VectorDimension FloatType values
+/// per point in native byte order, through a memory map and sorts the points
+/// along a Morton (Z-order) curve with a bounded-memory external merge sort:
+/// chunks that fit the memory budget are sorted into temporary run files,
+/// which are then merged into the index file.
+///
+/// The index file stores the sorted points and their original indices in
+/// leaf order, so the points of each leaf are contiguous on disk. A balanced
+/// hierarchy of leaf bounding boxes, stored in the same file, is loaded into
+/// memory by open(). Everything else stays mapped, and a query faults in only
+/// the pages of the leaves it visits.
+///
+/// Index files are native endian and are only valid for the VectorDimension,
+/// FloatType and IndexType that wrote them.
+///
+/// \tparam VectorType The VectorType used for queries.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::uint64_t>
+class OutOfCoreIndex
+{
+public:
+    static_assert(VectorDimension > 0, "The OutOfCoreIndex requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create an OutOfCoreIndex without an open index file.
+    OutOfCoreIndex()
+    {
+    }
+
+    /// \brief Create an OutOfCoreIndex and open an index file.
+    /// \param indexPath The path of an index file written by build().
+    explicit OutOfCoreIndex(const std::string& indexPath)
+    {
+        open(indexPath);
+    }
+
+    /// \brief Destroy the OutOfCoreIndex.
+    virtual ~OutOfCoreIndex()
+    {
+    }
+
+    /// \brief Write points to a raw binary point file that build() can read.
+    /// \param path The file path.
+    /// \param points The points to write.
+    /// \returns true iff the file was written.
+    static bool writePoints(const std::string& path, const Points& points)
+    {
+        std::ofstream stream(path, std::ios::binary);
+
+        for (const VectorType& point: points)
+        {
+            stream.write(reinterpret_cast<const char*>(VectorDataPointer<VectorType, FloatType>(point)),
+                         VectorDimension * sizeof(FloatType));
+        }
+
+        // Closing flushes the buffered tail, which can fail too.
+        stream.close();
+
+        return !stream.fail();
+    }
+
+    /// \brief Build an index file from a raw binary point file.
+    ///
+    /// Temporary run files are written next to the index file and removed
+    /// before returning.
+    ///
+    /// \param pointsPath The path of the raw binary point file.
+    /// \param indexPath The path of the index file to write.
+    /// \param maxLeafSize The number of consecutive Morton ordered points per
+    ///        leaf. The default fills about one page per leaf.
+    /// \param memoryBudget The approximate number of bytes used to sort.
+    /// \returns true iff the index file was written.
+    static bool build(const std::string& pointsPath,
+                      const std::string& indexPath,
+                      std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE,
+                      std::size_t memoryBudget = DEFAULT_MEMORY_BUDGET)
+    {
+        const std::size_t pointSize = VectorDimension * sizeof(FloatType);
+
+        MappedFile input;
+
+        if (!input.open(pointsPath) || input.size() % pointSize != 0)
+        {
+            return false;
+        }
+
+        input.adviseSequential();
+
+        const FloatType* pInput = reinterpret_cast<const FloatType*>(input.data());
+        const std::uint64_t numPoints = input.size() / pointSize;
+
+        maxLeafSize = std::max(static_cast<std::size_t>(1), maxLeafSize);
+
+        const std::size_t chunkSize = std::max(static_cast<std::size_t>(MIN_POINTS_PER_THREAD),
+                                               memoryBudget / sizeof(Record));
+
+        // Compute the bounding box, one chunk at a time.
+        Box bounds;
+        bounds.reset();
+
+        for (std::uint64_t first = 0; first < numPoints; first += chunkSize)
+        {
+            const std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, numPoints - first));
+            const std::size_t numChunks = ParallelChunkCount(count, MIN_POINTS_PER_THREAD);
+
+            std::vector<Box> chunkBounds(numChunks);
+
+            ParallelFor(count, numChunks, [&](std::size_t begin, std::size_t end, std::size_t chunk)
+            {
+                Box& box = chunkBounds[chunk];
+                box.reset();
+
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    box.grow(pInput + (first + i) * VectorDimension);
+                }
+            });
+
+            for (const Box& box: chunkBounds)
+            {
+                bounds.grow(box);
+            }
+
+            input.release(first * pointSize, count * pointSize);
+        }
+
+        std::array<FloatType, VectorDimension> scale;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType extent = bounds.high[j] - bounds.low[j];
+            scale[j] = extent > 0 ? static_cast<FloatType>(MAX_QUANTIZED) / extent : 0;
+        }
+
+        // Sort each chunk by Morton code. A single chunk is merged straight
+        // from memory, otherwise each chunk is written to a run file.
+        std::vector<Record> records;
+        std::vector<std::string> runPaths;
+
+        for (std::uint64_t first = 0; first < numPoints; first += chunkSize)
+        {
+            const std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, numPoints - first));
+
+            records.resize(count);
+
+            ParallelFor(count, ParallelChunkCount(count, MIN_POINTS_PER_THREAD), [&](std::size_t begin, std::size_t end, std::size_t)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    const FloatType* pPoint = pInput + (first + i) * VectorDimension;
+
+                    Record& record = records[i];
+                    record.code = mortonCode(pPoint, bounds, scale);
+                    record.index = first + i;
+                    std::copy(pPoint, pPoint + VectorDimension, record.point);
+                }
+            });
+
+            std::sort(records.begin(), records.end());
+
+            input.release(first * pointSize, count * pointSize);
+
+            if (count == numPoints)
+            {
+                break;
+            }
+
+            runPaths.push_back(indexPath + ".run" + std::to_string(runPaths.size()));
+
+            std::ofstream run(runPaths.back(), std::ios::binary);
+            run.write(reinterpret_cast<const char*>(records.data()), count * sizeof(Record));
+            run.close();
+
+            if (run.fail())
+            {
+                removeFiles(runPaths);
+                return false;
+            }
+        }
+
+        input.close();
+
+        // Lay out the index file.
+        const std::uint64_t numLeaves = (numPoints + maxLeafSize - 1) / maxLeafSize;
+        const std::uint64_t numNodes = numLeaves > 0 ? 2 * numLeaves - 1 : 0;
+
+        Header header;
+        header.maxLeafSize = maxLeafSize;
+        header.numPoints = numPoints;
+        header.numNodes = numNodes;
+        header.nodesOffset = sizeof(Header);
+        header.pointsOffset = alignToPage(header.nodesOffset + numNodes * sizeof(Node));
+        header.indicesOffset = alignToPage(header.pointsOffset + numPoints * pointSize);
+
+        std::ofstream output(indexPath, std::ios::binary | std::ios::trunc);
+
+        if (!output.is_open())
+        {
+            removeFiles(runPaths);
+            return false;
+        }
+
+        Writer writer(output, header, memoryBudget / 4);
+
+        if (runPaths.empty())
+        {
+            for (const Record& record: records)
+            {
+                writer.add(record);
+            }
+        }
+        else
+        {
+            records = std::vector<Record>();
+
+            if (!merge(runPaths, memoryBudget / 2, writer))
+            {
+                removeFiles(runPaths);
+                return false;
+            }
+        }
+
+        removeFiles(runPaths);
+
+        writer.flush();
+
+        // Build the hierarchy over the leaf boxes and write it with the header.
+        std::vector<Node> nodes;
+        nodes.reserve(numNodes);
+
+        if (numLeaves > 0)
+        {
+            emitNode(nodes, writer.leafBounds(), 0, numLeaves);
+        }
+
+        output.seekp(0);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        output.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(Node));
+        output.close();
+
+        return !output.fail();
+    }
+
+    /// \brief Build an index file and open it.
+    /// \param pointsPath The path of the raw binary point file.
+    /// \param indexPath The path of the index file to write.
+    /// \param maxLeafSize The number of consecutive Morton ordered points per leaf.
+    /// \param memoryBudget The approximate number of bytes used to sort.
+    /// \returns true iff the index file was written and opened.
+    bool buildIndex(const std::string& pointsPath,
+                    const std::string& indexPath,
+                    std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE,
+                    std::size_t memoryBudget = DEFAULT_MEMORY_BUDGET)
+    {
+        close();
+        return build(pointsPath, indexPath, maxLeafSize, memoryBudget) && open(indexPath);
+    }
+
+    /// \brief Open an index file written by build(), closing any open one.
+    /// \param indexPath The path of the index file.
+    /// \returns true iff the index file was opened. On failure the index is empty.
+    bool open(const std::string& indexPath)
+    {
+        close();
+
+        if (!_file.open(indexPath) || _file.size() < sizeof(Header))
+        {
+            close();
+            return false;
+        }
+
+        Header header;
+        std::copy(_file.data(), _file.data() + sizeof(Header), reinterpret_cast<char*>(&header));
+
+        const Header expected;
+
+        const std::uint64_t numLeaves = header.maxLeafSize > 0 ? header.numPoints / header.maxLeafSize + (header.numPoints % header.maxLeafSize > 0) : 0;
+
+        // The nodes, points and indices must follow each other in the file
+        // at the offsets build() aligns them to.
+        if (header.magic != expected.magic
+        || header.version != expected.version
+        || header.dimension != expected.dimension
+        || header.floatSize != expected.floatSize
+        || header.indexSize != expected.indexSize
+        || header.maxLeafSize == 0
+        || header.numNodes != (numLeaves > 0 ? 2 * numLeaves - 1 : 0)
+        || header.nodesOffset < sizeof(Header)
+        || header.nodesOffset % alignof(Node) != 0
+        || header.pointsOffset % PAGE_ALIGNMENT != 0
+        || header.indicesOffset % PAGE_ALIGNMENT != 0
+        || !isSectionValid(header.nodesOffset, header.numNodes, sizeof(Node), header.pointsOffset)
+        || !isSectionValid(header.pointsOffset, header.numPoints, VectorDimension * sizeof(FloatType), header.indicesOffset)
+        || (header.numPoints > 0 && !isSectionValid(header.indicesOffset, header.numPoints, sizeof(IndexType), _file.size())))
+        {
+            close();
+            return false;
+        }
+
+        const Node* pNodes = reinterpret_cast<const Node*>(_file.data() + header.nodesOffset);
+        _nodes.assign(pNodes, pNodes + header.numNodes);
+
+        // Queries trust the leaf ranges of the nodes to index the points.
+        if (!_nodes.empty() && !isNodeValid(0, 0, numLeaves))
+        {
+            close();
+            return false;
+        }
+
+        // Queries touch scattered leaves, so don't read ahead.
+        _file.adviseRandom();
+
+        _numPoints = static_cast<std::size_t>(header.numPoints);
+        _maxLeafSize = static_cast<std::size_t>(header.maxLeafSize);
+
+        if (_numPoints > 0)
+        {
+            _points = reinterpret_cast<const FloatType*>(_file.data() + header.pointsOffset);
+            _indices = reinterpret_cast<const IndexType*>(_file.data() + header.indicesOffset);
+        }
+
+        return true;
+    }
+
+    /// \brief Close the index file.
+    void close()
+    {
+        _file.close();
+        _nodes.clear();
+        _points = nullptr;
+        _indices = nullptr;
+        _numPoints = 0;
+        _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+    }
+
+    /// \returns true iff an index file is open.
+    bool isOpen() const
+    {
+        return _file.isOpen();
+    }
+
+    /// \returns the number of indexed points.
+    std::size_t size() const
+    {
+        return _numPoints;
+    }
+
+    /// \returns the number of points per leaf.
+    std::size_t getMaxLeafSize() const
+    {
+        return _maxLeafSize;
+    }
+
+    /// \returns the number of nodes in the in-memory hierarchy.
+    std::size_t getNumNodes() const
+    {
+        return _nodes.size();
+    }
+
+    /// \brief Find neighbors in the index.
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill with original point indices.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The nanoflann search parameters. Only eps is used.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet,
+                       const FloatType* pVector,
+                       const nanoflann::SearchParams& params) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+
+        const FloatType epsError = (1 + params.eps) * (1 + params.eps);
+
+        std::vector<std::pair<std::size_t, FloatType>> stack;
+        stack.reserve(64);
+
+        stack.push_back(std::make_pair(static_cast<std::size_t>(0), _nodes[0].bounds.distanceSquared(pVector)));
+
+        while (!stack.empty())
+        {
+            const std::size_t nodeIndex = stack.back().first;
+            const FloatType nodeDistance = stack.back().second;
+            stack.pop_back();
+
+            if (nodeDistance * epsError >= resultSet.worstDist())
+            {
+                continue;
+            }
+
+            const Node& node = _nodes[nodeIndex];
+
+            if (node.lastLeaf - node.firstLeaf == 1)
+            {
+                const std::size_t first = static_cast<std::size_t>(node.firstLeaf) * _maxLeafSize;
+                const std::size_t last = std::min(first + _maxLeafSize, _numPoints);
+
+                for (std::size_t i = first; i < last; ++i)
+                {
+                    const FloatType* pPoint = _points + i * VectorDimension;
+
+                    FloatType total = 0;
+
+                    for (std::size_t j = 0; j < VectorDimension; ++j)
+                    {
+                        const FloatType distance = pVector[j] - pPoint[j];
+                        total += (distance * distance);
+                    }
+
+                    if (total < resultSet.worstDist())
+                    {
+                        resultSet.addPoint(total, _indices[i]);
+                    }
+                }
+            }
+            else
+            {
+                const std::size_t children[2] = { leftChild(nodeIndex), rightChild(nodeIndex) };
+
+                const FloatType distance0 = _nodes[children[0]].bounds.distanceSquared(pVector);
+                const FloatType distance1 = _nodes[children[1]].bounds.distanceSquared(pVector);
+
+                // Push the farther child first so the nearer one is visited next.
+                if (distance0 < distance1)
+                {
+                    stack.push_back(std::make_pair(children[1], distance1));
+                    stack.push_back(std::make_pair(children[0], distance0));
+                }
+                else
+                {
+                    stack.push_back(std::make_pair(children[0], distance0));
+                    stack.push_back(std::make_pair(children[1], distance1));
+                }
+            }
+        }
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of original point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_numPoints, numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams());
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of original point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of original point indices for the nearby points.
+    /// \param epsilon The search epsilon (see nanoflann).
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams(0, epsilon, false));
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    enum
+    {
+        /// \brief The alignment of the point and index sections of the file.
+        PAGE_ALIGNMENT = 4096,
+
+        /// \brief The default number of points per leaf, about one page.
+        DEFAULT_MAX_LEAF_SIZE = (PAGE_ALIGNMENT / (VectorDimension * sizeof(FloatType)) > 0) ? PAGE_ALIGNMENT / (VectorDimension * sizeof(FloatType)) : 1,
+
+        /// \brief The default number of bytes used to sort, 256 MB.
+        DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024,
+
+        /// \brief The minimum number of points processed per thread.
+        MIN_POINTS_PER_THREAD = 16384,
+
+        /// \brief The number of leading dimensions ordered by the Morton code.
+        ///
+        /// A 64 bit code holds at least one bit of each of the first 64
+        /// dimensions. Later dimensions don't affect the order of the points,
+        /// but are still bounded by the hierarchy.
+        MORTON_DIMENSIONS = (VectorDimension < 64) ? VectorDimension : 64,
+
+        /// \brief The number of Morton code bits per dimension.
+        BITS_PER_DIMENSION = (64 / MORTON_DIMENSIONS > 21) ? 21 : 64 / MORTON_DIMENSIONS
+    };
+
+protected:
+    /// \brief The largest quantized coordinate.
+    static constexpr std::uint64_t MAX_QUANTIZED = (std::uint64_t(1) << BITS_PER_DIMENSION) - 1;
+
+    /// \brief The file format magic number, "OOCI".
+    static constexpr std::uint32_t MAGIC = 0x49434F4F;
+
+    /// \brief The file format version.
+    static constexpr std::uint32_t VERSION = 1;
+
+    /// \brief The index file header.
+    struct Header
+    {
+        std::uint32_t magic = MAGIC;
+        std::uint32_t version = VERSION;
+        std::uint32_t dimension = VectorDimension;
+        std::uint32_t floatSize = sizeof(FloatType);
+        std::uint32_t indexSize = sizeof(IndexType);
+        std::uint32_t reserved = 0;
+        std::uint64_t maxLeafSize = 0;
+        std::uint64_t numPoints = 0;
+        std::uint64_t numNodes = 0;
+        std::uint64_t nodesOffset = 0;
+        std::uint64_t pointsOffset = 0;
+        std::uint64_t indicesOffset = 0;
+    };
+
+    /// \brief An axis aligned bounding box.
+    typedef ofx::Box<FloatType, VectorDimension> Box;
+
+    /// \brief A hierarchy node, stored in preorder.
+    ///
+    /// A node spans a range of leaves split at its midpoint. The left child
+    /// follows its parent and the right child follows the left subtree.
+    struct Node
+    {
+        /// \brief The node bounds.
+        Box bounds;
+
+        /// \brief The first leaf of the node.
+        std::uint64_t firstLeaf = 0;
+
+        /// \brief One past the last leaf of the node.
+        std::uint64_t lastLeaf = 0;
+    };
+
+    /// \brief A point and its sort key, as stored in a run file.
+    struct Record
+    {
+        std::uint64_t code;
+        std::uint64_t index;
+        FloatType point[VectorDimension];
+
+        bool operator < (const Record& other) const
+        {
+            return code < other.code || (code == other.code && index < other.index);
+        }
+    };
+
+    /// \brief Writes sorted records to the point and index sections of the
+    ///        index file and collects the leaf bounds.
+    class Writer
+    {
+    public:
+        Writer(std::ofstream& stream, const Header& header, std::size_t bufferBytes):
+            _stream(stream),
+            _header(header),
+            _bufferSize(std::max(static_cast<std::size_t>(1), bufferBytes / (sizeof(Record))))
+        {
+            _points.reserve(_bufferSize * VectorDimension);
+            _indices.reserve(_bufferSize);
+            _leafBounds.reserve(static_cast<std::size_t>((header.numPoints + header.maxLeafSize - 1) / header.maxLeafSize));
+        }
+
+        void add(const Record& record)
+        {
+            if (_written % _header.maxLeafSize == 0)
+            {
+                _leafBounds.emplace_back();
+                _leafBounds.back().reset();
+            }
+
+            _leafBounds.back().grow(record.point);
+
+            _points.insert(_points.end(), record.point, record.point + VectorDimension);
+            _indices.push_back(static_cast<IndexType>(record.index));
+
+            ++_written;
+
+            if (_indices.size() >= _bufferSize)
+            {
+                flush();
+            }
+        }
+
+        void flush()
+        {
+            const std::uint64_t first = _written - _indices.size();
+
+            _stream.seekp(static_cast<std::streamoff>(_header.pointsOffset + first * VectorDimension * sizeof(FloatType)));
+            _stream.write(reinterpret_cast<const char*>(_points.data()), _points.size() * sizeof(FloatType));
+
+            _stream.seekp(static_cast<std::streamoff>(_header.indicesOffset + first * sizeof(IndexType)));
+            _stream.write(reinterpret_cast<const char*>(_indices.data()), _indices.size() * sizeof(IndexType));
+
+            _points.clear();
+            _indices.clear();
+        }
+
+        const std::vector<Box>& leafBounds() const
+        {
+            return _leafBounds;
+        }
+
+    private:
+        std::ofstream& _stream;
+        const Header& _header;
+        std::size_t _bufferSize = 1;
+        std::uint64_t _written = 0;
+        std::vector<FloatType> _points;
+        Indicies _indices;
+        std::vector<Box> _leafBounds;
+    };
+
+    /// \brief Reads a run file in buffered blocks.
+    struct RunReader
+    {
+        std::ifstream stream;
+        std::vector<Record> buffer;
+        std::size_t position = 0;
+
+        /// \brief Advance to the next record, reading the next block when the
+        ///        buffer is used up.
+        /// \returns true iff a record is available at buffer[position].
+        bool next()
+        {
+            if (++position < buffer.size())
+            {
+                return true;
+            }
+
+            buffer.resize(buffer.capacity());
+            stream.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(Record));
+            buffer.resize(static_cast<std::size_t>(stream.gcount()) / sizeof(Record));
+            position = 0;
+            return !buffer.empty();
+        }
+    };
+
+    /// \brief Merge the sorted run files into the writer.
+    /// \returns true iff every run was read.
+    static bool merge(const std::vector<std::string>& runPaths,
+                      std::size_t bufferBytes,
+                      Writer& writer)
+    {
+        const std::size_t bufferSize = std::max(static_cast<std::size_t>(1),
+                                                bufferBytes / (runPaths.size() * sizeof(Record)));
+
+        std::vector<std::unique_ptr<RunReader>> runs;
+
+        // The heap holds the current code, index and run of every open run.
+        typedef std::tuple<std::uint64_t, std::uint64_t, std::size_t> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+
+        for (const std::string& path: runPaths)
+        {
+            std::unique_ptr<RunReader> run(new RunReader());
+            run->stream.open(path, std::ios::binary);
+
+            if (!run->stream.is_open())
+            {
+                return false;
+            }
+
+            run->buffer.reserve(bufferSize);
+
+            if (run->next())
+            {
+                const Record& record = run->buffer[run->position];
+                heap.push(Entry(record.code, record.index, runs.size()));
+            }
+
+            runs.push_back(std::move(run));
+        }
+
+        while (!heap.empty())
+        {
+            const std::size_t runIndex = std::get<2>(heap.top());
+            heap.pop();
+
+            RunReader& run = *runs[runIndex];
+
+            writer.add(run.buffer[run.position]);
+
+            if (run.next())
+            {
+                const Record& record = run.buffer[run.position];
+                heap.push(Entry(record.code, record.index, runIndex));
+            }
+        }
+
+        return true;
+    }
+
+    /// \brief Append a node over a range of leaves and its subtree in preorder.
+    static void emitNode(std::vector<Node>& nodes,
+                         const std::vector<Box>& leafBounds,
+                         std::uint64_t firstLeaf,
+                         std::uint64_t lastLeaf)
+    {
+        const std::size_t index = nodes.size();
+
+        nodes.emplace_back();
+        nodes[index].firstLeaf = firstLeaf;
+        nodes[index].lastLeaf = lastLeaf;
+
+        if (lastLeaf - firstLeaf == 1)
+        {
+            nodes[index].bounds = leafBounds[static_cast<std::size_t>(firstLeaf)];
+            return;
+        }
+
+        const std::uint64_t middleLeaf = firstLeaf + (lastLeaf - firstLeaf) / 2;
+
+        emitNode(nodes, leafBounds, firstLeaf, middleLeaf);
+        emitNode(nodes, leafBounds, middleLeaf, lastLeaf);
+
+        nodes[index].bounds = nodes[index + 1].bounds;
+        nodes[index].bounds.grow(nodes[index + 2 * (middleLeaf - firstLeaf)].bounds);
+    }
+
+    /// \returns true iff a node and its subtree span the leaves emitNode()
+    ///          gives them.
+    bool isNodeValid(std::size_t node, std::uint64_t firstLeaf, std::uint64_t lastLeaf) const
+    {
+        if (_nodes[node].firstLeaf != firstLeaf || _nodes[node].lastLeaf != lastLeaf)
+        {
+            return false;
+        }
+
+        if (lastLeaf - firstLeaf == 1)
+        {
+            return true;
+        }
+
+        const std::uint64_t middleLeaf = firstLeaf + (lastLeaf - firstLeaf) / 2;
+
+        return isNodeValid(leftChild(node), firstLeaf, middleLeaf)
+            && isNodeValid(rightChild(node), middleLeaf, lastLeaf);
+    }
+
+    /// \returns true iff count items of a size, starting at an offset, end
+    ///          at or before the end offset.
+    static bool isSectionValid(std::uint64_t offset,
+                               std::uint64_t count,
+                               std::uint64_t size,
+                               std::uint64_t end)
+    {
+        // Divide rather than multiply, so that huge counts can't overflow.
+        return offset <= end && count <= (end - offset) / size;
+    }
+
+    /// \returns the index of the left child of an internal node.
+    std::size_t leftChild(std::size_t node) const
+    {
+        return node + 1;
+    }
+
+    /// \returns the index of the right child of an internal node.
+    std::size_t rightChild(std::size_t node) const
+    {
+        // The left subtree over m leaves has 2m - 1 nodes.
+        const Node& parent = _nodes[node];
+        return node + static_cast<std::size_t>(2 * ((parent.lastLeaf - parent.firstLeaf) / 2));
+    }
+
+    /// \returns the Morton code of a point.
+    static std::uint64_t mortonCode(const FloatType* pPoint,
+                                    const Box& bounds,
+                                    const std::array<FloatType, VectorDimension>& scale)
+    {
+        std::uint64_t code = 0;
+
+        for (std::size_t j = 0; j < MORTON_DIMENSIONS; ++j)
+        {
+            const std::uint64_t quantized = static_cast<std::uint64_t>((pPoint[j] - bounds.low[j]) * scale[j]);
+            code |= spreadBits(std::min(quantized, static_cast<std::uint64_t>(MAX_QUANTIZED))) << j;
+        }
+
+        return code;
+    }
+
+    /// \brief Spread the bits of a quantized coordinate MORTON_DIMENSIONS apart.
+    static std::uint64_t spreadBits(std::uint64_t value)
+    {
+        std::uint64_t result = 0;
+
+        for (std::size_t bit = 0; bit < BITS_PER_DIMENSION; ++bit)
+        {
+            result |= ((value >> bit) & 1) << (bit * MORTON_DIMENSIONS);
+        }
+
+        return result;
+    }
+
+    /// \returns an offset rounded up to the page alignment.
+    static std::uint64_t alignToPage(std::uint64_t offset)
+    {
+        return (offset + PAGE_ALIGNMENT - 1) / PAGE_ALIGNMENT * PAGE_ALIGNMENT;
+    }
+
+    /// \brief Remove temporary files.
+    static void removeFiles(const std::vector<std::string>& paths)
+    {
+        for (const std::string& path: paths)
+        {
+            std::remove(path.c_str());
+        }
+    }
+
+    /// \brief The mapped index file.
+    MappedFile _file;
+
+    /// \brief The in-memory hierarchy, in preorder.
+    std::vector<Node> _nodes;
+
+    /// \brief The mapped point coordinates in leaf order.
+    const FloatType* _points = nullptr;
+
+    /// \brief The mapped original point indices in leaf order.
+    const IndexType* _indices = nullptr;
+
+    /// \brief The number of indexed points.
+    std::size_t _numPoints = 0;
+
+    /// \brief The number of points per leaf.
+    std::size_t _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+
+};
+
+
+} // namespace ofx
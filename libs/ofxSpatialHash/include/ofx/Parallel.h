@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+namespace ofx {
+
+
+/// \returns the number of hardware threads, or 1 if it cannot be determined.
+inline std::size_t HardwareThreadCount()
+{
+    const std::size_t count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+
+/// \brief Calculate the number of chunks used to process a range in parallel.
+/// \param count The number of items in the range.
+/// \param minChunkSize The minimum number of items worth a thread.
+/// \param maxChunks The maximum number of chunks, or 0 for the thread count.
+/// \returns the number of chunks, at least 1.
+inline std::size_t ParallelChunkCount(std::size_t count,
+                                      std::size_t minChunkSize,
+                                      std::size_t maxChunks = 0)
+{
+    if (maxChunks == 0)
+    {
+        maxChunks = HardwareThreadCount();
+    }
+
+    const std::size_t chunks = count / std::max(static_cast<std::size_t>(1), minChunkSize);
+    return std::max(static_cast<std::size_t>(1), std::min(chunks, maxChunks));
+}
+
+
+/// \brief Process a range in contiguous chunks, one thread per chunk.
+///
+/// The calling thread processes the first chunk. The function is called as
+/// function(begin, end, chunk) and must be safe to call concurrently.
+///
+/// \tparam Function A callable with the signature void(std::size_t, std::size_t, std::size_t).
+/// \param count The number of items in the range.
+/// \param numChunks The number of chunks, usually from ParallelChunkCount().
+/// \param function The function to call for each chunk.
+template <typename Function>
+void ParallelFor(std::size_t count, std::size_t numChunks, Function function)
+{
+    numChunks = std::max(static_cast<std::size_t>(1), numChunks);
+
+    if (numChunks == 1)
+    {
+        function(0, count, 0);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(numChunks - 1);
+
+    for (std::size_t chunk = 1; chunk < numChunks; ++chunk)
+    {
+        const std::size_t begin = count * chunk / numChunks;
+        const std::size_t end = count * (chunk + 1) / numChunks;
+        threads.emplace_back(function, begin, end, chunk);
+    }
+
+    function(0, count / numChunks, 0);
+
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+}
+
+
+} // namespace ofx
@@ -0,0 +1,980 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ofx/MappedFile.h"
+#include "ofx/Parallel.h"
+#include "ofx/VectorData.h"
+
+
+namespace ofx {
+
+
+/// \brief Parallel point cloud file loaders.
+///
+/// Files are memory mapped and parsed block by block. While one block is
+/// parsed by several threads, the next block is read from disk in the
+/// background. Points are parsed straight into the caller's vector, which can
+/// then be indexed without another copy.
+///
+/// Supported formats are:
+///
+/// - PLY, ASCII and binary of either byte order. The x, y, z and w
+///   properties of the vertex element are read, in that order, and may have
+///   any scalar type. Other properties and elements are ignored.
+/// - XYZ, one point per line with coordinates separated by whitespace or
+///   commas. Extra columns are ignored, as are lines that do not start with
+///   a number, such as comments and column headers.
+/// - Raw binary, VectorDimension FloatType values per point in native byte
+///   order, as written by OutOfCoreIndex::writePoints().
+///
+/// \tparam VectorType The VectorType to load.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The floating point type of the VectorType.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float>
+class PointCloudLoader
+{
+public:
+    static_assert(VectorDimension > 0, "The PointCloudLoader requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief The point cloud file formats.
+    enum Format
+    {
+        /// \brief Detect the format from the file contents and extension.
+        FORMAT_AUTO,
+        /// \brief An ASCII or binary PLY file.
+        FORMAT_PLY,
+        /// \brief An ASCII file with one point per line.
+        FORMAT_XYZ,
+        /// \brief Raw native FloatType coordinates.
+        FORMAT_BINARY
+    };
+
+    /// \brief Settings for load().
+    struct LoadSettings
+    {
+        /// \brief The number of bytes parsed per block.
+        std::size_t blockSize = DEFAULT_BLOCK_SIZE;
+
+        /// \brief The maximum number of parsing threads, or 0 for the number
+        ///        of hardware threads.
+        std::size_t maxThreads = 0;
+
+        /// \brief Called on the loading thread after each block with the
+        ///        range [first, last) of points that were just parsed.
+        ///
+        /// Use this to start work on the loaded points, such as adding them
+        /// to an HNSW, while the rest of the file is parsed. The points keep
+        /// their indices, but XYZ loading may reallocate the vector if the
+        /// initial size estimate is exceeded, so don't keep references.
+        std::function<void(std::size_t, std::size_t)> onBlockLoaded;
+    };
+
+    /// \brief Load a point cloud file.
+    /// \param path The file path.
+    /// \param points The points to fill. Existing points are replaced.
+    /// \param settings The load settings.
+    /// \param format The file format.
+    /// \returns true iff the file was loaded. On failure points is empty.
+    static bool load(const std::string& path,
+                     Points& points,
+                     const LoadSettings& settings = LoadSettings(),
+                     Format format = FORMAT_AUTO)
+    {
+        points.clear();
+
+        MappedFile file;
+
+        if (!file.open(path))
+        {
+            return false;
+        }
+
+        if (format == FORMAT_AUTO)
+        {
+            format = detectFormat(path, file);
+        }
+
+        bool success = false;
+
+        switch (format)
+        {
+            case FORMAT_PLY:
+                success = loadPLY(file, points, settings);
+                break;
+            case FORMAT_XYZ:
+                success = loadXYZ(file, points, settings);
+                break;
+            default:
+                success = loadBinary(file, points, settings);
+                break;
+        }
+
+        if (!success)
+        {
+            points.clear();
+        }
+
+        return success;
+    }
+
+    enum
+    {
+        /// \brief The default number of bytes parsed per block, 64 MB.
+        DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024,
+
+        /// \brief The minimum number of text bytes parsed per thread.
+        MIN_BYTES_PER_THREAD = 256 * 1024,
+
+        /// \brief The minimum number of binary points parsed per thread.
+        MIN_POINTS_PER_THREAD = 16384
+    };
+
+protected:
+    /// \brief PLY scalar types.
+    enum PropertyType
+    {
+        PROPERTY_INT8,
+        PROPERTY_UINT8,
+        PROPERTY_INT16,
+        PROPERTY_UINT16,
+        PROPERTY_INT32,
+        PROPERTY_UINT32,
+        PROPERTY_FLOAT32,
+        PROPERTY_FLOAT64,
+        PROPERTY_INVALID
+    };
+
+    /// \brief A PLY element property.
+    struct Property
+    {
+        std::string name;
+        PropertyType type = PROPERTY_INVALID;
+        bool isList = false;
+    };
+
+    /// \brief A PLY element.
+    struct Element
+    {
+        std::string name;
+        std::uint64_t count = 0;
+        std::vector<Property> properties;
+    };
+
+    /// \brief A range of text with one point per line.
+    struct TextBlock
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+    };
+
+    /// \returns the detected format of a mapped file.
+    static Format detectFormat(const std::string& path, const MappedFile& file)
+    {
+        if (file.size() >= 4 && std::memcmp(file.data(), "ply", 3) == 0
+        && (file.data()[3] == '\n' || file.data()[3] == '\r'))
+        {
+            return FORMAT_PLY;
+        }
+
+        const std::size_t dot = path.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        if (extension == "xyz" || extension == "txt" || extension == "csv")
+        {
+            return FORMAT_XYZ;
+        }
+
+        return FORMAT_BINARY;
+    }
+
+    /// \brief Load raw native FloatType coordinates.
+    static bool loadBinary(const MappedFile& file,
+                           Points& points,
+                           const LoadSettings& settings)
+    {
+        const std::size_t pointSize = VectorDimension * sizeof(FloatType);
+
+        if (file.size() % pointSize != 0)
+        {
+            return false;
+        }
+
+        points.resize(file.size() / pointSize);
+
+        const char* pData = file.data();
+
+        forEachBinaryBlock(file, 0, points.size(), pointSize, settings, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                std::memcpy(pointData(points[i]), pData + i * pointSize, pointSize);
+            }
+        });
+
+        return true;
+    }
+
+    /// \brief Load an XYZ file.
+    static bool loadXYZ(const MappedFile& file,
+                        Points& points,
+                        const LoadSettings& settings)
+    {
+        const char* pData = file.data();
+        const char* pEnd = pData + file.size();
+
+        bool isReserved = false;
+        std::atomic<bool> isValid(true);
+
+        forEachTextBlock(file, pData, settings, [&](const TextBlock& block, const std::vector<TextBlock>& chunks)
+        {
+            // Count the point lines of each chunk to find where its points go.
+            std::vector<std::size_t> lineOffsets(chunks.size() + 1, 0);
+
+            ParallelFor(chunks.size(), chunks.size(), [&](std::size_t, std::size_t, std::size_t chunk)
+            {
+                std::size_t count = 0;
+
+                for (const char* pLine = chunks[chunk].begin; pLine < chunks[chunk].end; pLine = nextLine(pLine, chunks[chunk].end))
+                {
+                    count += isPointLine(pLine, chunks[chunk].end) ? 1 : 0;
+                }
+
+                lineOffsets[chunk + 1] = count;
+            });
+
+            for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk)
+            {
+                lineOffsets[chunk + 1] += lineOffsets[chunk];
+            }
+
+            const std::size_t first = points.size();
+
+            // Estimate the total from the first block to avoid reallocation.
+            if (!isReserved && block.end > block.begin)
+            {
+                const double bytesPerPoint = static_cast<double>(block.end - block.begin) / std::max(static_cast<std::size_t>(1), lineOffsets.back());
+                points.reserve(static_cast<std::size_t>(static_cast<double>(pEnd - pData) / bytesPerPoint * 1.05) + 1);
+                isReserved = true;
+            }
+
+            points.resize(first + lineOffsets.back());
+
+            ParallelFor(chunks.size(), chunks.size(), [&](std::size_t, std::size_t, std::size_t chunk)
+            {
+                std::size_t i = first + lineOffsets[chunk];
+
+                for (const char* pLine = chunks[chunk].begin; pLine < chunks[chunk].end; pLine = nextLine(pLine, chunks[chunk].end))
+                {
+                    if (isPointLine(pLine, chunks[chunk].end))
+                    {
+                        if (!parseLine(pLine, chunks[chunk].end, pointData(points[i++])))
+                        {
+                            isValid = false;
+                            return;
+                        }
+                    }
+                }
+            });
+
+            if (isValid && settings.onBlockLoaded && points.size() > first)
+            {
+                settings.onBlockLoaded(first, points.size());
+            }
+
+            return isValid.load();
+        });
+
+        return isValid;
+    }
+
+    /// \brief Load an ASCII or binary PLY file.
+    static bool loadPLY(const MappedFile& file,
+                        Points& points,
+                        const LoadSettings& settings)
+    {
+        const char* pData = file.data();
+        const char* pEnd = pData + file.size();
+
+        // Parse the header.
+        std::string format;
+        std::vector<Element> elements;
+        const char* pBody = nullptr;
+
+        for (const char* pLine = pData; pLine < pEnd; )
+        {
+            const char* pNext = nextLine(pLine, pEnd);
+
+            std::istringstream line(std::string(pLine, pNext));
+            std::string keyword;
+            line >> keyword;
+
+            pLine = pNext;
+
+            if (keyword == "format")
+            {
+                line >> format;
+            }
+            else if (keyword == "element")
+            {
+                Element element;
+                line >> element.name >> element.count;
+                elements.push_back(element);
+            }
+            else if (keyword == "property" && !elements.empty())
+            {
+                Property property;
+                std::string type;
+                line >> type;
+
+                if (type == "list")
+                {
+                    std::string countType;
+                    line >> countType >> type;
+                    property.isList = true;
+                }
+
+                line >> property.name;
+                property.type = propertyType(type);
+                elements.back().properties.push_back(property);
+            }
+            else if (keyword == "end_header")
+            {
+                pBody = pLine;
+                break;
+            }
+        }
+
+        const bool isAscii = format == "ascii";
+        const bool isBinary = format == "binary_little_endian" || format == "binary_big_endian";
+
+        if (pBody == nullptr || (!isAscii && !isBinary))
+        {
+            return false;
+        }
+
+        // Find the vertex element and skip the elements before it.
+        std::size_t vertexElement = 0;
+
+        while (vertexElement < elements.size() && elements[vertexElement].name != "vertex")
+        {
+            const Element& element = elements[vertexElement];
+
+            if (isAscii)
+            {
+                for (std::uint64_t i = 0; i < element.count && pBody < pEnd; ++i)
+                {
+                    pBody = nextLine(pBody, pEnd);
+                }
+            }
+            else
+            {
+                const std::size_t stride = propertyStride(element);
+
+                // Compare counts rather than byte sizes so a huge count
+                // cannot overflow.
+                if (stride == 0 || element.count > static_cast<std::uint64_t>(pEnd - pBody) / stride)
+                {
+                    return false;
+                }
+
+                pBody += static_cast<std::size_t>(element.count) * stride;
+            }
+
+            ++vertexElement;
+        }
+
+        if (vertexElement == elements.size())
+        {
+            return false;
+        }
+
+        const Element& vertex = elements[vertexElement];
+
+        // Find the coordinate properties.
+        static const char* COORDINATE_NAMES[] = { "x", "y", "z", "w" };
+
+        if (VectorDimension > 4)
+        {
+            return false;
+        }
+
+        std::size_t columns[VectorDimension];
+        PropertyType types[VectorDimension];
+        std::size_t offsets[VectorDimension];
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            std::size_t offset = 0;
+            std::size_t column = 0;
+
+            while (column < vertex.properties.size() && vertex.properties[column].name != COORDINATE_NAMES[j])
+            {
+                offset += propertySize(vertex.properties[column].type);
+                ++column;
+            }
+
+            if (column == vertex.properties.size() || vertex.properties[column].isList)
+            {
+                return false;
+            }
+
+            columns[j] = column;
+            types[j] = vertex.properties[column].type;
+            offsets[j] = offset;
+        }
+
+        // Check the vertex count against the body before allocating, so a
+        // header claiming more vertices than the file holds is rejected.
+        // Binary vertices are stride bytes each and ASCII vertices at least
+        // one byte each.
+        const std::uint64_t bodySize = static_cast<std::uint64_t>(pEnd - pBody);
+        const std::size_t stride = isBinary ? propertyStride(vertex) : 1;
+
+        if (stride == 0 || vertex.count > bodySize / stride)
+        {
+            return false;
+        }
+
+        const std::size_t numPoints = static_cast<std::size_t>(vertex.count);
+
+        points.resize(numPoints);
+
+        if (isBinary)
+        {
+            const bool isSwapped = (format == "binary_little_endian") != isLittleEndian();
+            const std::size_t bodyOffset = pBody - pData;
+
+            forEachBinaryBlock(file, bodyOffset, numPoints, stride, settings, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    const char* pVertex = pBody + i * stride;
+                    FloatType* pPoint = pointData(points[i]);
+
+                    for (std::size_t j = 0; j < VectorDimension; ++j)
+                    {
+                        pPoint[j] = readProperty(pVertex + offsets[j], types[j], isSwapped);
+                    }
+                }
+            });
+
+            return true;
+        }
+
+        if (numPoints == 0)
+        {
+            return true;
+        }
+
+        // Each ASCII vertex is one line, so the vertex lines are split into
+        // blocks by position and only the first numPoints lines are parsed.
+        std::size_t maxColumn = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            maxColumn = std::max(maxColumn, columns[j]);
+        }
+
+        std::size_t numLoaded = 0;
+        std::atomic<bool> isValid(true);
+
+        forEachTextBlock(file, pBody, settings, [&](const TextBlock&, const std::vector<TextBlock>& chunks)
+        {
+            std::vector<std::size_t> lineOffsets(chunks.size() + 1, 0);
+
+            ParallelFor(chunks.size(), chunks.size(), [&](std::size_t, std::size_t, std::size_t chunk)
+            {
+                std::size_t count = 0;
+
+                for (const char* pLine = chunks[chunk].begin; pLine < chunks[chunk].end; pLine = nextLine(pLine, chunks[chunk].end))
+                {
+                    ++count;
+                }
+
+                lineOffsets[chunk + 1] = count;
+            });
+
+            for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk)
+            {
+                lineOffsets[chunk + 1] += lineOffsets[chunk];
+            }
+
+            const std::size_t first = numLoaded;
+
+            numLoaded = std::min(numPoints, first + lineOffsets.back());
+
+            ParallelFor(chunks.size(), chunks.size(), [&](std::size_t, std::size_t, std::size_t chunk)
+            {
+                std::size_t i = first + lineOffsets[chunk];
+
+                FloatType values[VectorDimension] = { 0 };
+
+                for (const char* pLine = chunks[chunk].begin; pLine < chunks[chunk].end && i < numPoints; pLine = nextLine(pLine, chunks[chunk].end))
+                {
+                    const char* pLineEnd = lineEnd(pLine, chunks[chunk].end);
+                    const char* p = pLine;
+
+                    for (std::size_t column = 0; column <= maxColumn; ++column)
+                    {
+                        FloatType value = 0;
+                        p = parseFloat(skipSeparators(p, pLineEnd), pLineEnd, value);
+
+                        if (p == nullptr)
+                        {
+                            isValid = false;
+                            return;
+                        }
+
+                        for (std::size_t j = 0; j < VectorDimension; ++j)
+                        {
+                            if (columns[j] == column)
+                            {
+                                values[j] = value;
+                            }
+                        }
+                    }
+
+                    std::copy(values, values + VectorDimension, pointData(points[i++]));
+                }
+            });
+
+            if (isValid && settings.onBlockLoaded && numLoaded > first)
+            {
+                settings.onBlockLoaded(first, numLoaded);
+            }
+
+            return isValid && numLoaded < numPoints;
+        });
+
+        return isValid && numLoaded == numPoints;
+    }
+
+    /// \brief Parse fixed size records block by block, in parallel.
+    ///
+    /// The next block is read ahead while the current one is parsed.
+    ///
+    /// \param function Called as function(begin, end) for record ranges.
+    template <typename Function>
+    static void forEachBinaryBlock(const MappedFile& file,
+                                   std::size_t offset,
+                                   std::size_t count,
+                                   std::size_t stride,
+                                   const LoadSettings& settings,
+                                   Function function)
+    {
+        const std::size_t blockCount = std::max(static_cast<std::size_t>(1), settings.blockSize / stride);
+
+        file.adviseSequential();
+        file.willNeed(offset, blockCount * stride);
+
+        for (std::size_t first = 0; first < count; first += blockCount)
+        {
+            const std::size_t last = std::min(count, first + blockCount);
+
+            file.willNeed(offset + last * stride, blockCount * stride);
+
+            const std::size_t numChunks = ParallelChunkCount(last - first, MIN_POINTS_PER_THREAD, settings.maxThreads);
+
+            ParallelFor(last - first, numChunks, [&](std::size_t begin, std::size_t end, std::size_t)
+            {
+                function(first + begin, first + end);
+            });
+
+            if (settings.onBlockLoaded)
+            {
+                settings.onBlockLoaded(first, last);
+            }
+        }
+    }
+
+    /// \brief Split text into blocks of whole lines and each block into
+    ///        per-thread chunks of whole lines.
+    ///
+    /// The next block is read ahead while the current one is parsed.
+    ///
+    /// \param function Called as function(block, chunks) for each block.
+    ///        Returning false stops.
+    template <typename Function>
+    static void forEachTextBlock(const MappedFile& file,
+                                 const char* pBegin,
+                                 const LoadSettings& settings,
+                                 Function function)
+    {
+        const char* pData = file.data();
+        const char* pEnd = pData + file.size();
+        const std::size_t blockSize = std::max(static_cast<std::size_t>(1), settings.blockSize);
+
+        file.adviseSequential();
+        file.willNeed(pBegin - pData, blockSize);
+
+        std::vector<TextBlock> chunks;
+
+        for (const char* pBlock = pBegin; pBlock < pEnd; )
+        {
+            TextBlock block;
+            block.begin = pBlock;
+            block.end = lineStart(pBlock + std::min(blockSize, static_cast<std::size_t>(pEnd - pBlock)), pBlock, pEnd);
+
+            file.willNeed(block.end - pData, blockSize);
+
+            const std::size_t size = block.end - block.begin;
+            const std::size_t numChunks = ParallelChunkCount(size, MIN_BYTES_PER_THREAD, settings.maxThreads);
+
+            chunks.resize(numChunks);
+
+            for (std::size_t chunk = 0; chunk < numChunks; ++chunk)
+            {
+                chunks[chunk].begin = chunk == 0 ? block.begin : chunks[chunk - 1].end;
+                chunks[chunk].end = chunk + 1 == numChunks ? block.end : lineStart(block.begin + size * (chunk + 1) / numChunks, chunks[chunk].begin, block.end);
+            }
+
+            if (!function(block, chunks))
+            {
+                return;
+            }
+
+            pBlock = block.end;
+        }
+    }
+
+    /// \returns the first line start at or after p, or end.
+    static const char* lineStart(const char* p, const char* pBegin, const char* pEnd)
+    {
+        if (p <= pBegin || p >= pEnd || p[-1] == '\n')
+        {
+            return std::min(std::max(p, pBegin), pEnd);
+        }
+
+        return nextLine(p, pEnd);
+    }
+
+    /// \returns the start of the line after the one containing p, or end.
+    static const char* nextLine(const char* p, const char* pEnd)
+    {
+        const void* pNewline = std::memchr(p, '\n', pEnd - p);
+        return pNewline != nullptr ? static_cast<const char*>(pNewline) + 1 : pEnd;
+    }
+
+    /// \returns the end of the line starting at p, excluding the newline.
+    static const char* lineEnd(const char* p, const char* pEnd)
+    {
+        const void* pNewline = std::memchr(p, '\n', pEnd - p);
+        return pNewline != nullptr ? static_cast<const char*>(pNewline) : pEnd;
+    }
+
+    /// \returns p advanced past spaces, tabs, carriage returns and commas.
+    static const char* skipSeparators(const char* p, const char* pEnd)
+    {
+        while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == ','))
+        {
+            ++p;
+        }
+
+        return p;
+    }
+
+    /// \returns true iff the line starting at p starts with a number.
+    static bool isPointLine(const char* p, const char* pEnd)
+    {
+        p = skipSeparators(p, pEnd);
+        return p < pEnd && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.');
+    }
+
+    /// \brief Parse the first VectorDimension numbers of a line.
+    /// \returns true iff the line held enough numbers.
+    static bool parseLine(const char* p, const char* pEnd, FloatType* pPoint)
+    {
+        const char* pLineEnd = lineEnd(p, pEnd);
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            p = parseFloat(skipSeparators(p, pLineEnd), pLineEnd, pPoint[j]);
+
+            if (p == nullptr)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// \brief Parse a decimal number.
+    ///
+    /// Plain decimal numbers are parsed without strtod(), which needs a
+    /// null terminated string and is slowed by locale handling. Anything else,
+    /// such as nan or inf, falls back to strtod().
+    ///
+    /// \returns the end of the number, or nullptr if there was no number.
+    static const char* parseFloat(const char* p, const char* pEnd, FloatType& value)
+    {
+        const char* pStart = p;
+
+        bool isNegative = false;
+
+        if (p < pEnd && (*p == '-' || *p == '+'))
+        {
+            isNegative = *p == '-';
+            ++p;
+        }
+
+        std::uint64_t mantissa = 0;
+        int numDigits = 0;
+        int exponent = 0;
+        bool hasDigits = false;
+
+        for (; p < pEnd && *p >= '0' && *p <= '9'; ++p)
+        {
+            hasDigits = true;
+
+            if (numDigits < MAX_MANTISSA_DIGITS)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                numDigits += mantissa > 0 ? 1 : 0;
+            }
+            else
+            {
+                ++exponent;
+            }
+        }
+
+        if (p < pEnd && *p == '.')
+        {
+            for (++p; p < pEnd && *p >= '0' && *p <= '9'; ++p)
+            {
+                hasDigits = true;
+
+                if (numDigits < MAX_MANTISSA_DIGITS)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    numDigits += mantissa > 0 ? 1 : 0;
+                    --exponent;
+                }
+            }
+        }
+
+        if (!hasDigits)
+        {
+            return parseFloatFallback(pStart, pEnd, value);
+        }
+
+        if (p < pEnd && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+            bool isExponentNegative = false;
+
+            if (q < pEnd && (*q == '-' || *q == '+'))
+            {
+                isExponentNegative = *q == '-';
+                ++q;
+            }
+
+            if (q < pEnd && *q >= '0' && *q <= '9')
+            {
+                int explicitExponent = 0;
+
+                for (; q < pEnd && *q >= '0' && *q <= '9'; ++q)
+                {
+                    explicitExponent = std::min(explicitExponent * 10 + (*q - '0'), 100000);
+                }
+
+                exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+                p = q;
+            }
+        }
+
+        // Exact for mantissas below 2^53 and exponents within +/-22.
+        static const double POWERS_OF_TEN[] =
+        {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        double result = static_cast<double>(mantissa);
+
+        if (mantissa != 0)
+        {
+            if (exponent < -22 || exponent > 22)
+            {
+                result *= std::pow(10.0, exponent);
+            }
+            else if (exponent < 0)
+            {
+                result /= POWERS_OF_TEN[-exponent];
+            }
+            else
+            {
+                result *= POWERS_OF_TEN[exponent];
+            }
+        }
+
+        value = static_cast<FloatType>(isNegative ? -result : result);
+        return p;
+    }
+
+    /// \brief Parse a number with strtod().
+    /// \returns the end of the number, or nullptr if there was no number.
+    static const char* parseFloatFallback(const char* p, const char* pEnd, FloatType& value)
+    {
+        char buffer[64];
+        std::size_t length = 0;
+
+        while (p + length < pEnd && length + 1 < sizeof(buffer)
+        && p[length] != ' ' && p[length] != '\t' && p[length] != '\r' && p[length] != '\n' && p[length] != ',')
+        {
+            buffer[length] = p[length];
+            ++length;
+        }
+
+        buffer[length] = '\0';
+
+        char* pNumberEnd = nullptr;
+        const double result = std::strtod(buffer, &pNumberEnd);
+
+        if (pNumberEnd == buffer)
+        {
+            return nullptr;
+        }
+
+        value = static_cast<FloatType>(result);
+        return p + (pNumberEnd - buffer);
+    }
+
+    /// \returns the PLY type of a type name.
+    static PropertyType propertyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8") return PROPERTY_INT8;
+        if (name == "uchar" || name == "uint8") return PROPERTY_UINT8;
+        if (name == "short" || name == "int16") return PROPERTY_INT16;
+        if (name == "ushort" || name == "uint16") return PROPERTY_UINT16;
+        if (name == "int" || name == "int32") return PROPERTY_INT32;
+        if (name == "uint" || name == "uint32") return PROPERTY_UINT32;
+        if (name == "float" || name == "float32") return PROPERTY_FLOAT32;
+        if (name == "double" || name == "float64") return PROPERTY_FLOAT64;
+        return PROPERTY_INVALID;
+    }
+
+    /// \returns the size of a PLY type in bytes, or 0 if it is invalid.
+    static std::size_t propertySize(PropertyType type)
+    {
+        switch (type)
+        {
+            case PROPERTY_INT8:
+            case PROPERTY_UINT8:
+                return 1;
+            case PROPERTY_INT16:
+            case PROPERTY_UINT16:
+                return 2;
+            case PROPERTY_INT32:
+            case PROPERTY_UINT32:
+            case PROPERTY_FLOAT32:
+                return 4;
+            case PROPERTY_FLOAT64:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    /// \returns the size of a binary element in bytes, or 0 if it has list
+    ///          or invalid properties.
+    static std::size_t propertyStride(const Element& element)
+    {
+        std::size_t stride = 0;
+
+        for (const Property& property: element.properties)
+        {
+            if (property.isList || property.type == PROPERTY_INVALID)
+            {
+                return 0;
+            }
+
+            stride += propertySize(property.type);
+        }
+
+        return stride;
+    }
+
+    /// \brief Read a binary PLY property.
+    static FloatType readProperty(const char* p, PropertyType type, bool isSwapped)
+    {
+        char bytes[8];
+        const std::size_t size = propertySize(type);
+
+        if (isSwapped)
+        {
+            std::reverse_copy(p, p + size, bytes);
+        }
+        else
+        {
+            std::copy(p, p + size, bytes);
+        }
+
+        switch (type)
+        {
+            case PROPERTY_INT8: return static_cast<FloatType>(read<std::int8_t>(bytes));
+            case PROPERTY_UINT8: return static_cast<FloatType>(read<std::uint8_t>(bytes));
+            case PROPERTY_INT16: return static_cast<FloatType>(read<std::int16_t>(bytes));
+            case PROPERTY_UINT16: return static_cast<FloatType>(read<std::uint16_t>(bytes));
+            case PROPERTY_INT32: return static_cast<FloatType>(read<std::int32_t>(bytes));
+            case PROPERTY_UINT32: return static_cast<FloatType>(read<std::uint32_t>(bytes));
+            case PROPERTY_FLOAT32: return static_cast<FloatType>(read<float>(bytes));
+            case PROPERTY_FLOAT64: return static_cast<FloatType>(read<double>(bytes));
+            default: return 0;
+        }
+    }
+
+    /// \returns a value read from unaligned bytes.
+    template <typename Type>
+    static Type read(const char* bytes)
+    {
+        Type value;
+        std::memcpy(&value, bytes, sizeof(Type));
+        return value;
+    }
+
+    /// \returns true iff the host is little endian.
+    static bool isLittleEndian()
+    {
+        const std::uint16_t value = 1;
+        return read<std::uint8_t>(reinterpret_cast<const char*>(&value)) == 1;
+    }
+
+    /// \returns a writable pointer to the coordinates of a point.
+    static FloatType* pointData(VectorType& point)
+    {
+        // VectorDataPointer() only has a const overload, but the point is not const.
+        return const_cast<FloatType*>(VectorDataPointer<VectorType, FloatType>(point));
+    }
+
+    /// \brief The number of significant digits accumulated when parsing.
+    static constexpr int MAX_MANTISSA_DIGITS = 19;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,280 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+namespace ofx {
+
+
+/// \brief A result set adapter that only accepts points passing a predicate.
+///
+/// The wrapped result set only sees points that were accepted by the
+/// predicate, so rejected points never count toward the result size and never
+/// tighten the search bound. The predicate is evaluated in the leaf loop, after
+/// the distance test, so it is only called for points that could otherwise
+/// enter the result set.
+///
+/// \tparam ResultSetType The nanoflann compatible result set to wrap.
+/// \tparam Predicate A callable with the signature bool(IndexType).
+template <typename ResultSetType, typename Predicate>
+class FilteredResultSet
+{
+public:
+    typedef typename ResultSetType::DistanceType DistanceType;
+    typedef typename ResultSetType::IndexType IndexType;
+
+    /// \brief Create a FilteredResultSet.
+    /// \param resultSet The result set to wrap.
+    /// \param predicate The predicate, returning true for accepted points.
+    FilteredResultSet(ResultSetType& resultSet, const Predicate& predicate):
+        _resultSet(resultSet),
+        _predicate(predicate)
+    {
+    }
+
+    /// \returns the number of accepted points in the result set.
+    inline std::size_t size() const
+    {
+        return _resultSet.size();
+    }
+
+    /// \returns true if the wrapped result set is full.
+    inline bool full() const
+    {
+        return _resultSet.full();
+    }
+
+    /// \brief Add a point to the result set if the predicate accepts it.
+    /// \param distance The distance to the point.
+    /// \param index The index of the point.
+    /// \returns true if the search should continue.
+    inline bool addPoint(DistanceType distance, IndexType index)
+    {
+        if (!_predicate(index))
+        {
+            return true;
+        }
+
+        return _resultSet.addPoint(distance, index);
+    }
+
+    /// \returns the current worst distance of the wrapped result set.
+    inline DistanceType worstDist() const
+    {
+        return _resultSet.worstDist();
+    }
+
+private:
+    /// \brief The wrapped result set.
+    ResultSetType& _resultSet;
+
+    /// \brief The point predicate.
+    const Predicate& _predicate;
+
+};
+
+
+/// \brief A result set adapter that maps local indices to global indices.
+///
+/// Indices that want to search several sub-indices with a single shared result
+/// set wrap it once per sub-index, so every sub-index sees the bound tightened
+/// by the others and the results merge without a separate pass.
+///
+/// \tparam ResultSetType The nanoflann compatible result set to wrap.
+template <typename ResultSetType>
+class IndexMappingResultSet
+{
+public:
+    typedef typename ResultSetType::DistanceType DistanceType;
+    typedef typename ResultSetType::IndexType IndexType;
+
+    /// \brief Create an IndexMappingResultSet.
+    /// \param resultSet The result set to wrap.
+    /// \param indices The global index of each local index.
+    IndexMappingResultSet(ResultSetType& resultSet, const std::vector<IndexType>& indices):
+        _resultSet(resultSet),
+        _indices(indices)
+    {
+    }
+
+    /// \returns the number of points in the wrapped result set.
+    inline std::size_t size() const
+    {
+        return _resultSet.size();
+    }
+
+    /// \returns true if the wrapped result set is full.
+    inline bool full() const
+    {
+        return _resultSet.full();
+    }
+
+    /// \brief Add a point to the wrapped result set with its global index.
+    /// \param distance The distance to the point.
+    /// \param index The local index of the point.
+    /// \returns true if the search should continue.
+    inline bool addPoint(DistanceType distance, IndexType index)
+    {
+        return _resultSet.addPoint(distance, _indices[index]);
+    }
+
+    /// \returns the current worst distance of the wrapped result set.
+    inline DistanceType worstDist() const
+    {
+        return _resultSet.worstDist();
+    }
+
+private:
+    /// \brief The wrapped result set.
+    ResultSetType& _resultSet;
+
+    /// \brief The global index of each local index.
+    const std::vector<IndexType>& _indices;
+
+};
+
+
+/// \brief A result set keeping the N closest points within a radius.
+///
+/// The results are kept as a max-heap on distance. Until N points are found,
+/// the worst distance is the search radius. After that it is the distance of
+/// the farthest kept point, so the search prunes as tightly as a N closest
+/// points search, and never holds more than N results.
+///
+/// \tparam DistanceType_ The distance type.
+/// \tparam IndexType_ The point index type.
+template <typename DistanceType_, typename IndexType_ = std::size_t>
+class BoundedRadiusResultSet
+{
+public:
+    typedef DistanceType_ DistanceType;
+    typedef IndexType_ IndexType;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, DistanceType> IndexDistancePair;
+
+    /// \brief Create a BoundedRadiusResultSet.
+    ///
+    /// The results are cleared and reserved for the capacity.
+    ///
+    /// \param radiusSquared The search radius squared.
+    /// \param capacity The maximum number of points to keep.
+    /// \param results The results to fill.
+    BoundedRadiusResultSet(DistanceType radiusSquared,
+                           std::size_t capacity,
+                           std::vector<IndexDistancePair>& results):
+        _radiusSquared(radiusSquared),
+        _capacity(capacity),
+        _results(results)
+    {
+        _results.clear();
+        _results.reserve(_capacity);
+    }
+
+    /// \returns the number of points kept.
+    inline std::size_t size() const
+    {
+        return _results.size();
+    }
+
+    /// \returns true if the capacity has been reached.
+    inline bool full() const
+    {
+        return _results.size() == _capacity;
+    }
+
+    /// \brief Keep a point if it is among the N closest.
+    /// \param distance The distance to the point.
+    /// \param index The index of the point.
+    /// \returns true, as the search always continues.
+    inline bool addPoint(DistanceType distance, IndexType index)
+    {
+        if (_results.size() < _capacity)
+        {
+            _results.push_back(IndexDistancePair(index, distance));
+            std::push_heap(_results.begin(), _results.end(), compare);
+        }
+        else if (_capacity > 0 && distance < _results.front().second)
+        {
+            std::pop_heap(_results.begin(), _results.end(), compare);
+            _results.back() = IndexDistancePair(index, distance);
+            std::push_heap(_results.begin(), _results.end(), compare);
+        }
+
+        return true;
+    }
+
+    /// \returns the radius squared, or the distance of the farthest kept
+    ///          point once the capacity has been reached.
+    inline DistanceType worstDist() const
+    {
+        return (_capacity > 0 && full()) ? _results.front().second : _radiusSquared;
+    }
+
+    /// \brief Sort the kept points by ascending distance.
+    ///
+    /// This is O(N log N) in the capacity, not in the number of points found.
+    /// The results are no longer a heap afterwards, so no points may be added.
+    void sort()
+    {
+        std::sort_heap(_results.begin(), _results.end(), compare);
+    }
+
+private:
+    /// \brief Order pairs by distance, making the farthest the heap top.
+    static bool compare(const IndexDistancePair& a, const IndexDistancePair& b)
+    {
+        return a.second < b.second;
+    }
+
+    /// \brief The search radius squared.
+    DistanceType _radiusSquared;
+
+    /// \brief The maximum number of points to keep.
+    std::size_t _capacity = 0;
+
+    /// \brief The results, kept as a max-heap on distance.
+    std::vector<IndexDistancePair>& _results;
+
+};
+
+
+/// \brief A point predicate backed by a bitmask.
+///
+/// Points are accepted iff their bit in the mask is set. Points outside of the
+/// mask's range are rejected.
+class MaskPredicate
+{
+public:
+    /// \brief Create a MaskPredicate.
+    /// \param mask A const reference to the mask, indexed by point index.
+    MaskPredicate(const std::vector<bool>& mask): _mask(mask)
+    {
+    }
+
+    /// \returns true iff the point at the given index is accepted.
+    template <typename IndexType>
+    inline bool operator()(IndexType index) const
+    {
+        return static_cast<std::size_t>(index) < _mask.size() && _mask[index];
+    }
+
+private:
+    /// \brief The mask.
+    const std::vector<bool>& _mask;
+
+};
+
+
+} // namespace ofx
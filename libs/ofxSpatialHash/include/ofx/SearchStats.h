@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace ofx {
+
+
+/// \brief Traversal counters for KDTree searches.
+///
+/// Counters are only gathered when OFX_SPATIAL_HASH_ENABLE_STATS is defined
+/// before the first include of ofxSpatialHash. Otherwise searches are not
+/// instrumented and all counters stay zero.
+struct SearchStats
+{
+    /// \brief The number of searches.
+    std::uint64_t queries = 0;
+
+    /// \brief The number of tree nodes visited, including leaves.
+    std::uint64_t nodesVisited = 0;
+
+    /// \brief The number of leaves visited.
+    std::uint64_t leavesVisited = 0;
+
+    /// \brief The number of point distances computed.
+    std::uint64_t distanceEvaluations = 0;
+
+    /// \brief The number of subtrees skipped by the distance bound.
+    std::uint64_t prunedSubtrees = 0;
+
+    /// \brief The number of points offered to the result set.
+    std::uint64_t resultInsertions = 0;
+
+    /// \brief Reset all counters to zero.
+    void reset()
+    {
+        *this = SearchStats();
+    }
+
+    /// \brief Add the counters of another SearchStats.
+    /// \param other The counters to add.
+    /// \returns a reference to this SearchStats.
+    SearchStats& operator += (const SearchStats& other)
+    {
+        queries += other.queries;
+        nodesVisited += other.nodesVisited;
+        leavesVisited += other.leavesVisited;
+        distanceEvaluations += other.distanceEvaluations;
+        prunedSubtrees += other.prunedSubtrees;
+        resultInsertions += other.resultInsertions;
+        return *this;
+    }
+
+};
+
+
+/// \returns the counters of the calling thread's most recent search.
+inline SearchStats& lastSearchStats()
+{
+    static thread_local SearchStats stats;
+    return stats;
+}
+
+
+/// \returns the counters of all searches made by the calling thread since
+///          the last resetThreadSearchStats().
+inline SearchStats& threadSearchStats()
+{
+    static thread_local SearchStats stats;
+    return stats;
+}
+
+
+/// \brief Reset the calling thread's aggregate search counters.
+inline void resetThreadSearchStats()
+{
+    threadSearchStats().reset();
+}
+
+
+/// \brief A result set adapter that counts the points offered to it.
+/// \tparam ResultSetType The nanoflann compatible result set to wrap.
+template <typename ResultSetType>
+class CountingResultSet
+{
+public:
+    typedef typename ResultSetType::DistanceType DistanceType;
+    typedef typename ResultSetType::IndexType IndexType;
+
+    /// \brief Create a CountingResultSet.
+    /// \param resultSet The result set to wrap.
+    /// \param stats The counters to update.
+    CountingResultSet(ResultSetType& resultSet, SearchStats& stats):
+        _resultSet(resultSet),
+        _stats(stats)
+    {
+    }
+
+    /// \returns the number of points in the wrapped result set.
+    inline std::size_t size() const
+    {
+        return _resultSet.size();
+    }
+
+    /// \returns true if the wrapped result set is full.
+    inline bool full() const
+    {
+        return _resultSet.full();
+    }
+
+    /// \brief Count the point and add it to the wrapped result set.
+    /// \param distance The distance to the point.
+    /// \param index The index of the point.
+    /// \returns true if the search should continue.
+    inline bool addPoint(DistanceType distance, IndexType index)
+    {
+        ++_stats.resultInsertions;
+        return _resultSet.addPoint(distance, index);
+    }
+
+    /// \returns the current worst distance of the wrapped result set.
+    inline DistanceType worstDist() const
+    {
+        return _resultSet.worstDist();
+    }
+
+private:
+    /// \brief The wrapped result set.
+    ResultSetType& _resultSet;
+
+    /// \brief The counters to update.
+    SearchStats& _stats;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,383 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include "ofx/Box.h"
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+#include "ofx/ResultSets.h"
+
+
+namespace ofx {
+
+
+/// \brief A KDTree split spatially into independently built shards.
+///
+/// The ShardedKDTree splits the points at the median of their widest dimension
+/// until there is one region per shard, and builds a KDTree per shard in
+/// parallel. Queries visit the shards in order of their bounding box distance,
+/// skip shards that cannot contribute and share a single result set, so the
+/// results of all shards merge as they are found.
+///
+/// Each shard keeps its own copy of its points. When only the points of one
+/// region change, rebuildShard() refreshes that shard alone. Points keep
+/// their shard even if they move out of its region. The shard bounds are
+/// recomputed, so results stay exact, but queries prune less well until the
+/// next buildIndex().
+///
+/// \tparam VectorType The VectorType used by this ShardedKDTree.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class ShardedKDTree
+{
+public:
+    static_assert(VectorDimension > 0, "The ShardedKDTree requires a fixed vector dimension.");
+
+    /// \brief A typedef for the KDTree of each shard.
+    typedef KDTree<VectorType, VectorDimension, FloatType, IndexType> Tree;
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create a ShardedKDTree with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() or rebuildShard() methods, otherwise
+    /// search results will be invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param numShards The number of shards, or 0 for one per hardware thread.
+    /// \param maxLeafSize The maximum leaf size of each shard's KDTree.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    ShardedKDTree(const Points& points,
+                  std::size_t numShards = 0,
+                  std::size_t maxLeafSize = Tree::DEFAULT_MAX_LEAF_SIZE,
+                  bool autoBuildIndex = true):
+        _points(points),
+        _numShards(numShards > 0 ? numShards : HardwareThreadCount()),
+        _maxLeafSize(maxLeafSize)
+    {
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the ShardedKDTree.
+    virtual ~ShardedKDTree()
+    {
+    }
+
+    /// \brief Split the points into shards and build every shard in parallel.
+    void buildIndex()
+    {
+        _shards.clear();
+        _pointShards.assign(_points.size(), 0);
+
+        if (_points.empty())
+        {
+            return;
+        }
+
+        Indicies indices(_points.size());
+
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            indices[i] = static_cast<IndexType>(i);
+        }
+
+        split(indices, 0, indices.size(), std::min(_numShards, _points.size()));
+
+        ParallelFor(_shards.size(), ParallelChunkCount(_shards.size(), 1), [this](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t shard = begin; shard < end; ++shard)
+            {
+                buildShard(shard);
+            }
+        });
+    }
+
+    /// \brief Rebuild a single shard from the current point values.
+    ///
+    /// The shard keeps the same point indices. Use this when only points of
+    /// that shard have changed. If points were added or removed, call
+    /// buildIndex() instead.
+    ///
+    /// \param shard The shard to rebuild.
+    void rebuildShard(std::size_t shard)
+    {
+        buildShard(shard);
+    }
+
+    /// \returns the number of shards.
+    std::size_t getNumShards() const
+    {
+        return _shards.size();
+    }
+
+    /// \returns the shard holding the point with the given index.
+    std::size_t getShardOfPoint(IndexType index) const
+    {
+        return _pointShards[index];
+    }
+
+    /// \returns the point indices held by a shard.
+    const Indicies& getShardIndices(std::size_t shard) const
+    {
+        return _shards[shard]->indices;
+    }
+
+    /// \brief Find neighbors using a custom nanoflann compatible result set.
+    ///
+    /// Shards are visited nearest first, and shards whose bounding boxes are
+    /// beyond the result set's current worst distance are skipped.
+    ///
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    /// \param params The nanoflann search parameters.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet,
+                       const FloatType* pVector,
+                       const nanoflann::SearchParams& params) const
+    {
+        std::vector<std::pair<FloatType, std::size_t>> order(_shards.size());
+
+        for (std::size_t shard = 0; shard < _shards.size(); ++shard)
+        {
+            order[shard] = std::make_pair(_shards[shard]->bounds.distanceSquared(pVector), shard);
+        }
+
+        std::sort(order.begin(), order.end());
+
+        for (const auto& entry: order)
+        {
+            if (entry.first > resultSet.worstDist())
+            {
+                break;
+            }
+
+            const Shard& shard = *_shards[entry.second];
+
+            IndexMappingResultSet<ResultSetType> mappedResultSet(resultSet, shard.indices);
+            shard.tree->findNeighbors(mappedResultSet, pVector, params);
+        }
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams());
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon The search epsilon (see nanoflann).
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point), nanoflann::SearchParams(0, epsilon, false));
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+protected:
+    /// \brief An axis aligned bounding box.
+    typedef ofx::Box<FloatType, VectorDimension> Box;
+
+    /// \brief A shard and its KDTree.
+    ///
+    /// Shards are held by pointer because each KDTree references its shard's
+    /// points.
+    struct Shard
+    {
+        /// \brief The shard's copy of its points.
+        Points points;
+
+        /// \brief The global index of each of the shard's points.
+        Indicies indices;
+
+        /// \brief The bounds of the shard's points.
+        Box bounds;
+
+        /// \brief The shard's KDTree.
+        std::unique_ptr<Tree> tree;
+    };
+
+    /// \brief Recursively split a range of points into shards.
+    void split(Indicies& indices,
+               std::size_t first,
+               std::size_t last,
+               std::size_t numShards)
+    {
+        if (numShards <= 1)
+        {
+            std::unique_ptr<Shard> shard(new Shard());
+            shard->indices.assign(indices.begin() + first, indices.begin() + last);
+
+            for (IndexType index: shard->indices)
+            {
+                _pointShards[index] = _shards.size();
+            }
+
+            _shards.push_back(std::move(shard));
+            return;
+        }
+
+        Box bounds;
+        bounds.reset();
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            bounds.grow(VectorDataPointer<VectorType, FloatType>(_points[indices[i]]));
+        }
+
+        std::size_t dimension = 0;
+
+        for (std::size_t j = 1; j < VectorDimension; ++j)
+        {
+            if (bounds.high[j] - bounds.low[j] > bounds.high[dimension] - bounds.low[dimension])
+            {
+                dimension = j;
+            }
+        }
+
+        // Split the points in proportion to the number of shards on each side.
+        const std::size_t leftShards = numShards / 2;
+        const std::size_t middle = first + (last - first) * leftShards / numShards;
+
+        std::nth_element(indices.begin() + first, indices.begin() + middle, indices.begin() + last, [&](IndexType a, IndexType b)
+        {
+            return VectorDataPointer<VectorType, FloatType>(_points[a])[dimension]
+                 < VectorDataPointer<VectorType, FloatType>(_points[b])[dimension];
+        });
+
+        split(indices, first, middle, leftShards);
+        split(indices, middle, last, numShards - leftShards);
+    }
+
+    /// \brief Copy a shard's points and build its KDTree.
+    void buildShard(std::size_t index)
+    {
+        Shard& shard = *_shards[index];
+
+        shard.points.resize(shard.indices.size());
+        shard.bounds.reset();
+
+        for (std::size_t i = 0; i < shard.indices.size(); ++i)
+        {
+            shard.points[i] = _points[shard.indices[i]];
+            shard.bounds.grow(VectorDataPointer<VectorType, FloatType>(shard.points[i]));
+        }
+
+        if (!shard.tree)
+        {
+            shard.tree.reset(new Tree(shard.points, _maxLeafSize, false));
+        }
+
+        shard.tree->buildIndex();
+    }
+
+    /// \brief A const reference to the points.
+    const Points& _points;
+
+    /// \brief The requested number of shards.
+    std::size_t _numShards = 1;
+
+    /// \brief The maximum leaf size of each shard's KDTree.
+    std::size_t _maxLeafSize = Tree::DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The shards.
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    /// \brief The shard of each point.
+    std::vector<std::size_t> _pointShards;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,691 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include "ofx/KDTree.h"
+
+
+namespace ofx {
+
+
+/// \brief A sparse spatial hash for unbounded worlds.
+///
+/// The SparseSpatialHash maps integer cell coordinates to cells through a flat
+/// open-addressing hash table with robin hood probing, so only occupied cells
+/// use memory and there is no fixed world bound. The point ids in each cell are
+/// stored as a contiguous run in a shared pool, so a cell is scanned without
+/// chasing pointers.
+///
+/// Unlike the KDTree and SpatialHashGrid, the SparseSpatialHash stores a copy
+/// of each point's position and supports incremental insert(), move() and
+/// remove(). Point ids are user-provided, e.g. indices into a particle array.
+/// Ids index an internal array, so they should be reasonably dense.
+///
+/// \tparam VectorType The VectorType used by this SparseSpatialHash.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The point id type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class SparseSpatialHash
+{
+public:
+    static_assert(VectorDimension > 0, "The SparseSpatialHash requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief A typedef for integer cell coordinates.
+    typedef std::array<std::int32_t, VectorDimension> CellKey;
+
+    /// \brief Create an empty SparseSpatialHash.
+    /// \param cellSize The edge length of each cell.
+    /// \throws std::invalid_argument if cellSize is not positive and finite.
+    SparseSpatialHash(FloatType cellSize): _cellSize(cellSize)
+    {
+        if (!(cellSize > 0) || !std::isfinite(cellSize))
+        {
+            throw std::invalid_argument("[ofxSpatialHash] The SparseSpatialHash cell size must be positive and finite.");
+        }
+
+        _slots.resize(MIN_TABLE_SIZE);
+    }
+
+    /// \brief Destroy the SparseSpatialHash.
+    virtual ~SparseSpatialHash()
+    {
+    }
+
+    /// \returns the edge length of each cell.
+    FloatType getCellSize() const
+    {
+        return _cellSize;
+    }
+
+    /// \returns the number of points in the hash.
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    /// \returns the number of occupied cells.
+    std::size_t getNumCells() const
+    {
+        return _cells.size() - _freeCells.size();
+    }
+
+    /// \returns true iff a point with the given id is in the hash.
+    bool contains(IndexType id) const
+    {
+        return id < _entries.size() && _entries[id].cell != INVALID;
+    }
+
+    /// \brief Remove all points.
+    void clear()
+    {
+        _entries.clear();
+        _cells.clear();
+        _freeCells.clear();
+        _pool.clear();
+        _slots.assign(MIN_TABLE_SIZE, Slot());
+        _numSlotsUsed = 0;
+        _poolWaste = 0;
+        _size = 0;
+    }
+
+    /// \brief Insert a point, or move it if the id is already in the hash.
+    /// \param id The point id.
+    /// \param position The point's position.
+    void insert(IndexType id, const VectorType& position)
+    {
+        if (contains(id))
+        {
+            move(id, position);
+            return;
+        }
+
+        if (id >= _entries.size())
+        {
+            _entries.resize(id + 1);
+        }
+
+        Entry& entry = _entries[id];
+        setPosition(entry, position);
+        addToCell(id, findOrCreateCell(cellKey(entry.position.data())));
+        ++_size;
+    }
+
+    /// \brief Move a point to a new position.
+    ///
+    /// Moving a point within its cell only updates the stored position.
+    ///
+    /// \param id The point id.
+    /// \param position The point's new position.
+    void move(IndexType id, const VectorType& position)
+    {
+        if (!contains(id))
+        {
+            insert(id, position);
+            return;
+        }
+
+        Entry& entry = _entries[id];
+        setPosition(entry, position);
+
+        const CellKey key = cellKey(entry.position.data());
+
+        if (key != _cells[entry.cell].key)
+        {
+            removeFromCell(id);
+            addToCell(id, findOrCreateCell(key));
+        }
+    }
+
+    /// \brief Remove a point.
+    /// \param id The point id.
+    void remove(IndexType id)
+    {
+        if (contains(id))
+        {
+            removeFromCell(id);
+            _entries[id].cell = INVALID;
+            --_size;
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    ///
+    /// If the query box covers more cells than are occupied, the occupied
+    /// cells are scanned directly instead of probing every covered cell.
+    ///
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point ids and distances squared.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius, or
+    ///          0 if the radius is negative.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        results.clear();
+
+        // A negative radius would give a low cell above the high cell.
+        if (!(radius >= 0))
+        {
+            return 0;
+        }
+
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+        const FloatType radiusSquared = radius * radius;
+
+        std::array<FloatType, VectorDimension> low;
+        std::array<FloatType, VectorDimension> high;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            low[j] = pVector[j] - radius;
+            high[j] = pVector[j] + radius;
+        }
+
+        const CellKey lowKey = cellKey(low.data());
+        const CellKey highKey = cellKey(high.data());
+
+        double numCoveredCells = 1;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            numCoveredCells *= (static_cast<double>(highKey[j]) - lowKey[j] + 1);
+        }
+
+        if (numCoveredCells > getNumCells())
+        {
+            for (IndexType cell = 0; cell < _cells.size(); ++cell)
+            {
+                if (_cells[cell].count > 0 && cellOverlaps(_cells[cell].key, lowKey, highKey))
+                {
+                    searchCell(cell, pVector, radiusSquared, results);
+                }
+            }
+        }
+        else
+        {
+            CellKey key = lowKey;
+
+            for (;;)
+            {
+                const IndexType cell = findCell(key);
+
+                if (cell != INVALID)
+                {
+                    searchCell(cell, pVector, radiusSquared, results);
+                }
+
+                std::size_t j = 0;
+
+                while (j < VectorDimension && key[j]++ == highKey[j])
+                {
+                    key[j] = lowKey[j];
+                    ++j;
+                }
+
+                if (j == VectorDimension)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \brief Get the point ids in the cell containing a position.
+    /// \param point The position.
+    /// \returns a pair of pointers delimiting the cell's point ids.
+    std::pair<const IndexType*, const IndexType*> getCell(const VectorType& point) const
+    {
+        const IndexType cell = findCell(cellKey(VectorDataPointer<VectorType, FloatType>(point)));
+
+        if (cell == INVALID)
+        {
+            return std::make_pair(nullptr, nullptr);
+        }
+
+        const IndexType* pBegin = _pool.data() + _cells[cell].offset;
+        return std::make_pair(pBegin, pBegin + _cells[cell].count);
+    }
+
+    /// \brief Get the cell coordinates containing a position.
+    /// \param pVector a pointer to the 0th element of a vector.
+    /// \returns the cell coordinates.
+    CellKey cellKey(const FloatType* pVector) const
+    {
+        CellKey key;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType value = std::floor(pVector[j] / _cellSize);
+            const FloatType clamped = std::min(std::max(value, FloatType(std::numeric_limits<std::int32_t>::min() + 1)),
+                                               FloatType(std::numeric_limits<std::int32_t>::max() - 1));
+            key[j] = static_cast<std::int32_t>(clamped);
+        }
+
+        return key;
+    }
+
+    enum
+    {
+        /// \brief The initial and minimum number of hash table slots.
+        MIN_TABLE_SIZE = 64,
+
+        /// \brief The initial capacity of a cell's run in the pool.
+        MIN_CELL_CAPACITY = 4,
+
+        /// \brief The maximum hash table load, in percent.
+        MAX_LOAD_PERCENT = 80
+    };
+
+protected:
+    /// \brief The invalid index sentinel.
+    static constexpr IndexType INVALID = std::numeric_limits<IndexType>::max();
+
+    /// \brief A point's stored position and location in the pool.
+    struct Entry
+    {
+        /// \brief A copy of the point's position.
+        std::array<FloatType, VectorDimension> position;
+
+        /// \brief The point's cell, or INVALID if not in the hash.
+        IndexType cell = INVALID;
+
+        /// \brief The point's slot within its cell's run.
+        IndexType slot = 0;
+    };
+
+    /// \brief An occupied cell and its run in the pool.
+    struct Cell
+    {
+        /// \brief The cell coordinates.
+        CellKey key;
+
+        /// \brief The cached hash of the key.
+        std::uint32_t hash = 0;
+
+        /// \brief The first pool slot of the run.
+        IndexType offset = 0;
+
+        /// \brief The number of points in the run.
+        IndexType count = 0;
+
+        /// \brief The capacity of the run.
+        IndexType capacity = 0;
+    };
+
+    /// \brief A hash table slot.
+    struct Slot
+    {
+        /// \brief The cell index, or INVALID if the slot is empty.
+        IndexType cell = INVALID;
+
+        /// \brief The cached hash of the cell's key.
+        std::uint32_t hash = 0;
+
+        /// \brief The distance from the slot to the key's home slot.
+        std::uint32_t probeLength = 0;
+    };
+
+    /// \brief Hash integer cell coordinates.
+    static std::uint32_t hashKey(const CellKey& key)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            hash ^= static_cast<std::uint32_t>(key[j]);
+            hash *= 0x100000001b3ULL;
+        }
+
+        // Final avalanche so neighboring cells spread across the table.
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+
+        return static_cast<std::uint32_t>(hash);
+    }
+
+    /// \brief Copy a position into an entry.
+    static void setPosition(Entry& entry, const VectorType& position)
+    {
+        const FloatType* pPosition = VectorDataPointer<VectorType, FloatType>(position);
+        std::copy(pPosition, pPosition + VectorDimension, entry.position.begin());
+    }
+
+    /// \returns true iff the cell lies within the inclusive key range.
+    static bool cellOverlaps(const CellKey& key, const CellKey& low, const CellKey& high)
+    {
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            if (key[j] < low[j] || key[j] > high[j])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// \brief Look up a cell by key.
+    /// \returns the cell index, or INVALID if the cell is not occupied.
+    IndexType findCell(const CellKey& key) const
+    {
+        const std::uint32_t hash = hashKey(key);
+        const std::size_t mask = _slots.size() - 1;
+
+        std::size_t slot = hash & mask;
+
+        for (std::uint32_t probeLength = 0; ; ++probeLength)
+        {
+            const Slot& current = _slots[slot];
+
+            // Robin hood ordering lets the probe stop at any slot that is
+            // closer to its own home than the key would be.
+            if (current.cell == INVALID || current.probeLength < probeLength)
+            {
+                return INVALID;
+            }
+
+            if (current.hash == hash && _cells[current.cell].key == key)
+            {
+                return current.cell;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    /// \brief Look up a cell by key, creating it if needed.
+    /// \returns the cell index.
+    IndexType findOrCreateCell(const CellKey& key)
+    {
+        IndexType cell = findCell(key);
+
+        if (cell != INVALID)
+        {
+            return cell;
+        }
+
+        if (!_freeCells.empty())
+        {
+            cell = _freeCells.back();
+            _freeCells.pop_back();
+        }
+        else
+        {
+            cell = static_cast<IndexType>(_cells.size());
+            _cells.push_back(Cell());
+        }
+
+        _cells[cell].key = key;
+        _cells[cell].hash = hashKey(key);
+        _cells[cell].count = 0;
+
+        if ((_numSlotsUsed + 1) * 100 > _slots.size() * MAX_LOAD_PERCENT)
+        {
+            rehash(_slots.size() * 2);
+        }
+
+        insertSlot(cell, _cells[cell].hash);
+
+        return cell;
+    }
+
+    /// \brief Insert a cell into the hash table with robin hood probing.
+    void insertSlot(IndexType cell, std::uint32_t hash)
+    {
+        const std::size_t mask = _slots.size() - 1;
+
+        Slot incoming;
+        incoming.cell = cell;
+        incoming.hash = hash;
+        incoming.probeLength = 0;
+
+        std::size_t slot = hash & mask;
+
+        for (;;)
+        {
+            Slot& current = _slots[slot];
+
+            if (current.cell == INVALID)
+            {
+                current = incoming;
+                ++_numSlotsUsed;
+                return;
+            }
+
+            // Take the slot from entries that are closer to home.
+            if (current.probeLength < incoming.probeLength)
+            {
+                std::swap(current, incoming);
+            }
+
+            ++incoming.probeLength;
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    /// \brief Remove a cell from the hash table with backward shift deletion.
+    void eraseSlot(IndexType cell)
+    {
+        const std::size_t mask = _slots.size() - 1;
+
+        std::size_t slot = _cells[cell].hash & mask;
+
+        while (_slots[slot].cell != cell)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        std::size_t next = (slot + 1) & mask;
+
+        while (_slots[next].cell != INVALID && _slots[next].probeLength > 0)
+        {
+            _slots[slot] = _slots[next];
+            --_slots[slot].probeLength;
+            slot = next;
+            next = (next + 1) & mask;
+        }
+
+        _slots[slot] = Slot();
+        --_numSlotsUsed;
+    }
+
+    /// \brief Resize the hash table and reinsert all occupied cells.
+    void rehash(std::size_t numSlots)
+    {
+        _slots.assign(numSlots, Slot());
+        _numSlotsUsed = 0;
+
+        for (IndexType cell = 0; cell < _cells.size(); ++cell)
+        {
+            if (_cells[cell].count > 0)
+            {
+                insertSlot(cell, _cells[cell].hash);
+            }
+        }
+    }
+
+    /// \brief Append a point id to a cell's run, growing the run if needed.
+    void addToCell(IndexType id, IndexType cell)
+    {
+        Cell& current = _cells[cell];
+
+        if (current.count == current.capacity)
+        {
+            // Relocate the run to the end of the pool with twice the capacity.
+            const IndexType capacity = std::max(static_cast<IndexType>(MIN_CELL_CAPACITY),
+                                                current.capacity * 2);
+
+            if (_poolWaste + current.capacity > _pool.size() / 2 && _pool.size() > MIN_TABLE_SIZE)
+            {
+                compact();
+            }
+
+            const IndexType offset = static_cast<IndexType>(_pool.size());
+            _pool.resize(_pool.size() + capacity);
+
+            std::copy(_pool.begin() + current.offset,
+                      _pool.begin() + current.offset + current.count,
+                      _pool.begin() + offset);
+
+            _poolWaste += current.capacity;
+            current.offset = offset;
+            current.capacity = capacity;
+        }
+
+        _pool[current.offset + current.count] = id;
+        _entries[id].cell = cell;
+        _entries[id].slot = current.count;
+        ++current.count;
+    }
+
+    /// \brief Remove a point id from its cell's run.
+    void removeFromCell(IndexType id)
+    {
+        const IndexType cell = _entries[id].cell;
+        const IndexType slot = _entries[id].slot;
+
+        Cell& current = _cells[cell];
+
+        // Fill the hole with the last id in the run.
+        const IndexType last = _pool[current.offset + current.count - 1];
+        _pool[current.offset + slot] = last;
+        _entries[last].slot = slot;
+        --current.count;
+
+        if (current.count == 0)
+        {
+            eraseSlot(cell);
+            _poolWaste += current.capacity;
+            current.capacity = 0;
+            _freeCells.push_back(cell);
+        }
+    }
+
+    /// \brief Repack all runs contiguously to reclaim abandoned pool space.
+    void compact()
+    {
+        Indicies pool;
+        pool.reserve(_pool.size() - _poolWaste);
+
+        for (Cell& cell: _cells)
+        {
+            const IndexType offset = static_cast<IndexType>(pool.size());
+
+            pool.insert(pool.end(),
+                        _pool.begin() + cell.offset,
+                        _pool.begin() + cell.offset + cell.count);
+            pool.resize(offset + cell.capacity);
+
+            cell.offset = offset;
+        }
+
+        _pool.swap(pool);
+        _poolWaste = 0;
+    }
+
+    /// \brief Add all points of a cell within the radius to the results.
+    void searchCell(IndexType cell,
+                    const FloatType* pVector,
+                    FloatType radiusSquared,
+                    SearchResults& results) const
+    {
+        const Cell& current = _cells[cell];
+
+        for (IndexType i = current.offset; i < current.offset + current.count; ++i)
+        {
+            const IndexType id = _pool[i];
+            const FloatType* pPoint = _entries[id].position.data();
+
+            FloatType total = 0;
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                const FloatType distance = pVector[j] - pPoint[j];
+                total += (distance * distance);
+            }
+
+            if (total < radiusSquared)
+            {
+                results.push_back(std::make_pair(id, total));
+            }
+        }
+    }
+
+    /// \brief The edge length of each cell.
+    FloatType _cellSize = 1;
+
+    /// \brief The stored points, indexed by id.
+    std::vector<Entry> _entries;
+
+    /// \brief The cells, including unoccupied cells awaiting reuse.
+    std::vector<Cell> _cells;
+
+    /// \brief Unoccupied cells available for reuse.
+    Indicies _freeCells;
+
+    /// \brief The point id runs of all cells.
+    Indicies _pool;
+
+    /// \brief The open-addressing hash table. The size is a power of 2.
+    std::vector<Slot> _slots;
+
+    /// \brief The number of occupied hash table slots.
+    std::size_t _numSlotsUsed = 0;
+
+    /// \brief The number of abandoned pool slots.
+    std::size_t _poolWaste = 0;
+
+    /// \brief The number of points in the hash.
+    std::size_t _size = 0;
+
+};
+
+
+template<typename VectorType, int VectorDimension, typename FloatType, typename IndexType>
+constexpr IndexType SparseSpatialHash<VectorType, VectorDimension, FloatType, IndexType>::INVALID;
+
+
+} // namespace ofx
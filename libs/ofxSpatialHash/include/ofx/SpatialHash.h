@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+// The openFrameworks independent core. Include ofxSpatialHash.h instead to
+// use ofVec and glm vector types.
+
+
+#include "nanoflann.hpp"
+#include "ofx/BVH.h"
+#include "ofx/Box.h"
+#include "ofx/DoubleBufferedKDTree.h"
+#include "ofx/HierarchicalSpatialHash.h"
+#include "ofx/HNSW.h"
+#include "ofx/KDForest.h"
+#include "ofx/KDTree.h"
+#include "ofx/LinearBVH.h"
+#include "ofx/MappedFile.h"
+#include "ofx/Octree.h"
+#include "ofx/OutOfCoreIndex.h"
+#include "ofx/PointCloudLoader.h"
+#include "ofx/SearchStats.h"
+#include "ofx/ShardedKDTree.h"
+#include "ofx/SparseSpatialHash.h"
+#include "ofx/SpatialHashGrid.h"
+#include "ofx/VectorData.h"
+#include "ofx/VPTree.h"
@@ -0,0 +1,630 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+
+
+namespace ofx {
+
+
+/// \brief A uniform grid spatial hash optimized for dynamic particles.
+///
+/// The SpatialHashGrid buckets points into uniformly sized cells that cover
+/// the bounding box of the point collection. Rebuilding the index is a
+/// parallel counting sort of point indices by cell, so it is much cheaper than
+/// KDTree::buildIndex() and suits point collections that move every frame.
+///
+/// Queries visit only the cells that can contain results. Radius queries are
+/// fastest when the cell size is close to the query radius.
+///
+/// \tparam VectorType The internal VectorType used by this SpatialHashGrid.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class SpatialHashGrid
+{
+public:
+    static_assert(VectorDimension > 0, "The SpatialHashGrid requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief A typedef for integer cell coordinates.
+    typedef std::array<std::ptrdiff_t, VectorDimension> CellCoordinates;
+
+    /// \brief Create a SpatialHashGrid with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() method, otherwise search results will be
+    /// invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param cellSize The edge length of each grid cell.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    /// \throws std::invalid_argument if cellSize is not positive.
+    SpatialHashGrid(const Points& points,
+                    FloatType cellSize,
+                    bool autoBuildIndex = true):
+        _points(points)
+    {
+        setCellSize(cellSize);
+
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the SpatialHashGrid.
+    virtual ~SpatialHashGrid()
+    {
+    }
+
+    /// \brief Set the cell size.
+    ///
+    /// The cell size takes effect the next time buildIndex() is called.
+    ///
+    /// \param cellSize The edge length of each grid cell.
+    /// \throws std::invalid_argument if cellSize is not positive.
+    void setCellSize(FloatType cellSize)
+    {
+        if (!(cellSize > 0))
+        {
+            throw std::invalid_argument("[ofxSpatialHash] The SpatialHashGrid cell size must be positive.");
+        }
+
+        _cellSize = cellSize;
+    }
+
+    /// \returns the requested cell size.
+    FloatType getCellSize() const
+    {
+        return _cellSize;
+    }
+
+    /// \brief Get the cell size used by the current index.
+    ///
+    /// This is larger than the requested cell size if the requested cell size
+    /// would have required more than MAX_CELLS_PER_POINT cells per point.
+    ///
+    /// \returns the cell size used by the current index.
+    FloatType getEffectiveCellSize() const
+    {
+        return _effectiveCellSize;
+    }
+
+    /// \returns the number of cells along each dimension.
+    const CellCoordinates& getResolution() const
+    {
+        return _resolution;
+    }
+
+    /// \brief Rebuild the grid with a parallel counting sort.
+    void buildIndex()
+    {
+        const std::size_t numPoints = _points.size();
+
+        _cellStarts.clear();
+        _indices.clear();
+
+        if (numPoints == 0)
+        {
+            return;
+        }
+
+        const std::size_t numChunks = ParallelChunkCount(numPoints, MIN_POINTS_PER_THREAD);
+
+        // Compute the bounding box.
+        std::vector<std::array<FloatType, VectorDimension * 2>> chunkBounds(numChunks);
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t chunk)
+        {
+            auto& bounds = chunkBounds[chunk];
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                bounds[j] = std::numeric_limits<FloatType>::max();
+                bounds[VectorDimension + j] = std::numeric_limits<FloatType>::lowest();
+            }
+
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[i]);
+
+                for (std::size_t j = 0; j < VectorDimension; ++j)
+                {
+                    bounds[j] = std::min(bounds[j], pPoint[j]);
+                    bounds[VectorDimension + j] = std::max(bounds[VectorDimension + j], pPoint[j]);
+                }
+            }
+        });
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            _min[j] = std::numeric_limits<FloatType>::max();
+            _max[j] = std::numeric_limits<FloatType>::lowest();
+
+            for (const auto& bounds: chunkBounds)
+            {
+                _min[j] = std::min(_min[j], bounds[j]);
+                _max[j] = std::max(_max[j], bounds[VectorDimension + j]);
+            }
+        }
+
+        // Choose the grid resolution, enlarging cells if there are too many.
+        // Cell counts are compared as logarithms, because tiny cells can
+        // overflow any integer and even a double.
+        const double logMaxCells = std::log(static_cast<double>(numPoints) * MAX_CELLS_PER_POINT + MIN_MAX_CELLS);
+
+        double cellSize = _cellSize;
+        double logNumCells = logCellCount(cellSize);
+
+        while (logNumCells > logMaxCells)
+        {
+            cellSize *= std::exp((logNumCells - logMaxCells) / VectorDimension) * 1.001;
+            logNumCells = logCellCount(cellSize);
+        }
+
+        _effectiveCellSize = static_cast<FloatType>(std::min(cellSize, static_cast<double>(std::numeric_limits<FloatType>::max())));
+
+        const std::size_t cellCount = computeResolution();
+
+        // Count the points in each cell.
+        _pointCells.resize(numPoints);
+
+        std::unique_ptr<std::atomic<IndexType>[]> counts(new std::atomic<IndexType>[cellCount + 1]);
+
+        ParallelFor(cellCount + 1, ParallelChunkCount(cellCount + 1, MIN_POINTS_PER_THREAD), [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                counts[i].store(0, std::memory_order_relaxed);
+            }
+        });
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const std::size_t cell = cellIndex(cellCoordinates(VectorDataPointer<VectorType, FloatType>(_points[i])));
+                _pointCells[i] = static_cast<IndexType>(cell);
+                counts[cell].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        // Exclusive prefix sum of the counts gives each cell's first slot.
+        _cellStarts.resize(cellCount + 1);
+
+        IndexType total = 0;
+
+        for (std::size_t i = 0; i <= cellCount; ++i)
+        {
+            _cellStarts[i] = total;
+            total += counts[i].load(std::memory_order_relaxed);
+            counts[i].store(_cellStarts[i], std::memory_order_relaxed);
+        }
+
+        // Scatter the point indices into their cells.
+        _indices.resize(numPoints);
+
+        ParallelFor(numPoints, numChunks, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                _indices[counts[_pointCells[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<IndexType>(i);
+            }
+        });
+    }
+
+    /// \brief Find the N closest points to the given point.
+    ///
+    /// Cells are visited in rings of increasing distance around the cell
+    /// containing the point until no unvisited cell can contain a closer point.
+    ///
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        if (_indices.empty())
+        {
+            indices.clear();
+            distancesSquared.clear();
+            return;
+        }
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+        const CellCoordinates center = cellCoordinates(pVector);
+
+        std::ptrdiff_t maxRing = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            maxRing = std::max(maxRing, std::max(center[j], _resolution[j] - 1 - center[j]));
+        }
+
+        for (std::ptrdiff_t ring = 0; ring <= maxRing; ++ring)
+        {
+            CellCoordinates low;
+            CellCoordinates high;
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                low[j] = center[j] - ring;
+                high[j] = center[j] + ring;
+            }
+
+            forEachCell(low, high, [&](const CellCoordinates& cell)
+            {
+                for (std::size_t j = 0; j < VectorDimension; ++j)
+                {
+                    if (cell[j] == low[j] || cell[j] == high[j])
+                    {
+                        // The cell is on the ring.
+                        searchCell(cellIndex(cell), pVector, resultSet);
+                        return;
+                    }
+                }
+            });
+
+            if (resultSet.full())
+            {
+                // Unvisited cells lie beyond the faces of the ring's block
+                // that have not yet reached the edge of the grid.
+                FloatType gap = std::numeric_limits<FloatType>::max();
+
+                for (std::size_t j = 0; j < VectorDimension; ++j)
+                {
+                    if (low[j] > 0)
+                    {
+                        gap = std::min(gap, pVector[j] - (_min[j] + low[j] * _effectiveCellSize));
+                    }
+
+                    if (high[j] < _resolution[j] - 1)
+                    {
+                        gap = std::min(gap, _min[j] + (high[j] + 1) * _effectiveCellSize - pVector[j]);
+                    }
+                }
+
+                gap = std::max(gap, FloatType(0));
+
+                if (gap == std::numeric_limits<FloatType>::max()
+                 || gap * gap >= resultSet.worstDist())
+                {
+                    break;
+                }
+            }
+        }
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        if (_indices.empty())
+        {
+            return 0;
+        }
+
+        const FloatType* pVector = VectorDataPointer<VectorType, FloatType>(point);
+
+        CellCoordinates low;
+        CellCoordinates high;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            // Clamp before casting, as huge radii don't fit any integer.
+            const FloatType lowValue = std::floor((pVector[j] - radius - _min[j]) / _effectiveCellSize);
+            const FloatType highValue = std::floor((pVector[j] + radius - _min[j]) / _effectiveCellSize);
+            const FloatType lastCell = static_cast<FloatType>(_resolution[j] - 1);
+
+            if (!(lowValue <= lastCell && highValue >= 0))
+            {
+                // The search box misses the grid.
+                return 0;
+            }
+
+            low[j] = static_cast<std::ptrdiff_t>(std::max(lowValue, FloatType(0)));
+            high[j] = static_cast<std::ptrdiff_t>(std::min(highValue, lastCell));
+        }
+
+        forEachCell(low, high, [&](const CellCoordinates& cell)
+        {
+            searchCell(cellIndex(cell), pVector, resultSet);
+        });
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \brief Get the point indices in a cell.
+    /// \param cell The cell coordinates.
+    /// \returns a pair of pointers delimiting the cell's point indices.
+    std::pair<const IndexType*, const IndexType*> getCell(const CellCoordinates& cell) const
+    {
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            if (cell[j] < 0 || cell[j] >= _resolution[j])
+            {
+                return std::make_pair(nullptr, nullptr);
+            }
+        }
+
+        const std::size_t index = cellIndex(cell);
+
+        return std::make_pair(_indices.data() + _cellStarts[index],
+                              _indices.data() + _cellStarts[index + 1]);
+    }
+
+    enum
+    {
+        /// \brief The maximum number of cells per point.
+        ///
+        /// Sparse point collections with large bounds and a small cell size
+        /// would otherwise need huge numbers of empty cells.
+        MAX_CELLS_PER_POINT = 8,
+
+        /// \brief The maximum number of cells allowed regardless of size.
+        MIN_MAX_CELLS = 4096,
+
+        /// \brief The minimum number of points processed per thread.
+        MIN_POINTS_PER_THREAD = 16384
+    };
+
+protected:
+    /// \brief Count the cells needed to cover the bounds with a cell size.
+    /// \param cellSize The cell size.
+    /// \returns the natural logarithm of the total number of cells.
+    double logCellCount(double cellSize) const
+    {
+        double logNumCells = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const double extent = static_cast<double>(_max[j]) - static_cast<double>(_min[j]);
+            logNumCells += std::log(std::floor(extent / cellSize) + 1);
+        }
+
+        return logNumCells;
+    }
+
+    /// \brief Compute the grid resolution for the effective cell size.
+    ///
+    /// The effective cell size must already be large enough for the cell
+    /// counts to fit the grid.
+    ///
+    /// \returns the total number of cells.
+    std::size_t computeResolution()
+    {
+        std::size_t numCells = 1;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const double extent = static_cast<double>(_max[j]) - static_cast<double>(_min[j]);
+            _resolution[j] = static_cast<std::ptrdiff_t>(std::floor(extent / _effectiveCellSize)) + 1;
+            _strides[j] = (j == 0) ? 1 : _strides[j - 1] * _resolution[j - 1];
+            numCells *= _resolution[j];
+        }
+
+        return numCells;
+    }
+
+    /// \brief Get the clamped coordinates of the cell containing a point.
+    /// \param pVector a pointer to the 0th element of a vector.
+    /// \returns the cell coordinates.
+    CellCoordinates cellCoordinates(const FloatType* pVector) const
+    {
+        CellCoordinates cell;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType value = std::floor((pVector[j] - _min[j]) / _effectiveCellSize);
+            const FloatType clamped = std::min(std::max(value, FloatType(0)),
+                                               static_cast<FloatType>(_resolution[j] - 1));
+            cell[j] = static_cast<std::ptrdiff_t>(clamped);
+        }
+
+        return cell;
+    }
+
+    /// \returns the linear index of in-bounds cell coordinates.
+    std::size_t cellIndex(const CellCoordinates& cell) const
+    {
+        std::size_t index = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            index += cell[j] * _strides[j];
+        }
+
+        return index;
+    }
+
+    /// \brief Call a function for every in-bounds cell in a block of cells.
+    /// \param low The inclusive lower cell coordinates.
+    /// \param high The inclusive upper cell coordinates.
+    /// \param function A callable with the signature void(const CellCoordinates&).
+    template <typename Function>
+    void forEachCell(CellCoordinates low, CellCoordinates high, Function function) const
+    {
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            low[j] = std::max(low[j], std::ptrdiff_t(0));
+            high[j] = std::min(high[j], _resolution[j] - 1);
+
+            if (low[j] > high[j])
+            {
+                return;
+            }
+        }
+
+        CellCoordinates cell = low;
+
+        for (;;)
+        {
+            function(cell);
+
+            std::size_t j = 0;
+
+            while (j < VectorDimension && ++cell[j] > high[j])
+            {
+                cell[j] = low[j];
+                ++j;
+            }
+
+            if (j == VectorDimension)
+            {
+                return;
+            }
+        }
+    }
+
+    /// \brief Offer all points in a cell to a result set.
+    template <typename ResultSetType>
+    void searchCell(std::size_t cell,
+                    const FloatType* pVector,
+                    ResultSetType& resultSet) const
+    {
+        for (IndexType i = _cellStarts[cell]; i < _cellStarts[cell + 1]; ++i)
+        {
+            const IndexType index = _indices[i];
+            const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[index]);
+
+            FloatType total = 0;
+
+            for (std::size_t j = 0; j < VectorDimension; ++j)
+            {
+                const FloatType distance = pVector[j] - pPoint[j];
+                total += (distance * distance);
+            }
+
+            if (total < resultSet.worstDist())
+            {
+                resultSet.addPoint(total, index);
+            }
+        }
+    }
+
+    /// \brief Const reference to the points.
+    const std::vector<VectorType>& _points;
+
+    /// \brief The requested cell size.
+    FloatType _cellSize = 1;
+
+    /// \brief The cell size used by the current index.
+    FloatType _effectiveCellSize = 1;
+
+    /// \brief The minimum corner of the grid.
+    std::array<FloatType, VectorDimension> _min;
+
+    /// \brief The maximum corner of the point bounds.
+    std::array<FloatType, VectorDimension> _max;
+
+    /// \brief The number of cells along each dimension.
+    CellCoordinates _resolution;
+
+    /// \brief The linear index stride of each dimension.
+    std::array<std::size_t, VectorDimension> _strides;
+
+    /// \brief The first slot in _indices for each cell, plus an end marker.
+    Indicies _cellStarts;
+
+    /// \brief The point indices sorted by cell.
+    Indicies _indices;
+
+    /// \brief The cell of each point, kept to avoid reallocating per build.
+    Indicies _pointCells;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,460 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include "ofx/KDTree.h"
+
+
+namespace ofx {
+
+
+/// \brief A vantage point tree for high dimensional points.
+///
+/// Each internal node picks a vantage point and splits the remaining points
+/// into an inside and an outside shell at the median distance to it. Searches
+/// prune whole shells with the triangle inequality, which depends only on
+/// distances and not on the number of coordinates, so the VPTree degrades far
+/// more gracefully than the KDTree for 32D to 128D feature vectors where
+/// axis aligned splits no longer separate anything.
+///
+/// Each child stores the tight range of distances to the vantage point of the
+/// points it contains, so pruning does not rely on the median alone. Leaf
+/// points are copied into a contiguous, tree ordered array.
+///
+/// \tparam VectorType The internal VectorType used by this VPTree.
+/// \tparam VectorDimension The number of dimensions in the VectorType.
+/// \tparam FloatType The internal floating point type.
+/// \tparam IndexType The internal index type.
+template<typename VectorType,
+         int VectorDimension = VectorDataDim<VectorType>::DIM,
+         typename FloatType = float,
+         typename IndexType = std::size_t>
+class VPTree
+{
+public:
+    static_assert(VectorDimension > 0, "The VPTree requires a fixed vector dimension.");
+
+    /// \brief A typedef for a vector of points.
+    typedef std::vector<VectorType> Points;
+
+    /// \brief A typedef for a vector of point indicies.
+    typedef std::vector<IndexType> Indicies;
+
+    /// \brief A typedef for a vector of distances squared.
+    typedef std::vector<FloatType> DistancesSquared;
+
+    /// \brief A typedef for an Index, DistanceSquared Pair.
+    typedef std::pair<IndexType, FloatType> IndexDistanceSquaredPair;
+
+    /// \brief A typedef for a vector of IndexDistanceSquaredPair searchresults.
+    typedef std::vector<IndexDistanceSquaredPair> SearchResults;
+
+    /// \brief Create a VPTree with a reference to a vector or points.
+    ///
+    /// If the contents of the referenced std::vector change, the index must be
+    /// rebuilt using the buildIndex() method, otherwise search results will be
+    /// invalid.
+    ///
+    /// \param points A const reference to a std::vector or VectorType.
+    /// \param maxLeafSize The maximum number of points in a leaf.
+    /// \param autoBuildIndex Automatically build the index during construction.
+    VPTree(const Points& points,
+           std::size_t maxLeafSize = DEFAULT_MAX_LEAF_SIZE,
+           bool autoBuildIndex = true):
+        _points(points),
+        _maxLeafSize(std::max(static_cast<std::size_t>(2), maxLeafSize))
+    {
+        if (autoBuildIndex && !points.empty())
+        {
+            buildIndex();
+        }
+    }
+
+    /// \brief Destroy the VPTree.
+    virtual ~VPTree()
+    {
+    }
+
+    /// \brief Rebuild the tree.
+    void buildIndex()
+    {
+        const std::size_t numPoints = _points.size();
+
+        _nodes.clear();
+        _sortedIndices.resize(numPoints);
+        _sortedPoints.clear();
+
+        if (numPoints == 0)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < numPoints; ++i)
+        {
+            _sortedIndices[i] = static_cast<IndexType>(i);
+        }
+
+        _nodes.reserve(2 * numPoints / _maxLeafSize + 1);
+
+        std::minstd_rand random(RANDOM_SEED);
+        std::vector<std::pair<FloatType, IndexType>> scratch(numPoints);
+
+        buildNode(0, numPoints, random, scratch);
+
+        // Gather the points in tree order for cache friendly scans.
+        _sortedPoints.resize(numPoints * VectorDimension);
+
+        for (std::size_t i = 0; i < numPoints; ++i)
+        {
+            const FloatType* pPoint = VectorDataPointer<VectorType, FloatType>(_points[_sortedIndices[i]]);
+            std::copy(pPoint, pPoint + VectorDimension, &_sortedPoints[i * VectorDimension]);
+        }
+    }
+
+    /// \brief Find neighbors using a custom nanoflann compatible result set.
+    /// \tparam ResultSetType A nanoflann compatible result set.
+    /// \param resultSet The result set to fill.
+    /// \param pVector A pointer to the 0th element of the seed point.
+    template <typename ResultSetType>
+    void findNeighbors(ResultSetType& resultSet, const FloatType* pVector) const
+    {
+        if (!_nodes.empty())
+        {
+            searchNode(0, resultSet, pVector);
+        }
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param indices A collection of point indices for the nearby points.
+    /// \param distancesSquared A collection of the point distances squared.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            Indicies& indices,
+                            DistancesSquared& distancesSquared) const
+    {
+        // Ensure reasonable parameters.
+        numPointsToFind = std::min(_points.size(), numPointsToFind);
+        numPointsToFind = std::max(static_cast<std::size_t>(1), numPointsToFind);
+
+        indices.resize(numPointsToFind);
+        distancesSquared.resize(numPointsToFind);
+
+        nanoflann::KNNResultSet<FloatType, IndexType> resultSet(numPointsToFind);
+        resultSet.init(&indices[0], &distancesSquared[0]);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point));
+
+        indices.resize(resultSet.size());
+        distancesSquared.resize(resultSet.size());
+    }
+
+    /// \brief Find the N closest points to the given point.
+    /// \param point The seed point to search near.
+    /// \param numPointsToFind the number of points to return.
+    /// \param results A collection of point indices for the nearby points.
+    void findNClosestPoints(const VectorType& point,
+                            std::size_t numPointsToFind,
+                            SearchResults& results) const
+    {
+        Indicies indices;
+        DistancesSquared distancesSquared;
+
+        findNClosestPoints(point, numPointsToFind, indices, distancesSquared);
+
+        results.resize(indices.size());
+
+        // Copy the results.
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+    }
+
+    /// \brief Find the all points within a radius of the given point.
+    /// \param point The seed point to search near.
+    /// \param radius The radius to search within.
+    /// \param results A collection of point indices for the nearby points.
+    /// \param epsilon Unused, kept for compatibility with KDTree.
+    /// \param sorted True iff the the output list should be returned sorted
+    ///        by ascending distances.
+    /// \returns The number of points discovered within the search radius.
+    std::size_t findPointsWithinRadius(const VectorType& point,
+                                       FloatType radius,
+                                       SearchResults& results,
+                                       float epsilon = 0,
+                                       bool sorted = true) const
+    {
+        (void)epsilon;
+
+        nanoflann::RadiusResultSet<FloatType, IndexType> resultSet(radius * radius,
+                                                                   results);
+
+        findNeighbors(resultSet, VectorDataPointer<VectorType, FloatType>(point));
+
+        if (sorted)
+        {
+            std::sort(results.begin(), results.end(), nanoflann::IndexDist_Sorter());
+        }
+
+        return results.size();
+    }
+
+    /// \returns the number of nodes in the tree.
+    std::size_t getNumNodes() const
+    {
+        return _nodes.size();
+    }
+
+    enum
+    {
+        /// \brief The default maximum number of points in a leaf.
+        DEFAULT_MAX_LEAF_SIZE = 16,
+
+        /// \brief The number of vantage point candidates tried per node.
+        NUM_VANTAGE_CANDIDATES = 5,
+
+        /// \brief The number of points used to score each candidate.
+        NUM_VANTAGE_SAMPLES = 32,
+
+        /// \brief The seed used to pick vantage candidates.
+        RANDOM_SEED = 5489
+    };
+
+protected:
+    /// \brief A tree node.
+    ///
+    /// The inside child always follows its parent. The outside child index is
+    /// stored explicitly.
+    struct Node
+    {
+        /// \brief The first sorted point of the node. For internal nodes this
+        ///        is the vantage point.
+        IndexType first = 0;
+
+        /// \brief One past the last sorted point of a leaf, or first + 1 for
+        ///        internal nodes.
+        IndexType last = 0;
+
+        /// \brief The outside child index, or 0 for leaves.
+        std::uint32_t outside = 0;
+
+        /// \brief The largest distance from the vantage point to the inside child.
+        FloatType insideMax = 0;
+
+        /// \brief The smallest distance from the vantage point to the outside child.
+        FloatType outsideMin = 0;
+
+        /// \brief The largest distance from the vantage point to the outside child.
+        FloatType outsideMax = 0;
+    };
+
+    /// \returns the Euclidean distance squared between two points.
+    static FloatType distanceSquared(const FloatType* a, const FloatType* b)
+    {
+        FloatType total = 0;
+
+        for (std::size_t j = 0; j < VectorDimension; ++j)
+        {
+            const FloatType difference = a[j] - b[j];
+            total += difference * difference;
+        }
+
+        return total;
+    }
+
+    /// \returns a pointer to the 0th element of a point by original index.
+    const FloatType* pointData(IndexType index) const
+    {
+        return VectorDataPointer<VectorType, FloatType>(_points[index]);
+    }
+
+    /// \brief Pick the candidate whose distances to a sample spread the most.
+    std::size_t chooseVantagePoint(std::size_t first,
+                                   std::size_t last,
+                                   std::minstd_rand& random) const
+    {
+        std::uniform_int_distribution<std::size_t> pick(first, last - 1);
+
+        std::size_t best = first;
+        FloatType bestSpread = -1;
+
+        for (std::size_t c = 0; c < NUM_VANTAGE_CANDIDATES; ++c)
+        {
+            const std::size_t candidate = pick(random);
+            const FloatType* pCandidate = pointData(_sortedIndices[candidate]);
+
+            // Score by the variance of distances to a random sample.
+            FloatType sum = 0;
+            FloatType sumSquared = 0;
+
+            for (std::size_t s = 0; s < NUM_VANTAGE_SAMPLES; ++s)
+            {
+                const FloatType distance = std::sqrt(distanceSquared(pCandidate, pointData(_sortedIndices[pick(random)])));
+                sum += distance;
+                sumSquared += distance * distance;
+            }
+
+            const FloatType mean = sum / NUM_VANTAGE_SAMPLES;
+            const FloatType spread = sumSquared / NUM_VANTAGE_SAMPLES - mean * mean;
+
+            if (spread > bestSpread)
+            {
+                bestSpread = spread;
+                best = candidate;
+            }
+        }
+
+        return best;
+    }
+
+    /// \brief Recursively build the node for the given range of points.
+    void buildNode(std::size_t first,
+                   std::size_t last,
+                   std::minstd_rand& random,
+                   std::vector<std::pair<FloatType, IndexType>>& scratch)
+    {
+        const std::size_t nodeIndex = _nodes.size();
+        _nodes.push_back(Node());
+        _nodes[nodeIndex].first = static_cast<IndexType>(first);
+
+        if (last - first <= _maxLeafSize)
+        {
+            _nodes[nodeIndex].last = static_cast<IndexType>(last);
+            return;
+        }
+
+        // Move the vantage point to the front of the range.
+        std::swap(_sortedIndices[first], _sortedIndices[chooseVantagePoint(first, last, random)]);
+
+        const FloatType* pVantage = pointData(_sortedIndices[first]);
+
+        for (std::size_t i = first + 1; i < last; ++i)
+        {
+            scratch[i] = std::make_pair(std::sqrt(distanceSquared(pVantage, pointData(_sortedIndices[i]))),
+                                        _sortedIndices[i]);
+        }
+
+        // Split the remaining points at the median distance. The range holds
+        // at least three points, so both shells are non-empty.
+        const std::size_t middle = first + 1 + (last - first - 1) / 2;
+
+        std::nth_element(scratch.begin() + first + 1,
+                         scratch.begin() + middle,
+                         scratch.begin() + last);
+
+        FloatType insideMax = 0;
+        FloatType outsideMin = std::numeric_limits<FloatType>::max();
+        FloatType outsideMax = 0;
+
+        for (std::size_t i = first + 1; i < last; ++i)
+        {
+            _sortedIndices[i] = scratch[i].second;
+
+            if (i < middle)
+            {
+                insideMax = std::max(insideMax, scratch[i].first);
+            }
+            else
+            {
+                outsideMin = std::min(outsideMin, scratch[i].first);
+                outsideMax = std::max(outsideMax, scratch[i].first);
+            }
+        }
+
+        _nodes[nodeIndex].last = static_cast<IndexType>(first + 1);
+        _nodes[nodeIndex].insideMax = insideMax;
+        _nodes[nodeIndex].outsideMin = outsideMin;
+        _nodes[nodeIndex].outsideMax = outsideMax;
+
+        buildNode(first + 1, middle, random, scratch);
+
+        _nodes[nodeIndex].outside = static_cast<std::uint32_t>(_nodes.size());
+
+        buildNode(middle, last, random, scratch);
+    }
+
+    /// \brief Recursively search a node.
+    template <typename ResultSetType>
+    void searchNode(std::size_t nodeIndex,
+                    ResultSetType& resultSet,
+                    const FloatType* pVector) const
+    {
+        const Node& node = _nodes[nodeIndex];
+
+        if (node.outside == 0)
+        {
+            for (IndexType i = node.first; i < node.last; ++i)
+            {
+                const FloatType distance = distanceSquared(pVector, &_sortedPoints[i * VectorDimension]);
+
+                if (distance < resultSet.worstDist())
+                {
+                    resultSet.addPoint(distance, _sortedIndices[i]);
+                }
+            }
+
+            return;
+        }
+
+        const FloatType vantageDistanceSquared = distanceSquared(pVector, &_sortedPoints[node.first * VectorDimension]);
+
+        if (vantageDistanceSquared < resultSet.worstDist())
+        {
+            resultSet.addPoint(vantageDistanceSquared, _sortedIndices[node.first]);
+        }
+
+        const FloatType distance = std::sqrt(vantageDistanceSquared);
+
+        // Visit the shell the query falls in first so the bound tightens early.
+        const bool insideFirst = distance * 2 < node.insideMax + node.outsideMin;
+
+        for (std::size_t pass = 0; pass < 2; ++pass)
+        {
+            const FloatType tau = std::sqrt(resultSet.worstDist());
+
+            if ((pass == 0) == insideFirst)
+            {
+                if (distance - tau <= node.insideMax)
+                {
+                    searchNode(nodeIndex + 1, resultSet, pVector);
+                }
+            }
+            else if (distance + tau >= node.outsideMin && distance - tau <= node.outsideMax)
+            {
+                searchNode(node.outside, resultSet, pVector);
+            }
+        }
+    }
+
+    /// \brief A const reference to the points.
+    const Points& _points;
+
+    /// \brief The maximum number of points in a leaf.
+    std::size_t _maxLeafSize = DEFAULT_MAX_LEAF_SIZE;
+
+    /// \brief The tree nodes in depth first order.
+    std::vector<Node> _nodes;
+
+    /// \brief The original point indices in tree order.
+    Indicies _sortedIndices;
+
+    /// \brief The point coordinates in tree order.
+    std::vector<FloatType> _sortedPoints;
+
+};
+
+
+} // namespace ofx
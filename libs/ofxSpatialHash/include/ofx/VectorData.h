@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2010 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <array>
+#include <cstddef>
+
+
+namespace ofx {
+
+
+/// \brief Helpers for getting data pointer.
+///
+/// The default works for any VectorType with a data() method, such as
+/// std::array. Other vector types need a specialization, declared before the
+/// first index using them is instantiated. The openFrameworks and glm
+/// specializations are in ofx/VectorDataOF.h, included by ofxSpatialHash.h.
+template <typename VectorType, typename FloatType>
+const FloatType* VectorDataPointer(const VectorType& v) { return v.data(); }
+
+
+/// \brief Helpers for getting data vector dimensions.
+///
+/// A DIM of -1 means the dimension is only known at runtime.
+template <typename VectorType>
+struct VectorDataDim { static const int DIM = -1; };
+
+template <typename FloatType, std::size_t N>
+struct VectorDataDim<std::array<FloatType, N>> { static const int DIM = N; };
+
+
+} // namespace ofx
@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include "ofx/BVH.h"
+#include "ofx/VectorDataOF.h"
+#include "ofMesh.h"
+#include "ofPolyline.h"
+
+
+namespace ofx {
+
+
+/// \brief Add the triangles of an ofMesh to a BVH.
+///
+/// Triangle, triangle strip and triangle fan meshes are supported, with or
+/// without indices. Meshes with other primitive modes add nothing.
+///
+/// \param bvh The BVH to add to.
+/// \param mesh The mesh.
+/// \returns the id of the first triangle.
+template <typename FloatType, typename IndexType>
+IndexType addMesh(BVH<FloatType, IndexType>& bvh, const ofMesh& mesh)
+{
+    const IndexType first = static_cast<IndexType>(bvh.size());
+
+    const auto& vertices = mesh.getVertices();
+
+    std::vector<std::size_t> indices;
+
+    if (mesh.hasIndices())
+    {
+        indices.assign(mesh.getIndices().begin(), mesh.getIndices().end());
+    }
+    else
+    {
+        indices.resize(vertices.size());
+
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            indices[i] = i;
+        }
+    }
+
+    switch (mesh.getMode())
+    {
+        case OF_PRIMITIVE_TRIANGLES:
+            bvh.addTriangles(vertices, indices);
+            break;
+        case OF_PRIMITIVE_TRIANGLE_STRIP:
+            bvh.addTriangleStrip(vertices, indices);
+            break;
+        case OF_PRIMITIVE_TRIANGLE_FAN:
+            bvh.addTriangleFan(vertices, indices);
+            break;
+        default:
+            break;
+    }
+
+    return first;
+}
+
+
+/// \brief Add the segments of an ofPolyline to a BVH.
+/// \param bvh The BVH to add to.
+/// \param polyline The polyline.
+/// \returns the id of the first segment.
+template <typename FloatType, typename IndexType>
+IndexType addPolyline(BVH<FloatType, IndexType>& bvh, const ofPolyline& polyline)
+{
+    return bvh.addPolyline(polyline.getVertices(), polyline.isClosed());
+}
+
+
+} // namespace ofx
@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2010 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include "ofx/VectorData.h"
+#include "ofVec2f.h"
+#include "ofVec3f.h"
+#include "ofVec4f.h"
+
+
+namespace ofx {
+
+
+template <>
+inline const float* VectorDataPointer(const ofVec2f& v) { return v.getPtr(); }
+
+template <>
+inline const float* VectorDataPointer(const ofVec3f& v) { return v.getPtr(); }
+
+template <>
+inline const float* VectorDataPointer(const ofVec4f& v) { return v.getPtr(); }
+
+template <>
+inline const float* VectorDataPointer(const glm::vec2& v) { return &v[0]; }
+
+template <>
+inline const float* VectorDataPointer(const glm::vec3& v) { return &v[0]; }
+
+template <>
+inline const float* VectorDataPointer(const glm::vec4& v) { return &v[0]; }
+
+
+template <>
+struct VectorDataDim<ofVec2f> { static const int DIM = ofVec2f::DIM; };
+
+template <>
+struct VectorDataDim<ofVec3f> { static const int DIM = ofVec3f::DIM; };
+
+template <>
+struct VectorDataDim<ofVec4f> { static const int DIM = ofVec4f::DIM; };
+
+template <>
+struct VectorDataDim<glm::vec2> { static const int DIM = 2; };//glm::vec2::components; };
+
+template <>
+struct VectorDataDim<glm::vec3> { static const int DIM = 3; };//glm::vec3::components; };
+
+template <>
+struct VectorDataDim<glm::vec4> { static const int DIM = 4; };//glm::vec4::components; };
+
+
+} // namespace ofx
@@ -8,5 +8,6 @@
 #pragma once
 
 
-#include "nanoflann.hpp"
-#include "ofx/KDTree.h"
+#include "ofx/VectorDataOF.h"
+#include "ofx/SpatialHash.h"
+#include "ofx/BVHOF.h"
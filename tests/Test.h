@@ -0,0 +1,352 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+// A minimal test harness. Each test is a program that checks its results
+// against a brute force search and returns a non-zero status on failure.
+
+
+/// \brief Check a condition and record a failure if it is false.
+#define OFX_CHECK(condition) \
+    ofx::test::check((condition), #condition, __FILE__, __LINE__)
+
+
+namespace ofx {
+namespace test {
+
+
+/// \returns the number of failed checks so far.
+inline std::size_t& failureCount()
+{
+    static std::size_t count = 0;
+    return count;
+}
+
+
+/// \brief Record a failed check. Only the first failures are printed.
+inline bool check(bool condition, const char* expression, const char* file, int line)
+{
+    if (!condition)
+    {
+        if (failureCount() < 20)
+        {
+            std::printf("%s:%d: check failed: %s\n", file, line, expression);
+        }
+
+        ++failureCount();
+    }
+
+    return condition;
+}
+
+
+/// \brief Print a summary of the checks.
+/// \param name The name of the test.
+/// \returns the exit status of the test.
+inline int report(const char* name)
+{
+    if (failureCount() > 0)
+    {
+        std::printf("%s: %zu checks failed.\n", name, failureCount());
+        return 1;
+    }
+
+    std::printf("%s: passed.\n", name);
+    return 0;
+}
+
+
+/// \returns count points uniformly distributed in a cube.
+/// \param count The number of points.
+/// \param seed The random seed.
+/// \param size The edge length of the cube.
+template <typename FloatType, std::size_t Dimension>
+std::vector<std::array<FloatType, Dimension>> randomPoints(std::size_t count,
+                                                           unsigned seed,
+                                                           FloatType size = 1000)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<FloatType> uniform(0, size);
+
+    std::vector<std::array<FloatType, Dimension>> points(count);
+
+    for (auto& point: points)
+    {
+        for (auto& value: point)
+        {
+            value = uniform(random);
+        }
+    }
+
+    return points;
+}
+
+
+/// \returns the squared distance between two points.
+template <typename FloatType, std::size_t Dimension>
+double distanceSquared(const std::array<FloatType, Dimension>& a,
+                       const std::array<FloatType, Dimension>& b)
+{
+    double result = 0;
+
+    for (std::size_t j = 0; j < Dimension; ++j)
+    {
+        const double difference = double(a[j]) - double(b[j]);
+        result += difference * difference;
+    }
+
+    return result;
+}
+
+
+/// \brief A brute force result, an index and a squared distance.
+typedef std::pair<std::size_t, double> Result;
+
+
+/// \returns the squared distance of every point accepted by a predicate,
+///          sorted by ascending distance.
+template <typename Point, typename Predicate>
+std::vector<Result> bruteForce(const std::vector<Point>& points,
+                               const Point& query,
+                               const Predicate& predicate)
+{
+    std::vector<Result> results;
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        if (predicate(i))
+        {
+            results.push_back(Result(i, distanceSquared(points[i], query)));
+        }
+    }
+
+    std::sort(results.begin(), results.end(), [](const Result& a, const Result& b)
+    {
+        return a.second < b.second || (a.second == b.second && a.first < b.first);
+    });
+
+    return results;
+}
+
+
+/// \returns the squared distance of every point, sorted by ascending distance.
+template <typename Point>
+std::vector<Result> bruteForce(const std::vector<Point>& points, const Point& query)
+{
+    return bruteForce(points, query, [](std::size_t) { return true; });
+}
+
+
+/// \returns true iff two squared distances are equal up to rounding.
+inline bool nearlyEqual(double a, double b)
+{
+    return std::abs(a - b) <= 1e-4 * std::max(1.0, std::max(std::abs(a), std::abs(b)));
+}
+
+
+/// \brief Check the N closest points found by an index.
+///
+/// Ties may be broken either way, so the distances are compared in order and
+/// every index is checked against its reported distance.
+///
+/// \param points The indexed points.
+/// \param query The query point.
+/// \param expected The brute force results of bruteForce().
+/// \param numPointsToFind The number of points the index was asked for.
+/// \param actual The index results, sorted by ascending distance.
+/// \returns true iff the results match.
+template <typename Point, typename SearchResults>
+bool checkNearest(const std::vector<Point>& points,
+                  const Point& query,
+                  const std::vector<Result>& expected,
+                  std::size_t numPointsToFind,
+                  const SearchResults& actual)
+{
+    const std::size_t count = std::min(numPointsToFind, expected.size());
+
+    if (!OFX_CHECK(actual.size() == count))
+    {
+        return false;
+    }
+
+    bool success = true;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const std::size_t index = static_cast<std::size_t>(actual[i].first);
+
+        success = OFX_CHECK(index < points.size())
+               && OFX_CHECK(nearlyEqual(actual[i].second, expected[i].second))
+               && OFX_CHECK(nearlyEqual(actual[i].second, distanceSquared(points[index], query)))
+               && success;
+    }
+
+    return success;
+}
+
+
+/// \brief Check the points within a radius found by an index.
+///
+/// Points within rounding error of the radius may be included or not.
+///
+/// \param points The indexed points.
+/// \param query The query point.
+/// \param expected The brute force results of bruteForce().
+/// \param radius The search radius.
+/// \param actual The index results, in any order.
+/// \returns true iff the results match.
+template <typename Point, typename SearchResults>
+bool checkRadius(const std::vector<Point>& points,
+                 const Point& query,
+                 const std::vector<Result>& expected,
+                 double radius,
+                 const SearchResults& actual)
+{
+    const double radiusSquared = radius * radius;
+
+    std::vector<bool> found(points.size(), false);
+
+    bool success = true;
+
+    for (const auto& result: actual)
+    {
+        const std::size_t index = static_cast<std::size_t>(result.first);
+
+        if (!OFX_CHECK(index < points.size()) || !OFX_CHECK(!found[index]))
+        {
+            return false;
+        }
+
+        found[index] = true;
+
+        const double distance = distanceSquared(points[index], query);
+
+        success = OFX_CHECK(nearlyEqual(result.second, distance))
+               && OFX_CHECK(distance <= radiusSquared * (1 + 1e-4))
+               && success;
+    }
+
+    for (const Result& result: expected)
+    {
+        if (result.second < radiusSquared * (1 - 1e-4))
+        {
+            success = OFX_CHECK(found[result.first]) && success;
+        }
+    }
+
+    return success;
+}
+
+
+/// \returns true iff the results are sorted by ascending distance.
+template <typename SearchResults>
+bool isSorted(const SearchResults& results)
+{
+    for (std::size_t i = 1; i < results.size(); ++i)
+    {
+        if (results[i].second < results[i - 1].second)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/// \brief Check the searches shared by the exact indices.
+///
+/// Both findNClosestPoints() overloads and sorted and unsorted
+/// findPointsWithinRadius() are checked for every query.
+///
+/// \param index The index to check.
+/// \param points The indexed points.
+/// \param queries The query points.
+/// \param numPointsToFind The number of nearest points to find.
+/// \param radius The radius to search within.
+template <typename Index, typename Point>
+void checkSearches(const Index& index,
+                   const std::vector<Point>& points,
+                   const std::vector<Point>& queries,
+                   std::size_t numPointsToFind,
+                   double radius)
+{
+    for (const Point& query: queries)
+    {
+        const auto expected = bruteForce(points, query);
+
+        typename Index::Indicies indices;
+        typename Index::DistancesSquared distancesSquared;
+        index.findNClosestPoints(query, numPointsToFind, indices, distancesSquared);
+
+        typename Index::SearchResults results;
+
+        if (OFX_CHECK(indices.size() == distancesSquared.size()))
+        {
+            for (std::size_t i = 0; i < indices.size(); ++i)
+            {
+                results.push_back(std::make_pair(indices[i], distancesSquared[i]));
+            }
+        }
+
+        checkNearest(points, query, expected, numPointsToFind, results);
+
+        index.findNClosestPoints(query, numPointsToFind, results);
+        checkNearest(points, query, expected, numPointsToFind, results);
+
+        index.findPointsWithinRadius(query, radius, results);
+        OFX_CHECK(isSorted(results));
+        checkRadius(points, query, expected, radius, results);
+
+        index.findPointsWithinRadius(query, radius, results, 0, false);
+        checkRadius(points, query, expected, radius, results);
+    }
+}
+
+
+/// \returns the fraction of the expected N closest points that were found.
+template <typename SearchResults>
+double recall(const std::vector<Result>& expected,
+              std::size_t numPointsToFind,
+              const SearchResults& actual)
+{
+    const std::size_t count = std::min(numPointsToFind, expected.size());
+
+    if (count == 0)
+    {
+        return 1;
+    }
+
+    // Count by distance so that ties are not misses.
+    const double farthest = expected[count - 1].second;
+
+    std::size_t hits = 0;
+
+    for (const auto& result: actual)
+    {
+        if (result.second <= farthest * (1 + 1e-4))
+        {
+            ++hits;
+        }
+    }
+
+    return double(std::min(hits, count)) / double(count);
+}
+
+
+} } // namespace ofx::test
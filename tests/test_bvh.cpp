@@ -0,0 +1,242 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/BVH.h"
+#include "Test.h"
+
+
+// Checks BVH queries against a BVH with a single leaf, which tests every
+// primitive, and checks segment and box distances against closed forms.
+
+
+enum
+{
+    NUM_PRIMITIVES = 3000,
+    NUM_QUERIES = 200
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::BVH<float> Hierarchy;
+
+
+/// \returns the squared distance from a point to a segment.
+double segmentDistanceSquared(const Point& p, const Point& a, const Point& b)
+{
+    double ab[3];
+    double ap[3];
+    double lengthSquared = 0;
+    double dot = 0;
+
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+        ab[j] = double(b[j]) - a[j];
+        ap[j] = double(p[j]) - a[j];
+        lengthSquared += ab[j] * ab[j];
+        dot += ab[j] * ap[j];
+    }
+
+    const double t = lengthSquared > 0 ? std::min(1.0, std::max(0.0, dot / lengthSquared)) : 0;
+
+    double result = 0;
+
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+        const double difference = ap[j] - t * ab[j];
+        result += difference * difference;
+    }
+
+    return result;
+}
+
+
+/// \returns the squared distance from a point to a box.
+double boxDistanceSquared(const Point& p, const Point& low, const Point& high)
+{
+    double result = 0;
+
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+        const double difference = std::max(0.0, std::max(double(low[j]) - p[j], double(p[j]) - high[j]));
+        result += difference * difference;
+    }
+
+    return result;
+}
+
+
+/// \brief Add random triangles, segments and boxes to both hierarchies.
+void addPrimitives(Hierarchy& bvh, Hierarchy& reference, std::vector<std::pair<Point, Point>>& segments, std::vector<std::pair<Point, Point>>& boxes)
+{
+    const auto corners = ofx::test::randomPoints<float, 3>(NUM_PRIMITIVES, 1);
+    const auto offsets = ofx::test::randomPoints<float, 3>(NUM_PRIMITIVES * 2, 2, 40.0f);
+
+    for (std::size_t i = 0; i < NUM_PRIMITIVES; ++i)
+    {
+        const Point& a = corners[i];
+        Point b = a;
+        Point c = a;
+
+        for (std::size_t j = 0; j < 3; ++j)
+        {
+            b[j] += offsets[i * 2][j] - 20;
+            c[j] += offsets[i * 2 + 1][j] - 20;
+        }
+
+        switch (i % 3)
+        {
+            case 0:
+                bvh.addTriangle(a, b, c);
+                reference.addTriangle(a, b, c);
+                break;
+            case 1:
+                bvh.addSegment(a, b);
+                reference.addSegment(a, b);
+                segments.push_back(std::make_pair(a, b));
+                break;
+            default:
+            {
+                Point high = a;
+
+                for (std::size_t j = 0; j < 3; ++j)
+                {
+                    high[j] += offsets[i * 2][j] / 4;
+                }
+
+                bvh.addBox(a, high);
+                reference.addBox(a, high);
+                boxes.push_back(std::make_pair(a, high));
+                break;
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    Hierarchy bvh(4);
+    Hierarchy reference(NUM_PRIMITIVES);
+
+    std::vector<std::pair<Point, Point>> segments;
+    std::vector<std::pair<Point, Point>> boxes;
+
+    addPrimitives(bvh, reference, segments, boxes);
+
+    bvh.buildIndex();
+    reference.buildIndex();
+
+    OFX_CHECK(bvh.size() == NUM_PRIMITIVES);
+
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 3);
+    const auto directions = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 4, 2.0f);
+
+    for (std::size_t q = 0; q < queries.size(); ++q)
+    {
+        const Point& query = queries[q];
+
+        Hierarchy::ClosestPrimitive closest;
+        Hierarchy::ClosestPrimitive expected;
+
+        OFX_CHECK(bvh.findClosestPrimitive(query, closest));
+        OFX_CHECK(reference.findClosestPrimitive(query, expected));
+        OFX_CHECK(ofx::test::nearlyEqual(closest.distanceSquared, expected.distanceSquared));
+        OFX_CHECK(ofx::test::nearlyEqual(closest.distanceSquared, ofx::test::distanceSquared(closest.point, query)));
+
+        // A maximum distance below the closest distance finds nothing.
+        OFX_CHECK(!bvh.findClosestPrimitive(query, closest, std::sqrt(expected.distanceSquared) * 0.99f));
+
+        Hierarchy::SearchResults results;
+        Hierarchy::SearchResults expectedResults;
+
+        bvh.findPrimitivesWithinRadius(query, 50, results);
+        reference.findPrimitivesWithinRadius(query, 50, expectedResults);
+
+        OFX_CHECK(ofx::test::isSorted(results));
+        OFX_CHECK(results.size() == expectedResults.size());
+
+        std::sort(results.begin(), results.end());
+        std::sort(expectedResults.begin(), expectedResults.end());
+        OFX_CHECK(results == expectedResults);
+
+        // Segment and box distances match their closed forms.
+        for (const auto& result: results)
+        {
+            const std::size_t id = result.first;
+
+            if (id % 3 == 1)
+            {
+                const auto& segment = segments[id / 3];
+                OFX_CHECK(ofx::test::nearlyEqual(result.second, segmentDistanceSquared(query, segment.first, segment.second)));
+            }
+            else if (id % 3 == 2)
+            {
+                const auto& box = boxes[id / 3];
+                OFX_CHECK(ofx::test::nearlyEqual(result.second, boxDistanceSquared(query, box.first, box.second)));
+            }
+        }
+
+        Point direction = directions[q];
+
+        for (auto& value: direction)
+        {
+            value -= 1;
+        }
+
+        Hierarchy::RayHit hit;
+        Hierarchy::RayHit expectedHit;
+
+        const bool isHit = bvh.intersectRay(query, direction, hit);
+
+        OFX_CHECK(isHit == reference.intersectRay(query, direction, expectedHit));
+
+        if (isHit)
+        {
+            OFX_CHECK(ofx::test::nearlyEqual(hit.t, expectedHit.t));
+        }
+    }
+
+    // A ray along the x axis hits a known box face.
+    Hierarchy single;
+    single.addBox(Point{{ 10, -1, -1 }}, Point{{ 12, 1, 1 }});
+    single.buildIndex();
+
+    Hierarchy::RayHit hit;
+    OFX_CHECK(single.intersectRay(Point{{ 0, 0, 0 }}, Point{{ 1, 0, 0 }}, hit));
+    OFX_CHECK(ofx::test::nearlyEqual(hit.t, 10));
+    OFX_CHECK(!single.intersectRay(Point{{ 0, 0, 0 }}, Point{{ -1, 0, 0 }}, hit));
+
+    // Indexed triangles, strips and fans.
+    const std::vector<Point> vertices = {{ {{ 0, 0, 0 }}, {{ 1, 0, 0 }}, {{ 0, 1, 0 }}, {{ 1, 1, 0 }} }};
+    const std::vector<std::size_t> indices = { 0, 1, 2, 3 };
+
+    Hierarchy mesh;
+    OFX_CHECK(mesh.addTriangles(vertices, std::vector<std::size_t>{ 0, 1, 2 }) == 0);
+    OFX_CHECK(mesh.addTriangleStrip(vertices, indices) == 1);
+    OFX_CHECK(mesh.addTriangleFan(vertices, indices) == 3);
+    OFX_CHECK(mesh.addPolyline(vertices, true) == 5);
+    OFX_CHECK(mesh.size() == 9);
+
+    mesh.buildIndex();
+
+    Hierarchy::ClosestPrimitive closest;
+    OFX_CHECK(mesh.findClosestPrimitive(Point{{ 0.25f, 0.25f, 2 }}, closest));
+    OFX_CHECK(ofx::test::nearlyEqual(closest.distanceSquared, 4));
+
+    // A double precision BVH takes double and float vectors.
+    ofx::BVH<double> precise;
+    precise.addTriangle(std::array<double, 3>{{ 0, 0, 0 }}, std::array<double, 3>{{ 1, 0, 0 }}, std::array<double, 3>{{ 0, 1, 0 }});
+    precise.addSegment(Point{{ 0, 0, 3 }}, Point{{ 1, 0, 3 }});
+    precise.buildIndex();
+
+    ofx::BVH<double>::SearchResults preciseResults;
+    OFX_CHECK(precise.findPrimitivesWithinRadius(std::array<double, 3>{{ 0.25, 0.25, 1 }}, 10, preciseResults) == 2);
+    OFX_CHECK(preciseResults[0].first == 0 && ofx::test::nearlyEqual(preciseResults[0].second, 1));
+    OFX_CHECK(preciseResults[1].first == 1 && ofx::test::nearlyEqual(preciseResults[1].second, 4.0625));
+
+    return ofx::test::report("test_bvh");
+}
@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <atomic>
+#include <thread>
+#include "ofx/DoubleBufferedKDTree.h"
+#include "Test.h"
+
+
+// Checks that DoubleBufferedKDTree publishes correct snapshots, and that
+// queries made while rebuilds run always see a complete snapshot.
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::DoubleBufferedKDTree<Point> Tree;
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(20000, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(100, 2);
+
+    Tree tree;
+    OFX_CHECK(tree.acquire() == nullptr);
+    OFX_CHECK(tree.getEpoch() == 0);
+
+    // Queries before the first build find nothing.
+    Tree::SearchResults results;
+    tree.findNClosestPoints(queries[0], 10, results);
+    OFX_CHECK(results.empty());
+
+    tree.rebuild(points);
+    tree.waitForRebuild();
+    OFX_CHECK(!tree.isRebuilding());
+    OFX_CHECK(tree.getEpoch() == 1);
+
+    ofx::test::checkSearches(tree, points, queries, 12, 60);
+
+    // Query snapshots from another thread while rebuilding with new points.
+    std::atomic<bool> done(false);
+    std::atomic<std::size_t> numQueries(0);
+
+    std::thread reader([&]()
+    {
+        std::size_t i = 0;
+
+        while (!done || numQueries == 0)
+        {
+            const auto snapshot = tree.acquire();
+            const Point& query = queries[i++ % queries.size()];
+
+            Tree::SearchResults results;
+            snapshot->tree().findNClosestPoints(query, 8, results);
+
+            ofx::test::checkNearest(snapshot->points(), query, ofx::test::bruteForce(snapshot->points(), query), 8, results);
+
+            ++numQueries;
+        }
+    });
+
+    std::vector<Point> moved = points;
+
+    for (std::size_t epoch = 0; epoch < 5; ++epoch)
+    {
+        for (auto& point: moved)
+        {
+            point[epoch % 3] += 10;
+        }
+
+        // Sizes change so that a torn snapshot would be noticed.
+        moved.resize(moved.size() - 1000);
+
+        tree.rebuild(moved);
+        tree.waitForRebuild();
+    }
+
+    done = true;
+    reader.join();
+
+    OFX_CHECK(numQueries > 0);
+    OFX_CHECK(tree.acquire()->points().size() == moved.size());
+
+    ofx::test::checkSearches(tree, moved, queries, 12, 60);
+
+    return ofx::test::report("test_double_buffered_kdtree");
+}
@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/HierarchicalSpatialHash.h"
+#include "Test.h"
+
+
+// Checks HierarchicalSpatialHash point and sphere object searches against a
+// brute force search.
+
+
+enum
+{
+    NUM_POINTS = 5000,
+    NUM_OBJECTS = 2000,
+    NUM_QUERIES = 50
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::HierarchicalSpatialHash<Point> Hash;
+
+
+int main()
+{
+    // Ids below NUM_POINTS are points, the rest are sphere objects.
+    const auto positions = ofx::test::randomPoints<float, 3>(NUM_POINTS + NUM_OBJECTS, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 2);
+
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> uniform(0, 1);
+
+    std::vector<float> extents(positions.size(), 0);
+
+    Hash hash(2);
+
+    for (std::size_t i = 0; i < positions.size(); ++i)
+    {
+        if (i < NUM_POINTS)
+        {
+            hash.insert(i, positions[i]);
+        }
+        else
+        {
+            // Mostly small objects and a few large ones.
+            const float value = uniform(random);
+            extents[i] = value * value * value * 200;
+            hash.insert(i, positions[i], extents[i]);
+        }
+    }
+
+    const auto isPoint = [](std::size_t index) { return index < NUM_POINTS; };
+
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(positions, query, isPoint);
+
+        for (float radius: { 1.0f, 10.0f, 100.0f, 1000.0f })
+        {
+            Hash::SearchResults results;
+            hash.findPointsWithinRadius(query, radius, results);
+            OFX_CHECK(ofx::test::isSorted(results));
+            ofx::test::checkRadius(positions, query, expected, radius, results);
+
+            hash.findObjectsOverlappingSphere(query, radius, results);
+            OFX_CHECK(ofx::test::isSorted(results));
+
+            std::vector<bool> found(positions.size(), false);
+
+            for (const auto& result: results)
+            {
+                OFX_CHECK(result.first >= NUM_POINTS && result.first < positions.size());
+                OFX_CHECK(!found[result.first]);
+                found[result.first] = true;
+            }
+
+            for (std::size_t i = NUM_POINTS; i < positions.size(); ++i)
+            {
+                const double reach = double(radius) + extents[i];
+                const double distance = ofx::test::distanceSquared(positions[i], query);
+
+                if (distance < reach * reach * (1 - 1e-4))
+                {
+                    OFX_CHECK(found[i]);
+                }
+                else if (distance > reach * reach * (1 + 1e-4))
+                {
+                    OFX_CHECK(!found[i]);
+                }
+            }
+        }
+    }
+
+    return ofx::test::report("test_hierarchical_spatial_hash");
+}
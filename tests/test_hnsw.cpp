@@ -0,0 +1,179 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include "ofx/HNSW.h"
+#include "Test.h"
+
+
+// Checks HNSW recall against a brute force search, that a saved and loaded
+// index answers queries exactly like the original, and that corrupt streams
+// are rejected.
+
+
+typedef std::array<float, 16> Point;
+typedef ofx::HNSW<Point> Graph;
+
+
+/// \returns the average recall of the N closest points.
+double averageRecall(const Graph& graph,
+                     const std::vector<Point>& points,
+                     const std::vector<Point>& queries,
+                     std::size_t numPointsToFind)
+{
+    double total = 0;
+
+    for (const Point& query: queries)
+    {
+        Graph::SearchResults results;
+        graph.findNClosestPoints(query, numPointsToFind, results);
+
+        OFX_CHECK(results.size() == numPointsToFind);
+        OFX_CHECK(ofx::test::isSorted(results));
+
+        for (const auto& result: results)
+        {
+            OFX_CHECK(ofx::test::nearlyEqual(result.second, ofx::test::distanceSquared(points[result.first], query)));
+        }
+
+        total += ofx::test::recall(ofx::test::bruteForce(points, query), numPointsToFind, results);
+    }
+
+    return total / queries.size();
+}
+
+
+/// \brief Check that a saved graph with a value replaced is rejected.
+template <typename Type>
+void checkCorrupt(const std::string& data, std::size_t offset, Type value)
+{
+    std::string corrupt = data;
+    std::memcpy(&corrupt[offset], &value, sizeof(value));
+
+    std::stringstream stream(corrupt);
+
+    Graph loaded(8);
+    OFX_CHECK(!loaded.load(stream));
+    OFX_CHECK(loaded.size() == 0);
+    OFX_CHECK(loaded.getM() == 8);
+}
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 16>(10000, 1);
+    const auto queries = ofx::test::randomPoints<float, 16>(100, 2);
+
+    Graph graph;
+
+    // Add a single point, then the rest in parallel.
+    OFX_CHECK(graph.add(points[0]) == 0);
+    OFX_CHECK(graph.add(Graph::Points(points.begin() + 1, points.end())) == 1);
+    OFX_CHECK(graph.size() == points.size());
+
+    const double recall = averageRecall(graph, points, queries, 10);
+    std::printf("Recall with efSearch %zu: %f\n", graph.getEfSearch(), recall);
+    OFX_CHECK(recall > 0.9);
+
+    // Batch queries match single queries.
+    std::vector<Graph::SearchResults> batch;
+    graph.findNClosestPoints(queries, 10, batch);
+    OFX_CHECK(batch.size() == queries.size());
+
+    for (std::size_t i = 0; i < queries.size(); ++i)
+    {
+        Graph::SearchResults results;
+        graph.findNClosestPoints(queries[i], 10, results);
+        OFX_CHECK(batch[i] == results);
+    }
+
+    // A saved and loaded graph answers queries exactly like the original.
+    std::stringstream stream;
+    OFX_CHECK(graph.save(stream));
+
+    Graph loaded;
+    OFX_CHECK(loaded.load(stream));
+    OFX_CHECK(loaded.size() == graph.size());
+    OFX_CHECK(loaded.getM() == graph.getM());
+    OFX_CHECK(loaded.getMaxLevel() == graph.getMaxLevel());
+
+    for (const Point& query: queries)
+    {
+        Graph::SearchResults expected;
+        Graph::SearchResults results;
+        graph.findNClosestPoints(query, 10, expected);
+        loaded.findNClosestPoints(query, 10, results);
+        OFX_CHECK(expected == results);
+    }
+
+    // Corrupt streams are rejected. The stream holds eight 32 bit header
+    // values, with M at byte 16, the layer count at byte 24 and the entry
+    // point at byte 28, then the 64 bit point count, the points, the levels
+    // and the bottom layer links, which start with the number of links.
+    const std::string data = stream.str();
+    const std::size_t levelsOffset = 40 + points.size() * sizeof(Point);
+    const std::size_t linksOffset = levelsOffset + points.size() * sizeof(int);
+
+    checkCorrupt<std::uint32_t>(data, 16, 0);
+    checkCorrupt<std::uint32_t>(data, 16, 1);
+    checkCorrupt<std::uint32_t>(data, 16, 1 << 30);
+    checkCorrupt<std::uint32_t>(data, 20, 0);
+    checkCorrupt<std::uint32_t>(data, 24, 0);
+    checkCorrupt<std::uint32_t>(data, 24, graph.getMaxLevel() + 2);
+    checkCorrupt<std::uint32_t>(data, 28, points.size());
+    checkCorrupt<std::uint64_t>(data, 32, 0);
+    checkCorrupt<std::uint64_t>(data, 32, std::uint64_t(1) << 40);
+    checkCorrupt<int>(data, levelsOffset, -1);
+    checkCorrupt<std::uint32_t>(data, linksOffset, 2 * graph.getM() + 1);
+    checkCorrupt<std::uint32_t>(data, linksOffset + 4, points.size());
+
+    // A link on an upper layer to a point that doesn't reach that layer.
+    std::size_t upperOffset = linksOffset + points.size() * (2 * graph.getM() + 1) * 4;
+    std::size_t lowPoint = points.size();
+
+    for (std::size_t i = 0; i < points.size() && lowPoint == points.size(); ++i)
+    {
+        int level = 0;
+        std::memcpy(&level, &data[levelsOffset + i * sizeof(int)], sizeof(level));
+
+        if (level == 0)
+        {
+            lowPoint = i;
+        }
+    }
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        int level = 0;
+        std::memcpy(&level, &data[levelsOffset + i * sizeof(int)], sizeof(level));
+
+        std::uint32_t count = 0;
+        std::memcpy(&count, &data[upperOffset], sizeof(count));
+
+        if (level > 0 && count > 0)
+        {
+            checkCorrupt<std::uint32_t>(data, upperOffset + 4, lowPoint);
+            break;
+        }
+
+        upperOffset += level * (graph.getM() + 1) * 4;
+    }
+
+    // A truncated stream is rejected.
+    std::stringstream truncated(data.substr(0, data.size() / 2));
+    OFX_CHECK(!loaded.load(truncated));
+
+    // An empty graph finds nothing.
+    Graph empty;
+    Graph::SearchResults results;
+    empty.findNClosestPoints(queries[0], 10, results);
+    OFX_CHECK(results.empty());
+
+    return ofx::test::report("test_hnsw");
+}
@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/KDForest.h"
+#include "Test.h"
+
+
+// Checks KDForest searches against a brute force search. Unlimited checks
+// must be exact and the default checks must reach a reasonable recall.
+
+
+typedef std::array<float, 16> Point;
+typedef ofx::KDForest<Point> Forest;
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 16>(10000, 1);
+    const auto queries = ofx::test::randomPoints<float, 16>(100, 2);
+
+    Forest forest(points);
+    OFX_CHECK(forest.getNumTrees() == Forest::DEFAULT_NUM_TREES);
+
+    // With unlimited checks the forest is exact.
+    forest.setChecks(0);
+    ofx::test::checkSearches(forest, points, queries, 10, 800);
+
+    // With limited checks results are approximate but must be valid.
+    forest.setChecks(Forest::DEFAULT_CHECKS);
+
+    double totalRecall = 0;
+
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query);
+
+        Forest::SearchResults results;
+        forest.findNClosestPoints(query, 10, results);
+
+        OFX_CHECK(results.size() == 10);
+        OFX_CHECK(ofx::test::isSorted(results));
+
+        for (const auto& result: results)
+        {
+            OFX_CHECK(ofx::test::nearlyEqual(result.second, ofx::test::distanceSquared(points[result.first], query)));
+        }
+
+        totalRecall += ofx::test::recall(expected, 10, results);
+
+        // Approximate radius results are a subset of the exact results.
+        forest.findPointsWithinRadius(query, 800, results);
+
+        for (const auto& result: results)
+        {
+            OFX_CHECK(result.second <= 800.0 * 800.0 * (1 + 1e-4));
+        }
+    }
+
+    const double averageRecall = totalRecall / queries.size();
+    std::printf("Recall with %d checks: %f\n", forest.getChecks(), averageRecall);
+    OFX_CHECK(averageRecall > 0.3);
+
+    // Searches keep going past the checks until k points are found, so more
+    // points than checks are visited.
+    forest.setChecks(16);
+
+    for (std::size_t numPointsToFind: { 100, 2000 })
+    {
+        Forest::SearchResults results;
+        forest.findNClosestPoints(queries[0], numPointsToFind, results);
+
+        OFX_CHECK(results.size() == numPointsToFind);
+        OFX_CHECK(ofx::test::isSorted(results));
+
+        std::vector<bool> found(points.size(), false);
+
+        for (const auto& result: results)
+        {
+            OFX_CHECK(!found[result.first]);
+            found[result.first] = true;
+        }
+    }
+
+    return ofx::test::report("test_kdforest");
+}
@@ -0,0 +1,357 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/KDTree.h"
+#include "Test.h"
+
+
+// Checks every KDTree search path against a brute force search.
+
+
+enum
+{
+    NUM_POINTS = 20000,
+    NUM_QUERIES = 100,
+    NUM_NEAREST = 12
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::KDTree<Point> Tree;
+
+
+/// \brief Check the unfiltered searches.
+void testSearches(const Tree& tree,
+                  const std::vector<Point>& points,
+                  const std::vector<Point>& queries)
+{
+    const float radius = 60;
+
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query);
+
+        Tree::Indicies indices;
+        Tree::DistancesSquared distancesSquared;
+        tree.findNClosestPoints(query, NUM_NEAREST, indices, distancesSquared);
+
+        Tree::SearchResults results(indices.size());
+
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            results[i] = std::make_pair(indices[i], distancesSquared[i]);
+        }
+
+        ofx::test::checkNearest(points, query, expected, NUM_NEAREST, results);
+
+        tree.findNClosestPoints(query, NUM_NEAREST, results);
+        ofx::test::checkNearest(points, query, expected, NUM_NEAREST, results);
+
+        tree.findPointsWithinRadius(query, radius, results);
+        OFX_CHECK(ofx::test::isSorted(results));
+        ofx::test::checkRadius(points, query, expected, radius, results);
+
+        tree.findPointsWithinRadius(query, radius, results, 0, false);
+        ofx::test::checkRadius(points, query, expected, radius, results);
+
+        // Capped radius searches keep the N closest points within the radius.
+        tree.findNClosestPointsWithinRadius(query, NUM_NEAREST, radius, results);
+
+        std::vector<ofx::test::Result> capped;
+
+        for (const auto& result: expected)
+        {
+            if (result.second < double(radius) * radius && capped.size() < NUM_NEAREST)
+            {
+                capped.push_back(result);
+            }
+        }
+
+        OFX_CHECK(ofx::test::isSorted(results));
+        OFX_CHECK(results.size() == capped.size());
+
+        for (std::size_t i = 0; i < std::min(results.size(), capped.size()); ++i)
+        {
+            OFX_CHECK(ofx::test::nearlyEqual(results[i].second, capped[i].second));
+        }
+
+        // The density estimate is exact for a radius covering every point.
+        OFX_CHECK(tree.estimateRadiusResultCount(query, 1e6f) == points.size());
+    }
+}
+
+
+/// \brief Check the predicate and mask filtered searches.
+void testFiltered(const Tree& tree,
+                  const std::vector<Point>& points,
+                  const std::vector<Point>& queries)
+{
+    const float radius = 60;
+
+    std::vector<bool> mask(points.size());
+
+    for (std::size_t i = 0; i < mask.size(); ++i)
+    {
+        mask[i] = (i % 3) != 0;
+    }
+
+    const auto predicate = [&mask](std::size_t index) { return mask[index]; };
+
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query, predicate);
+
+        Tree::SearchResults results;
+
+        tree.findNClosestPoints(query, NUM_NEAREST, results, mask);
+        ofx::test::checkNearest(points, query, expected, NUM_NEAREST, results);
+
+        tree.findNClosestPoints(query, NUM_NEAREST, results, predicate);
+        ofx::test::checkNearest(points, query, expected, NUM_NEAREST, results);
+
+        tree.findPointsWithinRadius(query, radius, results, mask);
+        ofx::test::checkRadius(points, query, expected, radius, results);
+
+        tree.findPointsWithinRadius(query, radius, results, predicate);
+        ofx::test::checkRadius(points, query, expected, radius, results);
+    }
+
+    // A predicate rejecting every point finds nothing.
+    Tree::SearchResults results;
+    OFX_CHECK(tree.findNClosestPoints(queries[0], NUM_NEAREST, results, [](std::size_t) { return false; }) == 0);
+    OFX_CHECK(results.empty());
+}
+
+
+/// \brief Check the incremental nearest neighbor iterator.
+void testIterator(const Tree& tree,
+                  const std::vector<Point>& points,
+                  const std::vector<Point>& queries)
+{
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query);
+
+        auto iterator = tree.nearestNeighbors(query);
+
+        Tree::SearchResults results;
+        Tree::IndexDistanceSquaredPair result;
+
+        while (results.size() < 100 && iterator.next(result))
+        {
+            results.push_back(result);
+        }
+
+        ofx::test::checkNearest(points, query, expected, 100, results);
+    }
+
+    // The iterator yields every point exactly once.
+    auto iterator = tree.nearestNeighbors(queries[0]);
+
+    Tree::SearchResults results;
+    Tree::IndexDistanceSquaredPair result;
+
+    while (iterator.next(result))
+    {
+        results.push_back(result);
+    }
+
+    OFX_CHECK(results.size() == points.size());
+    OFX_CHECK(ofx::test::isSorted(results));
+}
+
+
+/// \brief Check warm started searches along a path of nearby queries.
+void testWarmStart(const Tree& tree, const std::vector<Point>& points)
+{
+    Tree::WarmStartQuery query(tree, NUM_NEAREST);
+
+    Point point = {{ 100, 100, 100 }};
+
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        point[0] += 3;
+        point[1] += 2;
+        point[2] += 1;
+
+        Tree::SearchResults results;
+        query.findNClosestPoints(point, results);
+        ofx::test::checkNearest(points, point, ofx::test::bruteForce(points, point), NUM_NEAREST, results);
+    }
+
+    // A large jump must not return stale neighbors.
+    point = {{ 900, 50, 700 }};
+
+    Tree::SearchResults results;
+    query.findNClosestPoints(point, results);
+    ofx::test::checkNearest(points, point, ofx::test::bruteForce(points, point), NUM_NEAREST, results);
+
+    query.setNumPointsToFind(NUM_NEAREST * 2);
+    query.findNClosestPoints(point, results);
+    ofx::test::checkNearest(points, point, ofx::test::bruteForce(points, point), NUM_NEAREST * 2, results);
+}
+
+
+/// \brief Check that the tree statistics describe a consistent tree.
+void testStats(const Tree& tree, std::size_t maxLeafSize)
+{
+    const Tree::TreeStats stats = tree.stats();
+
+    OFX_CHECK(stats.numPoints == NUM_POINTS);
+    OFX_CHECK(stats.numLeaves > 0);
+    OFX_CHECK(stats.numNodes >= stats.numLeaves);
+    OFX_CHECK(stats.minDepth <= stats.maxDepth);
+    OFX_CHECK(stats.averageDepth >= stats.minDepth);
+    OFX_CHECK(stats.averageDepth <= stats.maxDepth);
+    OFX_CHECK(stats.leafSizeHistogram.size() - 1 <= maxLeafSize);
+    OFX_CHECK(stats.emptySpaceRatio >= 0 && stats.emptySpaceRatio <= 1);
+    OFX_CHECK(stats.poolBytes > 0);
+    OFX_CHECK(stats.indexBytes >= NUM_POINTS * sizeof(std::size_t));
+
+    std::size_t numLeaves = 0;
+    std::size_t numPoints = 0;
+
+    for (std::size_t count = 0; count < stats.leafSizeHistogram.size(); ++count)
+    {
+        numLeaves += stats.leafSizeHistogram[count];
+        numPoints += count * stats.leafSizeHistogram[count];
+    }
+
+    OFX_CHECK(numLeaves == stats.numLeaves);
+    OFX_CHECK(numPoints == stats.numPoints);
+}
+
+
+/// \brief Check that autotuning picks a candidate and leaves a working index.
+void testAutotune(const std::vector<Point>& points,
+                  const std::vector<Point>& queries)
+{
+    Tree::AutotuneSettings settings;
+    settings.leafSizes = { 1, 4, 16, 32 };
+    settings.maxSamplePoints = 5000;
+    settings.maxSampleQueries = 50;
+    settings.radius = 60;
+    settings.numRepetitions = 1;
+
+    Tree tree(points);
+
+    const Tree::AutotuneResult result = tree.autotune(queries, settings);
+
+    const auto isCandidate = [&settings](std::size_t leafSize)
+    {
+        return std::find(settings.leafSizes.begin(), settings.leafSizes.end(), leafSize) != settings.leafSizes.end();
+    };
+
+    OFX_CHECK(isCandidate(result.params.leaf_max_size));
+    OFX_CHECK(result.measurements.size() == settings.leafSizes.size());
+
+    for (std::size_t i = 0; i < std::min(result.measurements.size(), settings.leafSizes.size()); ++i)
+    {
+        OFX_CHECK(result.measurements[i].leafSize == settings.leafSizes[i]);
+        OFX_CHECK(result.measurements[i].buildSeconds >= 0);
+        OFX_CHECK(result.measurements[i].querySeconds >= 0);
+        OFX_CHECK(result.measurements[i].cost >= 0);
+    }
+
+    // autotune() leaves the index unchanged.
+    OFX_CHECK(tree.getParams().leaf_max_size == Tree::DEFAULT_MAX_LEAF_SIZE);
+
+    // autotuneIndex() rebuilds the tree with the chosen leaf size.
+    const Tree::KDTreeParams params = tree.autotuneIndex(queries, settings);
+
+    OFX_CHECK(isCandidate(params.leaf_max_size));
+    OFX_CHECK(tree.getParams().leaf_max_size == params.leaf_max_size);
+    OFX_CHECK(!tree.isBruteForce());
+
+    const Tree::TreeStats stats = tree.stats();
+    OFX_CHECK(!stats.leafSizeHistogram.empty());
+    OFX_CHECK(stats.leafSizeHistogram.size() - 1 <= params.leaf_max_size);
+
+    testSearches(tree, points, queries);
+
+    // Without candidates the current parameters are kept.
+    settings.leafSizes.clear();
+    const Tree::AutotuneResult empty = tree.autotune(queries, settings);
+    OFX_CHECK(empty.params.leaf_max_size == params.leaf_max_size);
+    OFX_CHECK(empty.measurements.empty());
+}
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 2);
+
+    Tree tree(points);
+    OFX_CHECK(!tree.isBruteForce());
+
+    testSearches(tree, points, queries);
+    testFiltered(tree, points, queries);
+    testIterator(tree, points, queries);
+    testWarmStart(tree, points);
+    testStats(tree, Tree::DEFAULT_MAX_LEAF_SIZE);
+    testAutotune(points, queries);
+
+    // The brute force backend must agree with the tree.
+    Tree bruteForceTree(points, Tree::DEFAULT_MAX_LEAF_SIZE, false);
+    bruteForceTree.setSearchBackend(Tree::SEARCH_BACKEND_BRUTE_FORCE);
+    bruteForceTree.buildIndex();
+    OFX_CHECK(bruteForceTree.isBruteForce());
+
+    testSearches(bruteForceTree, points, queries);
+    testFiltered(bruteForceTree, points, queries);
+
+    // A linear scan has no tree to describe.
+    const Tree::TreeStats bruteForceStats = bruteForceTree.stats();
+    OFX_CHECK(bruteForceStats.numPoints == NUM_POINTS);
+    OFX_CHECK(bruteForceStats.numNodes == 0);
+    OFX_CHECK(bruteForceStats.numLeaves == 0);
+    OFX_CHECK(bruteForceStats.leafSizeHistogram.empty());
+    OFX_CHECK(bruteForceStats.poolBytes == 0);
+
+    // Small point sets, leaf sizes and duplicates, for both backends. These
+    // are below the brute force threshold, so the tree must be forced.
+    for (std::size_t count: { 1, 2, 7, 64 })
+    {
+        std::vector<Point> small = ofx::test::randomPoints<float, 3>(count, 3);
+        small.insert(small.end(), small.begin(), small.end());
+
+        for (Tree::SearchBackend backend: { Tree::SEARCH_BACKEND_TREE, Tree::SEARCH_BACKEND_BRUTE_FORCE })
+        {
+            Tree smallTree(small, 1, false);
+            smallTree.setSearchBackend(backend);
+            smallTree.buildIndex();
+            OFX_CHECK(smallTree.isBruteForce() == (backend == Tree::SEARCH_BACKEND_BRUTE_FORCE));
+
+            testSearches(smallTree, small, queries);
+            testFiltered(smallTree, small, queries);
+            testIterator(smallTree, small, queries);
+        }
+    }
+
+    // Searches in higher dimensions.
+    typedef std::array<float, 8> Point8;
+
+    const auto points8 = ofx::test::randomPoints<float, 8>(5000, 4);
+    const auto queries8 = ofx::test::randomPoints<float, 8>(50, 5);
+
+    ofx::KDTree<Point8> tree8(points8);
+
+    for (const Point8& query: queries8)
+    {
+        const auto expected = ofx::test::bruteForce(points8, query);
+
+        ofx::KDTree<Point8>::SearchResults results;
+        tree8.findNClosestPoints(query, NUM_NEAREST, results);
+        ofx::test::checkNearest(points8, query, expected, NUM_NEAREST, results);
+
+        tree8.findPointsWithinRadius(query, 300, results);
+        ofx::test::checkRadius(points8, query, expected, 300, results);
+    }
+
+    return ofx::test::report("test_kdtree");
+}
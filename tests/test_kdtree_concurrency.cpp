@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <atomic>
+#include <thread>
+#include "ofx/KDTree.h"
+#include "ofx/Parallel.h"
+#include "Test.h"
+
+
+// Queries one const KDTree from many threads at once, and compares every
+// result with the result of the same query computed on a single thread
+// beforehand.
+
+
+enum
+{
+    NUM_POINTS = 50000,
+    NUM_QUERIES = 2000,
+    NUM_ROUNDS = 2,
+    NUM_NEAREST = 16
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::KDTree<Point> Tree;
+
+
+/// \brief The reference results of one query.
+struct Expected
+{
+    Tree::SearchResults nearest;
+    Tree::SearchResults radius;
+    Tree::SearchResults filtered;
+};
+
+
+/// \brief Run every query kind for one point.
+void runQuery(const Tree& tree,
+              const Point& query,
+              float radius,
+              const std::vector<bool>& mask,
+              Expected& results)
+{
+    tree.findNClosestPoints(query, NUM_NEAREST, results.nearest);
+    tree.findPointsWithinRadius(query, radius, results.radius);
+    tree.findNClosestPoints(query, NUM_NEAREST, results.filtered, mask);
+}
+
+
+/// \brief Query the tree from many threads and count mismatched results.
+/// \returns the number of mismatched queries.
+std::size_t runConcurrent(const Tree& tree,
+                          const std::vector<Point>& queries,
+                          float radius,
+                          const std::vector<bool>& mask,
+                          const std::vector<Expected>& expected,
+                          std::size_t numThreads)
+{
+    std::atomic<std::size_t> mismatches(0);
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            // Each thread visits the queries in its own order.
+            std::vector<std::size_t> order(queries.size());
+
+            for (std::size_t i = 0; i < order.size(); ++i)
+            {
+                order[i] = i;
+            }
+
+            std::mt19937 random(static_cast<std::mt19937::result_type>(t));
+
+            Expected results;
+
+            for (std::size_t round = 0; round < NUM_ROUNDS; ++round)
+            {
+                std::shuffle(order.begin(), order.end(), random);
+
+                for (std::size_t i: order)
+                {
+                    runQuery(tree, queries[i], radius, mask, results);
+
+                    if (results.nearest != expected[i].nearest
+                    ||  results.radius != expected[i].radius
+                    ||  results.filtered != expected[i].filtered)
+                    {
+                        ++mismatches;
+                    }
+                }
+            }
+        }));
+    }
+
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    return mismatches;
+}
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 42);
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 43);
+
+    // Hide every third point from the filtered queries.
+    std::vector<bool> mask(NUM_POINTS);
+
+    for (std::size_t i = 0; i < mask.size(); ++i)
+    {
+        mask[i] = (i % 3) != 0;
+    }
+
+    const float radius = 40;
+
+    const Tree tree(points);
+
+    // Compute the reference results on a single thread.
+    std::vector<Expected> expected(queries.size());
+
+    for (std::size_t i = 0; i < queries.size(); ++i)
+    {
+        runQuery(tree, queries[i], radius, mask, expected[i]);
+    }
+
+    // Spot check the reference results themselves.
+    for (std::size_t i = 0; i < queries.size(); i += 100)
+    {
+        const auto all = ofx::test::bruteForce(points, queries[i]);
+        ofx::test::checkNearest(points, queries[i], all, NUM_NEAREST, expected[i].nearest);
+        ofx::test::checkRadius(points, queries[i], all, radius, expected[i].radius);
+    }
+
+    const std::size_t maxThreads = std::max(static_cast<std::size_t>(4), 2 * ofx::HardwareThreadCount());
+
+    for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        const std::size_t mismatches = runConcurrent(tree, queries, radius, mask, expected, numThreads);
+
+        std::printf("%zu threads: %zu mismatches\n", numThreads, mismatches);
+
+        OFX_CHECK(mismatches == 0);
+    }
+
+    return ofx::test::report("test_kdtree_concurrency");
+}
@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#ifndef OFX_SPATIAL_HASH_ENABLE_STATS
+#error "test_kdtree_stats must be built with OFX_SPATIAL_HASH_ENABLE_STATS."
+#endif
+
+
+#include <thread>
+#include "ofx/KDTree.h"
+#include "Test.h"
+
+
+// Checks the KDTree search counters gathered when
+// OFX_SPATIAL_HASH_ENABLE_STATS is defined, for the tree and brute force
+// backends, and that each thread keeps its own counters.
+
+
+enum
+{
+    NUM_POINTS = 20000,
+    NUM_QUERIES = 200,
+    NUM_NEAREST = 16
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::KDTree<Point> Tree;
+
+
+/// \brief Check the counters of one tree search with the given results.
+void checkTreeSearch(const Tree::SearchResults& results)
+{
+    const ofx::SearchStats& stats = ofx::lastSearchStats();
+
+    OFX_CHECK(stats.queries == 1);
+    OFX_CHECK(stats.nodesVisited > 0);
+    OFX_CHECK(stats.leavesVisited > 0);
+    OFX_CHECK(stats.leavesVisited <= stats.nodesVisited);
+    OFX_CHECK(stats.distanceEvaluations >= results.size());
+    OFX_CHECK(stats.distanceEvaluations < NUM_POINTS);
+    OFX_CHECK(stats.resultInsertions >= results.size());
+    OFX_CHECK(stats.resultInsertions <= stats.distanceEvaluations);
+}
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 2);
+
+    Tree tree(points);
+    Tree::SearchResults results;
+
+    // Tree searches visit nodes and count every point offered to the results.
+    ofx::resetThreadSearchStats();
+
+    ofx::SearchStats total;
+
+    for (const auto& query: queries)
+    {
+        tree.findNClosestPoints(query, NUM_NEAREST, results);
+        OFX_CHECK(results.size() == NUM_NEAREST);
+        checkTreeSearch(results);
+        total += ofx::lastSearchStats();
+
+        tree.findPointsWithinRadius(query, 50, results);
+        checkTreeSearch(results);
+        total += ofx::lastSearchStats();
+    }
+
+    const ofx::SearchStats& threadStats = ofx::threadSearchStats();
+
+    OFX_CHECK(threadStats.queries == 2 * NUM_QUERIES);
+    OFX_CHECK(threadStats.nodesVisited == total.nodesVisited);
+    OFX_CHECK(threadStats.leavesVisited == total.leavesVisited);
+    OFX_CHECK(threadStats.distanceEvaluations == total.distanceEvaluations);
+    OFX_CHECK(threadStats.prunedSubtrees == total.prunedSubtrees);
+    OFX_CHECK(threadStats.resultInsertions == total.resultInsertions);
+
+    // A brute force scan evaluates every point and visits no nodes.
+    Tree bruteForceTree(points, Tree::DEFAULT_MAX_LEAF_SIZE, false);
+    bruteForceTree.setSearchBackend(Tree::SEARCH_BACKEND_BRUTE_FORCE);
+    bruteForceTree.buildIndex();
+
+    for (const auto& query: queries)
+    {
+        bruteForceTree.findNClosestPoints(query, NUM_NEAREST, results);
+
+        const ofx::SearchStats& stats = ofx::lastSearchStats();
+
+        OFX_CHECK(stats.queries == 1);
+        OFX_CHECK(stats.distanceEvaluations == NUM_POINTS);
+        OFX_CHECK(stats.nodesVisited == 0);
+        OFX_CHECK(stats.resultInsertions >= results.size());
+    }
+
+    OFX_CHECK(ofx::threadSearchStats().queries == 3 * NUM_QUERIES);
+
+    // Searches on another thread count only on that thread.
+    const ofx::SearchStats before = ofx::threadSearchStats();
+    const ofx::SearchStats beforeLast = ofx::lastSearchStats();
+
+    ofx::SearchStats otherStats;
+    ofx::SearchStats otherStartStats;
+
+    std::thread other([&]()
+    {
+        otherStartStats = ofx::threadSearchStats();
+
+        Tree::SearchResults otherResults;
+
+        for (const auto& query: queries)
+        {
+            tree.findNClosestPoints(query, NUM_NEAREST, otherResults);
+        }
+
+        otherStats = ofx::threadSearchStats();
+    });
+
+    other.join();
+
+    OFX_CHECK(otherStartStats.queries == 0);
+    OFX_CHECK(otherStats.queries == NUM_QUERIES);
+    OFX_CHECK(otherStats.nodesVisited > 0);
+
+    OFX_CHECK(ofx::threadSearchStats().queries == before.queries);
+    OFX_CHECK(ofx::threadSearchStats().nodesVisited == before.nodesVisited);
+    OFX_CHECK(ofx::threadSearchStats().distanceEvaluations == before.distanceEvaluations);
+    OFX_CHECK(ofx::lastSearchStats().distanceEvaluations == beforeLast.distanceEvaluations);
+
+    // Resetting clears only the calling thread's aggregate.
+    ofx::resetThreadSearchStats();
+    OFX_CHECK(ofx::threadSearchStats().queries == 0);
+    OFX_CHECK(ofx::threadSearchStats().nodesVisited == 0);
+
+    return ofx::test::report("test_kdtree_stats");
+}
@@ -0,0 +1,47 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/LinearBVH.h"
+#include "Test.h"
+
+
+// Checks LinearBVH searches against a brute force search.
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(20000, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(100, 2);
+
+    for (std::size_t maxLeafSize: { 1, 4, 32 })
+    {
+        ofx::LinearBVH<std::array<float, 3>> bvh(points, maxLeafSize);
+        ofx::test::checkSearches(bvh, points, queries, 12, 60);
+    }
+
+    // Duplicate points share a Morton code.
+    std::vector<std::array<float, 3>> duplicates(500, std::array<float, 3>{{ 5, 5, 5 }});
+    duplicates.push_back({{ 6, 5, 5 }});
+
+    ofx::LinearBVH<std::array<float, 3>> bvh(duplicates, 4);
+    ofx::test::checkSearches(bvh, duplicates, queries, 12, 1000);
+
+    const auto points2 = ofx::test::randomPoints<float, 2>(10000, 3);
+    const auto queries2 = ofx::test::randomPoints<float, 2>(100, 4);
+
+    ofx::LinearBVH<std::array<float, 2>> bvh2(points2);
+    ofx::test::checkSearches(bvh2, points2, queries2, 12, 40);
+
+    // Vectors with more dimensions than bits in a Morton code.
+    const auto points100 = ofx::test::randomPoints<float, 100>(2000, 5);
+    const auto queries100 = ofx::test::randomPoints<float, 100>(20, 6);
+
+    ofx::LinearBVH<std::array<float, 100>> bvh100(points100);
+    ofx::test::checkSearches(bvh100, points100, queries100, 12, 2500);
+
+    return ofx::test::report("test_linear_bvh");
+}
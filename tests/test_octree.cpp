@@ -0,0 +1,40 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/Octree.h"
+#include "Test.h"
+
+
+// Checks Octree searches against a brute force search.
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(20000, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(100, 2);
+
+    for (std::size_t maxBucketSize: { 1, 16, 64 })
+    {
+        ofx::Octree<std::array<float, 3>> octree(points, maxBucketSize);
+        ofx::test::checkSearches(octree, points, queries, 12, 60);
+    }
+
+    // Duplicate points stop splitting at the maximum depth.
+    std::vector<std::array<float, 3>> duplicates(500, std::array<float, 3>{{ 5, 5, 5 }});
+    duplicates.push_back({{ 6, 5, 5 }});
+
+    ofx::Octree<std::array<float, 3>> octree(duplicates, 4);
+    ofx::test::checkSearches(octree, duplicates, queries, 12, 1000);
+
+    const auto points2 = ofx::test::randomPoints<float, 2>(10000, 3);
+    const auto queries2 = ofx::test::randomPoints<float, 2>(100, 4);
+
+    ofx::Octree<std::array<float, 2>> quadtree(points2);
+    ofx::test::checkSearches(quadtree, points2, queries2, 12, 40);
+
+    return ofx::test::report("test_octree");
+}
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "ofx/OutOfCoreIndex.h"
+#include "Test.h"
+
+
+// Checks OutOfCoreIndex searches against a brute force search, with a memory
+// budget small enough to force an external merge of several runs, and checks
+// that corrupt index files are rejected.
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::OutOfCoreIndex<Point> Index;
+
+
+/// \brief Read a whole file.
+std::vector<char> readFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+
+/// \brief Write a whole file.
+void writeFile(const std::string& path, const std::vector<char>& data, std::size_t size)
+{
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(data.data(), 1, size, file);
+    std::fclose(file);
+}
+
+
+/// \brief Read a 64 bit value of an index file.
+std::uint64_t readValue(const std::vector<char>& data, std::size_t offset)
+{
+    std::uint64_t value = 0;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+
+/// \brief Check that an index file with a 64 bit value replaced is rejected.
+void checkCorrupt(const std::vector<char>& data, std::size_t offset, std::uint64_t value)
+{
+    std::vector<char> corrupt = data;
+    std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+    writeFile("test_out_of_core_index.corrupt", corrupt, corrupt.size());
+
+    Index index;
+    OFX_CHECK(!index.open("test_out_of_core_index.corrupt"));
+    OFX_CHECK(!index.isOpen());
+
+    std::remove("test_out_of_core_index.corrupt");
+}
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 3>(50000, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(100, 2);
+
+    const std::string pointsPath = "test_out_of_core_index.points";
+    const std::string indexPath = "test_out_of_core_index.index";
+
+    OFX_CHECK(Index::writePoints(pointsPath, points));
+
+    for (std::size_t memoryBudget: { 1 << 16, 64 << 20 })
+    {
+        Index index;
+        OFX_CHECK(index.buildIndex(pointsPath, indexPath, Index::DEFAULT_MAX_LEAF_SIZE, memoryBudget));
+        OFX_CHECK(index.isOpen());
+        OFX_CHECK(index.size() == points.size());
+
+        ofx::test::checkSearches(index, points, queries, 12, 60);
+    }
+
+    // Small leaves and a reopened index.
+    OFX_CHECK(Index::build(pointsPath, indexPath, 4));
+
+    Index index(indexPath);
+    OFX_CHECK(index.isOpen());
+    OFX_CHECK(index.getMaxLeafSize() == 4);
+    ofx::test::checkSearches(index, points, queries, 12, 60);
+
+    // Corrupt headers and nodes are rejected. The header holds the leaf
+    // size, point count, node count and the node, point and index offsets
+    // as 64 bit values from byte 24, and each node holds its first and last
+    // leaf after its bounds.
+    const std::vector<char> data = readFile(indexPath);
+    const std::uint64_t numNodes = readValue(data, 40);
+    const std::uint64_t nodesOffset = readValue(data, 48);
+    const std::uint64_t pointsOffset = readValue(data, 56);
+    const std::uint64_t indicesOffset = readValue(data, 64);
+    const std::size_t nodeSize = (pointsOffset - nodesOffset) / numNodes;
+    const std::size_t leafOffset = nodesOffset + 6 * sizeof(float);
+
+    OFX_CHECK(nodeSize >= leafOffset - nodesOffset + 16);
+
+    checkCorrupt(data, 56, indicesOffset + 4096);
+    checkCorrupt(data, 56, 0);
+    checkCorrupt(data, 64, pointsOffset);
+    checkCorrupt(data, 64, std::uint64_t(1) << 62);
+    checkCorrupt(data, 48, pointsOffset);
+    checkCorrupt(data, 48, nodesOffset + 4);
+    checkCorrupt(data, 32, std::uint64_t(1) << 62);
+    checkCorrupt(data, leafOffset, 1);
+    checkCorrupt(data, leafOffset + 8, readValue(data, leafOffset + 8) + 1);
+    checkCorrupt(data, leafOffset + nodeSize + 8, std::uint64_t(1) << 62);
+
+    {
+        // Huge consistent point and node counts must not overflow the
+        // section size checks.
+        std::vector<char> corrupt = data;
+        const std::uint64_t hugePoints = std::uint64_t(1) << 62;
+        const std::uint64_t hugeNodes = hugePoints / 2 - 1;
+        std::memcpy(corrupt.data() + 32, &hugePoints, sizeof(hugePoints));
+        checkCorrupt(corrupt, 40, hugeNodes);
+    }
+
+    // Truncated index files are rejected.
+    writeFile(indexPath, data, data.size() / 2);
+
+    OFX_CHECK(!index.open(indexPath));
+    OFX_CHECK(!index.isOpen());
+    OFX_CHECK(!index.open("missing.index"));
+
+#ifdef __linux__
+    // Writes that only fail when the stream is flushed are reported.
+    const std::vector<Point> single(1, points[0]);
+
+    OFX_CHECK(!Index::writePoints("/dev/full", single));
+    OFX_CHECK(Index::writePoints(pointsPath, single));
+    OFX_CHECK(!Index::build(pointsPath, "/dev/full"));
+#endif
+
+    // An empty index.
+    OFX_CHECK(Index::writePoints(pointsPath, std::vector<Point>()));
+    OFX_CHECK(index.buildIndex(pointsPath, indexPath));
+    OFX_CHECK(index.isOpen());
+    OFX_CHECK(index.size() == 0);
+
+    // Vectors with more dimensions than bits in a Morton code.
+    typedef std::array<float, 100> Point100;
+    typedef ofx::OutOfCoreIndex<Point100> Index100;
+
+    const auto points100 = ofx::test::randomPoints<float, 100>(2000, 3);
+    const auto queries100 = ofx::test::randomPoints<float, 100>(20, 4);
+
+    OFX_CHECK(Index100::writePoints(pointsPath, points100));
+
+    Index100 index100;
+    OFX_CHECK(index100.buildIndex(pointsPath, indexPath, 8));
+    OFX_CHECK(index100.size() == points100.size());
+    ofx::test::checkSearches(index100, points100, queries100, 12, 2500);
+
+    std::remove(pointsPath.c_str());
+    std::remove(indexPath.c_str());
+
+    return ofx::test::report("test_out_of_core_index");
+}
@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "ofx/OutOfCoreIndex.h"
+#include "ofx/PointCloudLoader.h"
+#include "Test.h"
+
+
+// Writes the same points as ASCII and binary PLY, XYZ and raw binary files
+// and checks that every loader reads them back, with blocks small enough to
+// split each file many times.
+
+
+enum
+{
+    NUM_POINTS = 20000
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::PointCloudLoader<Point> Loader;
+
+
+/// \brief Write a value with the given byte order.
+template <typename Type>
+void writeValue(std::ostream& stream, Type value, bool bigEndian)
+{
+    char bytes[sizeof(Type)];
+    std::memcpy(bytes, &value, sizeof(Type));
+
+    const std::uint16_t one = 1;
+    const bool littleEndian = *reinterpret_cast<const std::uint8_t*>(&one) == 1;
+
+    if (littleEndian == bigEndian)
+    {
+        std::reverse(bytes, bytes + sizeof(Type));
+    }
+
+    stream.write(bytes, sizeof(Type));
+}
+
+
+/// \brief Write an ASCII PLY file with a face element before the vertices.
+void writeAsciiPLY(const std::string& path, const std::vector<Point>& points)
+{
+    std::ofstream stream(path, std::ios::binary);
+    stream << "ply\nformat ascii 1.0\ncomment a test file\n";
+    stream << "element face 2\nproperty list uchar int vertex_indices\n";
+    stream << "element vertex " << points.size() << "\n";
+    stream << "property float y\nproperty uchar red\nproperty float x\nproperty float z\n";
+    stream << "end_header\n";
+    stream << "3 0 1 2\n3 1 2 3\n";
+    stream.precision(9);
+
+    for (const Point& point: points)
+    {
+        stream << point[1] << " 255 " << point[0] << " " << point[2] << "\n";
+    }
+}
+
+
+/// \brief Write a binary PLY file with double coordinates and an extra property.
+void writeBinaryPLY(const std::string& path, const std::vector<Point>& points, bool bigEndian)
+{
+    std::ofstream stream(path, std::ios::binary);
+    stream << "ply\nformat " << (bigEndian ? "binary_big_endian" : "binary_little_endian") << " 1.0\n";
+    stream << "element vertex " << points.size() << "\n";
+    stream << "property double x\nproperty double y\nproperty ushort intensity\nproperty double z\n";
+    stream << "end_header\n";
+
+    for (const Point& point: points)
+    {
+        writeValue<double>(stream, point[0], bigEndian);
+        writeValue<double>(stream, point[1], bigEndian);
+        writeValue<std::uint16_t>(stream, 7, bigEndian);
+        writeValue<double>(stream, point[2], bigEndian);
+    }
+}
+
+
+/// \brief Write an XYZ file with comments, a header and mixed separators.
+void writeXYZ(const std::string& path, const std::vector<Point>& points)
+{
+    std::ofstream stream(path, std::ios::binary);
+    stream << "# a test file\nx,y,z,intensity\n";
+    stream.precision(9);
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        const Point& point = points[i];
+
+        if (i % 2 == 0)
+        {
+            stream << point[0] << "," << point[1] << "," << point[2] << ",1\n";
+        }
+        else
+        {
+            stream << point[0] << "\t" << point[1] << "  " << point[2] << "\r\n";
+        }
+    }
+}
+
+
+/// \brief Load a file and compare it with the points.
+void checkLoad(const std::string& path,
+               const std::vector<Point>& points,
+               Loader::Format format = Loader::FORMAT_AUTO)
+{
+    for (std::size_t blockSize: { 4096, 64 * 1024 * 1024 })
+    {
+        Loader::LoadSettings settings;
+        settings.blockSize = blockSize;
+        settings.maxThreads = 4;
+
+        // Blocks are reported in order and cover every point once.
+        std::size_t next = 0;
+        bool isOrdered = true;
+
+        settings.onBlockLoaded = [&](std::size_t first, std::size_t last)
+        {
+            isOrdered = isOrdered && first == next && last > first;
+            next = last;
+        };
+
+        std::vector<Point> loaded;
+
+        if (!OFX_CHECK(Loader::load(path, loaded, settings, format)))
+        {
+            std::printf("Could not load %s.\n", path.c_str());
+            continue;
+        }
+
+        OFX_CHECK(isOrdered);
+        OFX_CHECK(next == points.size());
+
+        if (OFX_CHECK(loaded.size() == points.size()))
+        {
+            for (std::size_t i = 0; i < points.size(); ++i)
+            {
+                for (std::size_t j = 0; j < 3; ++j)
+                {
+                    OFX_CHECK(std::abs(loaded[i][j] - points[i][j]) <= 1e-4f * std::max(1.0f, std::abs(points[i][j])));
+                }
+            }
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+
+int main()
+{
+    auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 1);
+
+    // Negative values and exponents.
+    for (std::size_t i = 0; i < points.size(); i += 7)
+    {
+        points[i][0] = -points[i][0];
+        points[i][1] *= 1e-6f;
+    }
+
+    writeAsciiPLY("test_ascii.ply", points);
+    checkLoad("test_ascii.ply", points);
+
+    writeBinaryPLY("test_little.ply", points, false);
+    checkLoad("test_little.ply", points);
+
+    writeBinaryPLY("test_big.ply", points, true);
+    checkLoad("test_big.ply", points);
+
+    writeXYZ("test_points.xyz", points);
+    checkLoad("test_points.xyz", points);
+
+    OFX_CHECK(ofx::OutOfCoreIndex<Point>::writePoints("test_points.bin", points));
+    checkLoad("test_points.bin", points, Loader::FORMAT_BINARY);
+
+    // Missing and malformed files fail and leave the points empty.
+    std::vector<Point> loaded(1);
+    OFX_CHECK(!Loader::load("missing.ply", loaded));
+    OFX_CHECK(loaded.empty());
+
+    {
+        std::ofstream stream("test_bad.ply", std::ios::binary);
+        stream << "ply\nformat ascii 1.0\nelement face 1\nproperty float x\nend_header\n1\n";
+    }
+
+    loaded.resize(1);
+    OFX_CHECK(!Loader::load("test_bad.ply", loaded));
+    OFX_CHECK(loaded.empty());
+    std::remove("test_bad.ply");
+
+    // Headers claiming more elements than the body holds fail before
+    // allocating, including counts whose byte size overflows.
+    const std::string truncatedHeaders[] =
+    {
+        "ply\nformat binary_little_endian 1.0\nelement vertex 4000000000000\n"
+        "property float x\nproperty float y\nproperty float z\nend_header\n",
+        "ply\nformat ascii 1.0\nelement vertex 4000000000000\n"
+        "property float x\nproperty float y\nproperty float z\nend_header\n",
+        "ply\nformat binary_little_endian 1.0\nelement face 2305843009213693953\nproperty double a\n"
+        "element vertex 1\nproperty float x\nproperty float y\nproperty float z\nend_header\n",
+        "ply\nformat binary_little_endian 1.0\nelement vertex 18446744073709551615\n"
+        "property double x\nproperty double y\nproperty double z\nend_header\n"
+    };
+
+    for (const auto& header: truncatedHeaders)
+    {
+        {
+            std::ofstream stream("test_truncated.ply", std::ios::binary);
+            stream << header << std::string(20, '\0');
+        }
+
+        loaded.resize(1);
+        OFX_CHECK(!Loader::load("test_truncated.ply", loaded));
+        OFX_CHECK(loaded.empty());
+        std::remove("test_truncated.ply");
+    }
+
+    return ofx::test::report("test_point_cloud_loader");
+}
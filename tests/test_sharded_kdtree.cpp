@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/ShardedKDTree.h"
+#include "Test.h"
+
+
+// Checks ShardedKDTree searches against a brute force search, before and
+// after a single shard is rebuilt.
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::ShardedKDTree<Point> Tree;
+
+
+int main()
+{
+    auto points = ofx::test::randomPoints<float, 3>(20000, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(100, 2);
+
+    for (std::size_t numShards: { 1, 3, 8 })
+    {
+        Tree tree(points, numShards);
+        OFX_CHECK(tree.getNumShards() == numShards);
+        ofx::test::checkSearches(tree, points, queries, 12, 60);
+    }
+
+    Tree tree(points, 4);
+
+    // Every point belongs to exactly one shard.
+    std::vector<std::size_t> counts(points.size(), 0);
+
+    for (std::size_t shard = 0; shard < tree.getNumShards(); ++shard)
+    {
+        for (auto index: tree.getShardIndices(shard))
+        {
+            ++counts[index];
+            OFX_CHECK(tree.getShardOfPoint(index) == shard);
+        }
+    }
+
+    OFX_CHECK(std::count(counts.begin(), counts.end(), 1) == std::ptrdiff_t(points.size()));
+
+    // Move the points of one shard slightly and rebuild only that shard.
+    for (auto index: tree.getShardIndices(2))
+    {
+        points[index][0] += 1;
+    }
+
+    tree.rebuildShard(2);
+    ofx::test::checkSearches(tree, points, queries, 12, 60);
+
+    return ofx::test::report("test_sharded_kdtree");
+}
@@ -0,0 +1,153 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <limits>
+#include <stdexcept>
+#include "ofx/SparseSpatialHash.h"
+#include "Test.h"
+
+
+// Checks SparseSpatialHash radius searches against a brute force search while
+// points are inserted, moved and removed.
+
+
+enum
+{
+    NUM_POINTS = 10000,
+    NUM_QUERIES = 50,
+    NUM_STEPS = 5
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::SparseSpatialHash<Point> Hash;
+
+
+/// \brief Check radius searches over the live points.
+void testSearches(const Hash& hash,
+                  const std::vector<Point>& points,
+                  const std::vector<bool>& live,
+                  const std::vector<Point>& queries)
+{
+    const auto isLive = [&live](std::size_t index) { return bool(live[index]); };
+
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query, isLive);
+
+        for (float radius: { 5.0f, 40.0f, 400.0f })
+        {
+            Hash::SearchResults results;
+            hash.findPointsWithinRadius(query, radius, results);
+            OFX_CHECK(ofx::test::isSorted(results));
+            ofx::test::checkRadius(points, query, expected, radius, results);
+
+            hash.findPointsWithinRadius(query, radius, results, 0, false);
+            ofx::test::checkRadius(points, query, expected, radius, results);
+        }
+    }
+}
+
+
+int main()
+{
+    auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 1);
+    const auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 2);
+
+    std::vector<bool> live(points.size(), true);
+
+    Hash hash(25);
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        hash.insert(i, points[i]);
+    }
+
+    OFX_CHECK(hash.size() == points.size());
+
+    testSearches(hash, points, live, queries);
+
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> step(-30, 30);
+    std::uniform_int_distribution<int> action(0, 9);
+
+    for (std::size_t s = 0; s < NUM_STEPS; ++s)
+    {
+        for (std::size_t i = 0; i < points.size(); ++i)
+        {
+            const int value = action(random);
+
+            if (value == 0)
+            {
+                // Toggle the point in or out of the hash.
+                if (live[i])
+                {
+                    hash.remove(i);
+                }
+                else
+                {
+                    hash.insert(i, points[i]);
+                }
+
+                live[i] = !live[i];
+            }
+            else if (live[i] && value < 6)
+            {
+                for (auto& value: points[i])
+                {
+                    value += step(random);
+                }
+
+                hash.move(i, points[i]);
+            }
+        }
+
+        OFX_CHECK(hash.size() == std::size_t(std::count(live.begin(), live.end(), true)));
+
+        for (std::size_t i = 0; i < points.size(); ++i)
+        {
+            OFX_CHECK(hash.contains(i) == live[i]);
+        }
+
+        testSearches(hash, points, live, queries);
+    }
+
+    hash.clear();
+    OFX_CHECK(hash.size() == 0);
+
+    Hash::SearchResults results;
+    OFX_CHECK(hash.findPointsWithinRadius(queries[0], 1000, results) == 0);
+
+    // A negative radius finds nothing rather than walking an inverted range.
+    hash.insert(0, queries[0]);
+    OFX_CHECK(hash.findPointsWithinRadius(queries[0], -1, results) == 0);
+    OFX_CHECK(results.empty());
+    OFX_CHECK(hash.findPointsWithinRadius(queries[0], -1000, results) == 0);
+    OFX_CHECK(hash.findPointsWithinRadius(queries[0], 1, results) == 1);
+
+    // Cell sizes must be positive and finite.
+    for (float cellSize: { 0.0f,
+                           -1.0f,
+                           std::numeric_limits<float>::quiet_NaN(),
+                           std::numeric_limits<float>::infinity() })
+    {
+        bool isConstructorThrown = false;
+
+        try
+        {
+            Hash invalid(cellSize);
+        }
+        catch (const std::invalid_argument&)
+        {
+            isConstructorThrown = true;
+        }
+
+        OFX_CHECK(isConstructorThrown);
+    }
+
+    return ofx::test::report("test_sparse_spatial_hash");
+}
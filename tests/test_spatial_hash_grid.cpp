@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include <limits>
+#include <stdexcept>
+#include "ofx/SpatialHashGrid.h"
+#include "Test.h"
+
+
+// Checks SpatialHashGrid searches against a brute force search.
+
+
+enum
+{
+    NUM_POINTS = 20000,
+    NUM_QUERIES = 100,
+    NUM_NEAREST = 12
+};
+
+
+typedef std::array<float, 3> Point;
+typedef ofx::SpatialHashGrid<Point> Grid;
+
+
+/// \brief Check searches at several radii.
+void testSearches(const Grid& grid,
+                  const std::vector<Point>& points,
+                  const std::vector<Point>& queries)
+{
+    for (const Point& query: queries)
+    {
+        const auto expected = ofx::test::bruteForce(points, query);
+
+        Grid::SearchResults results;
+        grid.findNClosestPoints(query, NUM_NEAREST, results);
+        ofx::test::checkNearest(points, query, expected, NUM_NEAREST, results);
+
+        Grid::Indicies indices;
+        Grid::DistancesSquared distancesSquared;
+        grid.findNClosestPoints(query, NUM_NEAREST, indices, distancesSquared);
+        OFX_CHECK(indices.size() == results.size());
+        OFX_CHECK(distancesSquared.size() == results.size());
+
+        for (float radius: { 10.0f, 50.0f, 200.0f })
+        {
+            grid.findPointsWithinRadius(query, radius, results);
+            OFX_CHECK(ofx::test::isSorted(results));
+            ofx::test::checkRadius(points, query, expected, radius, results);
+        }
+    }
+}
+
+
+int main()
+{
+    auto points = ofx::test::randomPoints<float, 3>(NUM_POINTS, 1);
+    auto queries = ofx::test::randomPoints<float, 3>(NUM_QUERIES, 2);
+
+    // Queries outside the bounds of the points.
+    queries.push_back({{ -500, -500, -500 }});
+    queries.push_back({{ 2000, 500, 500 }});
+
+    for (float cellSize: { 5.0f, 50.0f, 500.0f })
+    {
+        Grid grid(points, cellSize);
+        OFX_CHECK(grid.getEffectiveCellSize() >= cellSize);
+        testSearches(grid, points, queries);
+    }
+
+    // Points moved after a rebuild.
+    Grid grid(points, 50);
+
+    for (auto& point: points)
+    {
+        point[0] = 1000 - point[0];
+        point[2] *= 0.5f;
+    }
+
+    grid.buildIndex();
+    testSearches(grid, points, queries);
+
+    // A flat point set and a single point.
+    std::vector<Point> flat = ofx::test::randomPoints<float, 3>(1000, 3);
+
+    for (auto& point: flat)
+    {
+        point[1] = 7;
+    }
+
+    testSearches(Grid(flat, 20), flat, queries);
+
+    std::vector<Point> single(1, Point{{ 1, 2, 3 }});
+    testSearches(Grid(single, 1), single, queries);
+
+    // Cell sizes must be positive.
+    for (float cellSize: { 0.0f, -1.0f, std::numeric_limits<float>::quiet_NaN() })
+    {
+        bool isConstructorThrown = false;
+        bool isSetterThrown = false;
+
+        try
+        {
+            Grid invalid(points, cellSize);
+        }
+        catch (const std::invalid_argument&)
+        {
+            isConstructorThrown = true;
+        }
+
+        try
+        {
+            grid.setCellSize(cellSize);
+        }
+        catch (const std::invalid_argument&)
+        {
+            isSetterThrown = true;
+        }
+
+        OFX_CHECK(isConstructorThrown);
+        OFX_CHECK(isSetterThrown);
+        OFX_CHECK(grid.getCellSize() == 50);
+    }
+
+    // Tiny cells are enlarged to a sane grid, even when the cell count
+    // overflows a double.
+    for (float cellSize: { 1e-30f, std::numeric_limits<float>::denorm_min() })
+    {
+        Grid tiny(points, cellSize);
+        OFX_CHECK(tiny.getEffectiveCellSize() > 1);
+        testSearches(tiny, points, queries);
+
+        typedef std::array<float, 8> Point8;
+
+        const auto points8 = ofx::test::randomPoints<float, 8>(1000, 4);
+        const auto queries8 = ofx::test::randomPoints<float, 8>(20, 5);
+
+        ofx::SpatialHashGrid<Point8> tiny8(points8, cellSize);
+
+        for (const Point8& query: queries8)
+        {
+            ofx::SpatialHashGrid<Point8>::SearchResults results;
+            tiny8.findPointsWithinRadius(query, 300, results);
+            ofx::test::checkRadius(points8, query, ofx::test::bruteForce(points8, query), 300, results);
+        }
+    }
+
+    // Huge radii find every point, and radii that miss the grid find none.
+    Grid::SearchResults results;
+    OFX_CHECK(grid.findPointsWithinRadius(points[0], 1e30f, results) == points.size());
+    OFX_CHECK(grid.findPointsWithinRadius(points[0], std::numeric_limits<float>::max(), results) == points.size());
+    OFX_CHECK(grid.findPointsWithinRadius(Point{{ 1e30f, 0, 0 }}, 1, results) == 0);
+    OFX_CHECK(grid.findPointsWithinRadius(Point{{ -1e30f, 0, 0 }}, 1, results) == 0);
+
+    return ofx::test::report("test_spatial_hash_grid");
+}
@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2018 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier:	MIT
+//
+
+
+#include "ofx/VPTree.h"
+#include "Test.h"
+
+
+// Checks VPTree searches against a brute force search.
+
+
+int main()
+{
+    const auto points = ofx::test::randomPoints<float, 32>(5000, 1);
+    const auto queries = ofx::test::randomPoints<float, 32>(50, 2);
+
+    for (std::size_t maxLeafSize: { 2, 16 })
+    {
+        ofx::VPTree<std::array<float, 32>> tree(points, maxLeafSize);
+        ofx::test::checkSearches(tree, points, queries, 10, 1200);
+    }
+
+    const auto points3 = ofx::test::randomPoints<float, 3>(10000, 3);
+    const auto queries3 = ofx::test::randomPoints<float, 3>(100, 4);
+
+    ofx::VPTree<std::array<float, 3>> tree3(points3);
+    ofx::test::checkSearches(tree3, points3, queries3, 12, 60);
+
+    return ofx::test::report("test_vptree");
+}